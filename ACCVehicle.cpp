@@ -35,123 +35,128 @@
  * @brief Adaptive cruise control logic
  */
 
+#include <algorithm>
+#include <cmath>
 #include "ACCVehicle.h"
+#include "Lane.h"
 
-ACCVehicle::ACCVehicle(const Vehicle &x) : Vehicle(x) {
+void ACCVehicle::convert(VehicleData &x) {
+    x.kind = VehicleKind::acc;
     // We're a supercar
-    terminalSpeed = 350.0f / 3.6f;
-    maxAcceleration = 12.0f;
-    unsatisfiedTime = 0.0f;
+    x.terminalSpeed = 350.0f / 3.6f;
+    x.maxAcceleration = 12.0f;
+    x.unsatisfied = false;
+    x.unsatisfiedTime = 0.0f;
 }
 
-void ACCVehicle::decideAcceleration(const Neighbours *n) {
+void ACCVehicle::decideAcceleration(Lane &l, size_t i, const Target &front) {
+    float reactionTime = l.reactionTime[i];
+    float a;
+    bool unsatisfied;
+
     // positive -- we have space; negative -- we're too close
-    float distanceDrift = n->front->dist - targetDistance;
+    float distanceDrift = front.dist - l.targetDistance[i];
 
     // positive -- we're going too fast; negative -- we're too slow
-    float speedDrift = v - targetSpeed;
-
-    if (n->front == nullptr) {
-        // No one in sight -- smoothly coast to target speed
-        a = -speedDrift / reactionTime;
-        unsatisfied = false;
-    } else {
-        // We may have a car in front
-        if (distanceDrift > 0) {
-            // Time until we reach the target distance
-            float reachTime = -distanceDrift / n->front->vRel;
-            if (reachTime <= 0.0) {
-                // We will never reach the car in front
-                reachTime = 1e10;
-            }
+    float speedDrift = l.v[i] - l.targetSpeed[i];
+
+    // There's always a car in front: far away when nobody's in sight,
+    // and then we just coast to target speed
+    if (distanceDrift > 0) {
+        // Time until we reach the target distance
+        float reachTime = -distanceDrift / front.vRel;
+        if (reachTime <= 0.0) {
+            // We will never reach the car in front
+            reachTime = 1e10f;
+        }
 
-            reachTime += 0.02;
+        reachTime += 0.02f;
 
-            // Match the front car's speed within reachTime
-            float aCorrectRelativeSpeed = n->front->vRel / reachTime;
+        // Match the front car's speed within reachTime
+        float aCorrectRelativeSpeed = front.vRel / reachTime;
 
-            // Gets us to the target speed within reactionTime
-            float aCorrectSpeed = -speedDrift / reactionTime;
+        // Gets us to the target speed within reactionTime
+        float aCorrectSpeed = -speedDrift / reactionTime;
 
-            a = aCorrectSpeed + aCorrectRelativeSpeed;
+        a = aCorrectSpeed + aCorrectRelativeSpeed;
 
-            // We think about overtaking if we'll reach target distance within
-            // 2 * reactionTime or if we're right at that distance
-            unsatisfied = reachTime < reactionTime * 2 or std::abs(distanceDrift) < 1.0;
+        // We think about overtaking if we'll reach target distance within
+        // 2 * reactionTime or if we're right at that distance
+        unsatisfied = reachTime < reactionTime * 2 or std::abs(distanceDrift) < 1.0;
 
 
-        } else {
-            // Apply panic break if needed
-            float aPanicBreak = 0;
-            if (-distanceDrift > panicDistance) {
-                aPanicBreak = -maxAcceleration;
-            }
+    } else {
+        // Apply panic break if needed
+        float aPanicBreak = 0;
+        if (-distanceDrift > l.panicDistance[i]) {
+            aPanicBreak = -l.maxAcceleration[i];
+        }
 
-            // Decelerate to target distance. Our target speed doesn't matter anymore.
-            float aCorrectDistance = distanceDrift / reactionTime / reactionTime;
-            float aMatchSpeed = 2 * n->front->vRel / reactionTime;
-            a = aPanicBreak + aMatchSpeed + aCorrectDistance;
+        // Decelerate to target distance. Our target speed doesn't matter anymore.
+        float aCorrectDistance = distanceDrift / reactionTime / reactionTime;
+        float aMatchSpeed = 2 * front.vRel / reactionTime;
+        a = aPanicBreak + aMatchSpeed + aCorrectDistance;
 
-            unsatisfied = true;
-        }
+        unsatisfied = true;
     }
 
     // Make it a little snappy
     if (std::abs(a) > 0.5) {
-        a += sgn(a) * 1.0;
+        a += sgn(a) * 1.0f;
     }
 
+    l.a[i] = a;
+    l.unsatisfied[i] = unsatisfied;
 }
 
-bool ACCVehicle::shouldChangeLane(Target *front, Target *back) {
-    if (!canChangeLane(front, back)) {
+bool ACCVehicle::shouldChangeLane(const Lane &l, size_t i, const Target &front, const Target &back) {
+    if (!canChangeLane(l, i, front, back)) {
         return false;
     }
 
+    float targetSpeed = l.targetSpeed[i];
+
     // Front vehicle is too close
-    if (front->dist < targetDistance * 0.5 + panicDistance) {
+    if (front.dist < l.targetDistance[i] * 0.5 + l.panicDistance[i]) {
         return false;
     }
 
 //    float avgSpeed = (v + targetSpeed) / 2;
-//    float newRelativeSpeed = front->vRel + v - avgSpeed;
-    float reachTime = front->dist / front->vRel;
+//    float newRelativeSpeed = front.vRel + v - avgSpeed;
+    float reachTime = front.dist / front.vRel;
 
     if (reachTime < 0.0) reachTime = 1e10;
 
-    return reachTime > reactionTime && front->vRel > -targetSpeed / 20;
+    return reachTime > l.reactionTime[i] && front.vRel > -targetSpeed / 20;
 }
 
-bool ACCVehicle::canChangeLane(Target *front, Target *back) {
-    if (front == nullptr || back == nullptr) {
-        return false;
-    }
-
-    return !(std::abs(front->dist) < panicDistance * 2
-             || std::abs(back->dist) < panicDistance * 2);
+bool ACCVehicle::canChangeLane(const Lane &l, size_t i, const Target &front, const Target &back) {
+    float panicDistance = l.panicDistance[i];
+    return !(std::abs(front.dist) < panicDistance * 2
+             || std::abs(back.dist) < panicDistance * 2);
 }
 
 
-void ACCVehicle::think(const Neighbours *n) {
-    if (unsatisfiedTime > reactionTime) {
-        if (shouldChangeLane(n->frontLeft, n->backLeft)) {
-            action = Action::change_lane_left;
-            unsatisfiedTime = 0.0;
-        } else if (shouldChangeLane(n->frontRight, n->backRight)) {
-            action = Action::change_lane_right;
-            unsatisfiedTime = 0.0;
+void ACCVehicle::think(Lane &l, size_t i, const Neighbours &n, VehicleObserver *highway) {
+    if (l.unsatisfiedTime[i] > l.reactionTime[i]) {
+        if (n.left && shouldChangeLane(l, i, n.frontLeft, n.backLeft)) {
+            l.action[i] = Action::change_lane_left;
+            l.unsatisfiedTime[i] = 0.0;
+        } else if (n.right && shouldChangeLane(l, i, n.frontRight, n.backRight)) {
+            l.action[i] = Action::change_lane_right;
+            l.unsatisfiedTime[i] = 0.0;
         }
     }
 
-    Vehicle::think(n);
+    Vehicle::applyAction(l, i, n, highway);
 }
 
-void ACCVehicle::step(float dt) {
-    Vehicle::step(dt);
+void ACCVehicle::step(Lane &l, size_t i, float dt) {
+    Vehicle::integrate(l, i, dt);
 
-    if (unsatisfied) {
-        unsatisfiedTime += dt;
+    if (l.unsatisfied[i]) {
+        l.unsatisfiedTime[i] += dt;
     } else {
-        unsatisfiedTime = std::max(unsatisfiedTime / 1.3f - dt, 0.0f);
+        l.unsatisfiedTime[i] = std::max(l.unsatisfiedTime[i] / 1.3f - dt, 0.0f);
     }
 }
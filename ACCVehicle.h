@@ -41,40 +41,33 @@
 
 /**
  * A vehicle fitted with our adaptive cruise control system.
+ *
+ * The state lives in the Lane; these functions work on slot i of a lane.
  */
-class ACCVehicle : public Vehicle {
+class ACCVehicle {
 
 private:
-    /**
-     * Marks if the vehicle is currently slowed down by traffic.
-     */
-    bool unsatisfied;
-
-    /**
-     * Marks for how long the vehicle has been slowed down by traffic.
-     */
-    float unsatisfiedTime;
-
     /**
      * Checks if changing lane is a good tactic.
      */
-    bool shouldChangeLane(Target *front, Target *back);
+    static bool shouldChangeLane(const Lane &l, size_t i, const Target &front, const Target &back);
 
-protected:
+public:
     /**
      * Implementation of the cruise control algorithm.
      */
-    virtual void decideAcceleration(const Neighbours *n) override;
-
-    virtual bool canChangeLane(Target *front, Target *back) override;
+    static void decideAcceleration(Lane &l, size_t i, const Target &front);
 
-public:
+    static bool canChangeLane(const Lane &l, size_t i, const Target &front, const Target &back);
 
-    virtual void think(const Neighbours *n) override;
+    static void think(Lane &l, size_t i, const Neighbours &n, VehicleObserver *highway);
 
-    virtual void step(float dt) override;
+    static void step(Lane &l, size_t i, float dt);
 
-    ACCVehicle(const Vehicle &x);
+    /**
+     * Fits the cruise control system to an existing vehicle.
+     */
+    static void convert(VehicleData &x);
 };
 
 
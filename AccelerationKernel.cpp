@@ -0,0 +1,256 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file AccelerationKernel.cpp
+ * @brief Car following for many vehicles at once
+ */
+
+#include <cstring>
+#include "AccelerationKernel.h"
+#include "Lane.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define ACC_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+void AccelerationKernel::runScalar(Lane &l, size_t begin, size_t end,
+                                   const float *frontDist, const float *frontVRel) {
+    for (size_t i = begin; i < end; i++) {
+        Vehicle::decideAcceleration(l, i, Target(frontVRel[i], frontDist[i]));
+    }
+}
+
+#ifdef ACC_KERNEL_X86
+
+/*
+ * Both kernels follow RandomVehicle::decideAcceleration and ACCVehicle::decideAcceleration
+ * operation for operation, so the rounding is the same and the results match bit for bit.
+ * Each branch of the scalar code is worked out for every vehicle, then the masks pick one.
+ */
+
+__attribute__((target("avx2")))
+static void runAVX2(Lane &l, size_t begin, size_t end, const float *frontDist, const float *frontVRel) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 never = _mm256_set1_ps(1e10f);
+    const __m256 snap = _mm256_set1_ps(0.02f);
+    const __m256i accKind = _mm256_set1_epi32((int) VehicleKind::acc);
+
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 dist = _mm256_loadu_ps(frontDist + i);
+        __m256 vRel = _mm256_loadu_ps(frontVRel + i);
+        __m256 v = _mm256_loadu_ps(&l.v[i]);
+        __m256 targetSpeed = _mm256_loadu_ps(&l.targetSpeed[i]);
+        __m256 targetDistance = _mm256_loadu_ps(&l.targetDistance[i]);
+        __m256 reactionTime = _mm256_loadu_ps(&l.reactionTime[i]);
+        __m256 panicDistance = _mm256_loadu_ps(&l.panicDistance[i]);
+        __m256 maxAcceleration = _mm256_loadu_ps(&l.maxAcceleration[i]);
+
+        __m256 distanceDrift = _mm256_sub_ps(dist, targetDistance);
+        __m256 speedDrift = _mm256_sub_ps(v, targetSpeed);
+        __m256 hasSpace = _mm256_cmp_ps(distanceDrift, zero, _CMP_GT_OQ);
+
+        // We have space: close in on the front car and get to the target speed
+        __m256 reachTime = _mm256_div_ps(_mm256_xor_ps(distanceDrift, sign), vRel);
+        __m256 randomReachTime = _mm256_blendv_ps(reachTime, never, _mm256_cmp_ps(reachTime, zero, _CMP_LT_OQ));
+        __m256 accReachTime = _mm256_add_ps(
+                _mm256_blendv_ps(reachTime, never, _mm256_cmp_ps(reachTime, zero, _CMP_LE_OQ)), snap);
+        __m256 aCorrectSpeed = _mm256_div_ps(_mm256_xor_ps(speedDrift, sign), reactionTime);
+        __m256 randomFree = _mm256_add_ps(aCorrectSpeed, _mm256_div_ps(vRel, randomReachTime));
+        __m256 accFree = _mm256_add_ps(aCorrectSpeed, _mm256_div_ps(vRel, accReachTime));
+
+        // We're too close: back off to the target distance, braking hard if we're in panic
+        __m256 panic = _mm256_cmp_ps(_mm256_xor_ps(distanceDrift, sign), panicDistance, _CMP_GT_OQ);
+        __m256 aPanicBreak = _mm256_and_ps(panic, _mm256_xor_ps(maxAcceleration, sign));
+        __m256 aCorrectDistance = _mm256_div_ps(_mm256_div_ps(distanceDrift, reactionTime), reactionTime);
+        __m256 aMatchSpeed = _mm256_div_ps(_mm256_mul_ps(two, vRel), reactionTime);
+        __m256 tooClose = _mm256_add_ps(_mm256_add_ps(aPanicBreak, aMatchSpeed), aCorrectDistance);
+
+        __m256 randomA = _mm256_blendv_ps(tooClose, randomFree, hasSpace);
+        __m256 accA = _mm256_blendv_ps(tooClose, accFree, hasSpace);
+        // ACC: make it a little snappy
+        __m256 snappy = _mm256_cmp_ps(_mm256_andnot_ps(sign, accA), half, _CMP_GT_OQ);
+        __m256 towards = _mm256_or_ps(_mm256_and_ps(accA, sign), one);
+        accA = _mm256_blendv_ps(accA, _mm256_add_ps(accA, towards), snappy);
+
+        __m128i kinds = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(&l.kind[i]));
+        __m256 isAcc = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_cvtepu8_epi32(kinds), accKind));
+        _mm256_storeu_ps(&l.a[i], _mm256_blendv_ps(randomA, accA, isAcc));
+
+        int accBits = _mm256_movemask_ps(isAcc);
+        if (accBits) {
+            __m256 satisfied = _mm256_and_ps(hasSpace, _mm256_andnot_ps(
+                    _mm256_cmp_ps(accReachTime, _mm256_mul_ps(reactionTime, two), _CMP_LT_OQ),
+                    _mm256_cmp_ps(_mm256_andnot_ps(sign, distanceDrift), one, _CMP_NLT_UQ)));
+            int satisfiedBits = _mm256_movemask_ps(satisfied);
+            for (int k = 0; k < 8; k++) {
+                if (accBits & (1 << k)) {
+                    l.unsatisfied[i + k] = !(satisfiedBits & (1 << k));
+                }
+            }
+        }
+    }
+
+    AccelerationKernel::runScalar(l, i, end, frontDist, frontVRel);
+}
+
+static inline __m128 select(__m128 mask, __m128 ifTrue, __m128 ifFalse) {
+    return _mm_or_ps(_mm_and_ps(mask, ifTrue), _mm_andnot_ps(mask, ifFalse));
+}
+
+static void runSSE2(Lane &l, size_t begin, size_t end, const float *frontDist, const float *frontVRel) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 never = _mm_set1_ps(1e10f);
+    const __m128 snap = _mm_set1_ps(0.02f);
+    const __m128i accKind = _mm_set1_epi32((int) VehicleKind::acc);
+    const __m128i zeroBytes = _mm_setzero_si128();
+
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 dist = _mm_loadu_ps(frontDist + i);
+        __m128 vRel = _mm_loadu_ps(frontVRel + i);
+        __m128 v = _mm_loadu_ps(&l.v[i]);
+        __m128 targetSpeed = _mm_loadu_ps(&l.targetSpeed[i]);
+        __m128 targetDistance = _mm_loadu_ps(&l.targetDistance[i]);
+        __m128 reactionTime = _mm_loadu_ps(&l.reactionTime[i]);
+        __m128 panicDistance = _mm_loadu_ps(&l.panicDistance[i]);
+        __m128 maxAcceleration = _mm_loadu_ps(&l.maxAcceleration[i]);
+
+        __m128 distanceDrift = _mm_sub_ps(dist, targetDistance);
+        __m128 speedDrift = _mm_sub_ps(v, targetSpeed);
+        __m128 hasSpace = _mm_cmpgt_ps(distanceDrift, zero);
+
+        // We have space: close in on the front car and get to the target speed
+        __m128 reachTime = _mm_div_ps(_mm_xor_ps(distanceDrift, sign), vRel);
+        __m128 randomReachTime = select(_mm_cmplt_ps(reachTime, zero), never, reachTime);
+        __m128 accReachTime = _mm_add_ps(select(_mm_cmple_ps(reachTime, zero), never, reachTime), snap);
+        __m128 aCorrectSpeed = _mm_div_ps(_mm_xor_ps(speedDrift, sign), reactionTime);
+        __m128 randomFree = _mm_add_ps(aCorrectSpeed, _mm_div_ps(vRel, randomReachTime));
+        __m128 accFree = _mm_add_ps(aCorrectSpeed, _mm_div_ps(vRel, accReachTime));
+
+        // We're too close: back off to the target distance, braking hard if we're in panic
+        __m128 panic = _mm_cmpgt_ps(_mm_xor_ps(distanceDrift, sign), panicDistance);
+        __m128 aPanicBreak = _mm_and_ps(panic, _mm_xor_ps(maxAcceleration, sign));
+        __m128 aCorrectDistance = _mm_div_ps(_mm_div_ps(distanceDrift, reactionTime), reactionTime);
+        __m128 aMatchSpeed = _mm_div_ps(_mm_mul_ps(two, vRel), reactionTime);
+        __m128 tooClose = _mm_add_ps(_mm_add_ps(aPanicBreak, aMatchSpeed), aCorrectDistance);
+
+        __m128 randomA = select(hasSpace, randomFree, tooClose);
+        __m128 accA = select(hasSpace, accFree, tooClose);
+        // ACC: make it a little snappy
+        __m128 snappy = _mm_cmpgt_ps(_mm_andnot_ps(sign, accA), half);
+        __m128 towards = _mm_or_ps(_mm_and_ps(accA, sign), one);
+        accA = select(snappy, _mm_add_ps(accA, towards), accA);
+
+        int32_t kindBytes;
+        std::memcpy(&kindBytes, &l.kind[i], sizeof(kindBytes));
+        __m128i kinds = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(kindBytes), zeroBytes), zeroBytes);
+        __m128 isAcc = _mm_castsi128_ps(_mm_cmpeq_epi32(kinds, accKind));
+        _mm_storeu_ps(&l.a[i], select(isAcc, accA, randomA));
+
+        int accBits = _mm_movemask_ps(isAcc);
+        if (accBits) {
+            __m128 satisfied = _mm_and_ps(hasSpace, _mm_andnot_ps(
+                    _mm_cmplt_ps(accReachTime, _mm_mul_ps(reactionTime, two)),
+                    _mm_cmpnlt_ps(_mm_andnot_ps(sign, distanceDrift), one)));
+            int satisfiedBits = _mm_movemask_ps(satisfied);
+            for (int k = 0; k < 4; k++) {
+                if (accBits & (1 << k)) {
+                    l.unsatisfied[i + k] = !(satisfiedBits & (1 << k));
+                }
+            }
+        }
+    }
+
+    AccelerationKernel::runScalar(l, i, end, frontDist, frontVRel);
+}
+
+typedef void (*KernelFunction)(Lane &l, size_t begin, size_t end, const float *frontDist, const float *frontVRel);
+
+static bool hasAVX2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+void AccelerationKernel::run(Lane &l, size_t begin, size_t end, const float *frontDist, const float *frontVRel) {
+    static const KernelFunction kernel = hasAVX2() ? runAVX2 : runSSE2;
+    kernel(l, begin, end, frontDist, frontVRel);
+}
+
+bool AccelerationKernel::runWith(const char *instructionSet, Lane &l, size_t begin, size_t end,
+                                 const float *frontDist, const float *frontVRel) {
+    if (std::strcmp(instructionSet, "avx2") == 0 && hasAVX2()) {
+        runAVX2(l, begin, end, frontDist, frontVRel);
+    } else if (std::strcmp(instructionSet, "sse2") == 0) {
+        runSSE2(l, begin, end, frontDist, frontVRel);
+    } else if (std::strcmp(instructionSet, "scalar") == 0) {
+        runScalar(l, begin, end, frontDist, frontVRel);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char *AccelerationKernel::instructionSet() {
+    return hasAVX2() ? "avx2" : "sse2";
+}
+
+#else
+
+void AccelerationKernel::run(Lane &l, size_t begin, size_t end, const float *frontDist, const float *frontVRel) {
+    runScalar(l, begin, end, frontDist, frontVRel);
+}
+
+bool AccelerationKernel::runWith(const char *instructionSet, Lane &l, size_t begin, size_t end,
+                                 const float *frontDist, const float *frontVRel) {
+    if (std::strcmp(instructionSet, "scalar") != 0) {
+        return false;
+    }
+    runScalar(l, begin, end, frontDist, frontVRel);
+    return true;
+}
+
+const char *AccelerationKernel::instructionSet() {
+    return "scalar";
+}
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEC_ACC_CPP_ACCELERATIONKERNEL_H
+#define LEC_ACC_CPP_ACCELERATIONKERNEL_H
+
+/**
+ * @file AccelerationKernel.h
+ * @brief Car following for many vehicles at once
+ */
+
+#include <cstddef>
+
+class Lane;
+
+/**
+ * Decides the acceleration of a run of vehicles on one lane, several at a time.
+ *
+ * Does what Vehicle::decideAcceleration does for each vehicle, with SIMD instructions:
+ * both the random vehicle and the ACC laws are worked out for 8 (AVX2) or 4 (SSE2) vehicles,
+ * and the right one is picked with masks instead of branches.
+ * The instruction set is picked at run time, from what the CPU supports.
+ * Results match the scalar code bit for bit.
+ */
+class AccelerationKernel {
+public:
+    /**
+     * Writes Lane::a, and Lane::unsatisfied for ACC vehicles, for the slots in [begin, end).
+     * @param frontDist Distance to the vehicle in front, indexed by slot.
+     * @param frontVRel Relative speed of the vehicle in front, indexed by slot.
+     */
+    static void run(Lane &l, size_t begin, size_t end, const float *frontDist, const float *frontVRel);
+
+    /**
+     * Same as AccelerationKernel::run, one vehicle at a time, through Vehicle::decideAcceleration.
+     */
+    static void runScalar(Lane &l, size_t begin, size_t end, const float *frontDist, const float *frontVRel);
+
+    /**
+     * Same as AccelerationKernel::run, with the given instruction set instead of the one picked for this CPU,
+     * so each of them can be checked against the scalar code (see tests/).
+     * @return false if it can't run here: not built for this architecture, or the CPU doesn't support it.
+     */
+    static bool runWith(const char *instructionSet, Lane &l, size_t begin, size_t end,
+                        const float *frontDist, const float *frontVRel);
+
+    /**
+     * Name of the instruction set AccelerationKernel::run uses on this CPU: "avx2", "sse2" or "scalar".
+     */
+    static const char *instructionSet();
+};
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEC_ACC_CPP_BYTEORDER_H
+#define LEC_ACC_CPP_BYTEORDER_H
+
+/**
+ * @file ByteOrder.h
+ * @brief Little-endian files on any machine
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Files the simulation writes (see Checkpoint) are little-endian, whatever machine writes or reads them.
+ * On little-endian machines, which is nearly all of them, there's nothing to do and columns are copied as is.
+ */
+class ByteOrder {
+public:
+    static bool hostIsLittle() {
+        const uint16_t one = 1;
+        unsigned char first;
+        std::memcpy(&first, &one, 1);
+        return first == 1;
+    }
+
+    /**
+     * Converts n values of the given size between little-endian and the order of this machine, in place.
+     * The same call goes both ways.
+     */
+    static void convert(void *values, size_t size, size_t n) {
+        if (size == 1 || hostIsLittle()) {
+            return;
+        }
+        char *bytes = static_cast<char *>(values);
+        for (size_t i = 0; i < n; i++, bytes += size) {
+            std::reverse(bytes, bytes + size);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,393 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file Checkpoint.cpp
+ * @brief Saving and loading the state of a highway
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "ByteOrder.h"
+#include "Checkpoint.h"
+#include "Error.h"
+#include "Highway.h"
+
+/**
+ * First bytes of every checkpoint.
+ */
+static const char MAGIC[8] = {'A', 'C', 'C', 'S', 'T', 'A', 'T', 'E'};
+
+/**
+ * Bumped whenever the layout of the file changes.
+ */
+const uint32_t CHECKPOINT_VERSION = 2;
+
+/**
+ * Bytes taken by one LaneChangeData in the file.
+ */
+const uint64_t LANE_CHANGE_BYTES = 5 * 4 + 1;
+
+namespace {
+
+template<typename T>
+void put(std::vector<char> &out, const T &value) {
+    const char *bytes = reinterpret_cast<const char *>(&value);
+    size_t start = out.size();
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+    ByteOrder::convert(out.data() + start, sizeof(T), 1);
+}
+
+/**
+ * FNV-1a over the whole file but the checksum itself, which comes last.
+ */
+uint64_t checksum(const char *data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ (unsigned char) data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * Reads values from the mapped file, and throws if it ends too soon.
+ */
+struct Reader {
+    const char *in;
+    const char *end;
+    const std::string &path;
+
+    void need(uint64_t bytes) {
+        if ((uint64_t) (end - in) < bytes) {
+            throw Error("Checkpoint " + path + " is cut short");
+        }
+    }
+
+    /**
+     * Checks there's room for count elements, without multiplying first: a count read from
+     * the file can be anything, and the product would wrap.
+     */
+    void need(uint64_t count, uint64_t elementSize) {
+        if (count > (uint64_t) (end - in) / elementSize) {
+            throw Error("Checkpoint " + path + " is cut short");
+        }
+    }
+
+    template<typename T>
+    T get() {
+        need(sizeof(T));
+        T value;
+        std::memcpy(&value, in, sizeof(T));
+        ByteOrder::convert(&value, sizeof(T), 1);
+        in += sizeof(T);
+        return value;
+    }
+};
+
+/**
+ * A file mapped in memory, read only, for as long as this lives.
+ */
+struct MappedFile {
+    const char *data = nullptr;
+    size_t size = 0;
+
+    MappedFile(const std::string &path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw Error("Can't open checkpoint " + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            size = (size_t) st.st_size;
+            void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            data = p == MAP_FAILED ? nullptr : static_cast<const char *>(p);
+        }
+        close(fd);
+        if (data == nullptr) {
+            throw Error("Can't map checkpoint " + path);
+        }
+    }
+
+    ~MappedFile() {
+        munmap(const_cast<char *>(data), size);
+    }
+};
+
+/**
+ * Checks the header and the checksum, and reads the key and the configuration.
+ * Leaves the reader at the state of the highway.
+ */
+Reader openCheckpoint(const MappedFile &file, const std::string &path, uint64_t &key, HighwayConfig &config) {
+    if (file.size < sizeof(MAGIC) + sizeof(uint64_t) || std::memcmp(file.data, MAGIC, sizeof(MAGIC)) != 0) {
+        throw Error(path + " isn't a checkpoint");
+    }
+    Reader r = {file.data + sizeof(MAGIC), file.data + file.size - sizeof(uint64_t), path};
+    if (r.get<uint32_t>() != CHECKPOINT_VERSION) {
+        throw Error("Checkpoint " + path + " was written by another version");
+    }
+
+    Reader tail = {r.end, file.data + file.size, path};
+    if (tail.get<uint64_t>() != checksum(file.data, file.size - sizeof(uint64_t))) {
+        throw Error("Checkpoint " + path + " is damaged");
+    }
+
+    key = r.get<uint64_t>();
+    uint32_t length = r.get<uint32_t>();
+    r.need(length);
+    std::istringstream text(std::string(r.in, length));
+    r.in += length;
+    config.read(text, path);
+    return r;
+}
+
+}
+
+void Checkpoint::save(const Highway &highway, const std::string &path, uint64_t key) {
+    std::vector<char> out;
+    out.insert(out.end(), MAGIC, MAGIC + sizeof(MAGIC));
+    put(out, CHECKPOINT_VERSION);
+    put(out, key);
+
+    // Where the run writes its trace and recording isn't part of its state: a resumed run that kept them
+    // would open the same files again, and truncate what was written before the crash
+    HighwayConfig saved = highway.getConfig();
+    saved.traceFile.clear();
+    saved.recordFile.clear();
+    std::string config = saved.toString();
+    put(out, (uint32_t) config.size());
+    out.insert(out.end(), config.begin(), config.end());
+
+    put(out, highway.randomSeed);
+    const RandomStream &random = highway.random;
+    for (uint32_t word: random.key) {
+        put(out, word);
+    }
+    for (uint32_t word: random.counter) {
+        put(out, word);
+    }
+    for (uint32_t word: random.buffer) {
+        put(out, word);
+    }
+    put(out, random.used);
+
+    put(out, highway.stepsTaken);
+    put(out, highway.lastTeleportTime);
+    put(out, highway.preferredVehicleId);
+    put(out, highway.selectedVehicleId);
+    put(out, highway.preferredVehicleFrontDistance);
+
+    put(out, (uint64_t) highway.slots.size());
+    put(out, (uint64_t) highway.freeIds.size());
+    for (VehicleId id: highway.freeIds) {
+        put(out, id);
+    }
+
+    // Field by field, so the padding doesn't end up in the file
+    put(out, (uint64_t) highway.laneChangers.size());
+    for (const LaneChangeData &data: highway.laneChangers) {
+        put(out, data.vehicle);
+        put(out, (int32_t) data.from);
+        put(out, (int32_t) data.to);
+        put(out, data.progress);
+        put(out, (int32_t) data.direction);
+        put(out, (uint8_t) data.changed);
+    }
+
+    put(out, (uint32_t) highway.lanes.size());
+    for (const Lane *l: highway.lanes) {
+        put(out, (uint64_t) l->size());
+        l->save(out);
+    }
+    put(out, checksum(out.data(), out.size()));
+
+    // Write next to it, then move it in place, so a crash never leaves a torn file behind
+    std::string temporary = path + ".tmp";
+    FILE *file = std::fopen(temporary.c_str(), "wb");
+    if (file == nullptr) {
+        throw Error("Can't write checkpoint " + temporary);
+    }
+    bool written = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+    written = std::fclose(file) == 0 && written;
+    if (!written || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        throw Error("Can't write checkpoint " + path);
+    }
+}
+
+void Checkpoint::load(Highway &highway, const std::string &path, uint64_t key) {
+    MappedFile file(path);
+    uint64_t savedKey;
+    HighwayConfig config;
+    Reader r = openCheckpoint(file, path, savedKey, config);
+    if (savedKey != key) {
+        throw Error("Checkpoint " + path + " was saved with another configuration");
+    }
+
+    // Read everything before touching the highway, so a bad file leaves it as it was
+    uint64_t randomSeed = r.get<uint64_t>();
+    RandomStream random;
+    for (uint32_t &word: random.key) {
+        word = r.get<uint32_t>();
+    }
+    for (uint32_t &word: random.counter) {
+        word = r.get<uint32_t>();
+    }
+    for (uint32_t &word: random.buffer) {
+        word = r.get<uint32_t>();
+    }
+    random.used = r.get<uint32_t>();
+
+    uint64_t stepsTaken = r.get<uint64_t>();
+    float lastTeleportTime = r.get<float>();
+    VehicleId preferredVehicleId = r.get<VehicleId>();
+    VehicleId selectedVehicleId = r.get<VehicleId>();
+    float preferredVehicleFrontDistance = r.get<float>();
+
+    uint64_t slotCount = r.get<uint64_t>();
+    uint64_t freeCount = r.get<uint64_t>();
+    r.need(freeCount, sizeof(VehicleId));
+    std::vector<VehicleId> freeIds(freeCount);
+    for (VehicleId &id: freeIds) {
+        id = r.get<VehicleId>();
+    }
+
+    uint64_t changerCount = r.get<uint64_t>();
+    r.need(changerCount, LANE_CHANGE_BYTES);
+    std::vector<LaneChangeData> laneChangers(changerCount);
+    for (LaneChangeData &data: laneChangers) {
+        data.vehicle = r.get<VehicleId>();
+        data.from = r.get<int32_t>();
+        data.to = r.get<int32_t>();
+        data.progress = r.get<float>();
+        data.direction = r.get<int32_t>();
+        data.changed = r.get<uint8_t>() != 0;
+    }
+
+    uint32_t laneCount = r.get<uint32_t>();
+    if (laneCount != highway.lanes.size()) {
+        throw Error("Checkpoint " + path + " has a different number of lanes");
+    }
+    size_t vehicleSize = highway.lanes.front()->savedVehicleSize();
+    std::vector<const char *> columns(laneCount);
+    std::vector<uint64_t> sizes(laneCount);
+    uint64_t vehicles = 0;
+    for (uint32_t l = 0; l < laneCount; l++) {
+        sizes[l] = r.get<uint64_t>();
+        r.need(sizes[l], vehicleSize);
+        columns[l] = r.in;
+        r.in += sizes[l] * vehicleSize;
+        vehicles += sizes[l];
+    }
+
+    bool valid = vehicles + freeCount == slotCount && preferredVehicleId < slotCount && random.used <= 4
+                 && (selectedVehicleId == NO_VEHICLE || selectedVehicleId < slotCount);
+
+    // Every id is either on a lane or free, exactly once, and this remembers which lane. Each count was
+    // checked against the bytes left to read before it, so when they add up to slotCount this is no bigger
+    // than the file
+    const uint32_t UNUSED = UINT32_MAX, FREE = UINT32_MAX - 1, CHANGING = UINT32_MAX - 2;
+    std::vector<uint32_t> slotLane(valid ? slotCount : 0, UNUSED);
+    for (uint32_t l = 0; valid && l < laneCount; l++) {
+        // Lane::save starts with the ids
+        for (uint64_t i = 0; valid && i < sizes[l]; i++) {
+            VehicleId id;
+            std::memcpy(&id, columns[l] + i * sizeof(VehicleId), sizeof(VehicleId));
+            ByteOrder::convert(&id, sizeof(id), 1);
+            valid = id < slotCount && slotLane[id] == UNUSED;
+            if (valid) {
+                slotLane[id] = l;
+            }
+        }
+    }
+    for (size_t i = 0; valid && i < freeIds.size(); i++) {
+        valid = freeIds[i] < slotCount && slotLane[freeIds[i]] == UNUSED;
+        if (valid) {
+            slotLane[freeIds[i]] = FREE;
+        }
+    }
+    // The ACC and the selected vehicle are on the road
+    valid = valid && slotLane[preferredVehicleId] < laneCount
+            && (selectedVehicleId == NO_VEHICLE || slotLane[selectedVehicleId] < laneCount);
+
+    // Lane changers are on the road, once each, a lane over. Highway::commitDecisions takes the ones
+    // that haven't moved yet from the lane they're on
+    for (size_t i = 0; valid && i < laneChangers.size(); i++) {
+        const LaneChangeData &data = laneChangers[i];
+        valid = data.vehicle < slotCount && slotLane[data.vehicle] < laneCount
+                && (data.direction == 1 || data.direction == -1)
+                && data.from >= 0 && data.from < (int) laneCount && data.to == data.from + data.direction
+                && data.to >= 0 && data.to < (int) laneCount
+                && data.progress >= 0 && data.progress < 1
+                && (data.changed || slotLane[data.vehicle] == (uint32_t) data.from);
+        if (valid) {
+            slotLane[data.vehicle] = CHANGING;
+        }
+    }
+    if (!valid) {
+        throw Error("Checkpoint " + path + " doesn't add up");
+    }
+
+    highway.randomSeed = randomSeed;
+    highway.random = random;
+    highway.stepsTaken = stepsTaken;
+    highway.lastTeleportTime = lastTeleportTime;
+    highway.preferredVehicleId = preferredVehicleId;
+    highway.selectedVehicleId = selectedVehicleId;
+    highway.preferredVehicleFrontDistance = preferredVehicleFrontDistance;
+    highway.freeIds = freeIds;
+    highway.laneChangers = laneChangers;
+    highway.slots.assign(slotCount, VehicleSlot());
+    for (uint32_t l = 0; l < laneCount; l++) {
+        highway.lanes[l]->load(columns[l], sizes[l]);
+    }
+    highway.reindex();
+    for (const LaneChangeData &data: highway.laneChangers) {
+        highway.slots[data.vehicle].changingLane = true;
+    }
+}
+
+HighwayConfig Checkpoint::config(const std::string &path) {
+    MappedFile file(path);
+    uint64_t key;
+    HighwayConfig config;
+    openCheckpoint(file, path, key, config);
+    // Files saved before they were left out still have them
+    config.traceFile.clear();
+    config.recordFile.clear();
+    return config;
+}
@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEC_ACC_CPP_CHECKPOINT_H
+#define LEC_ACC_CPP_CHECKPOINT_H
+
+/**
+ * @file Checkpoint.h
+ * @brief Saving and loading the state of a highway
+ */
+
+#include <cstdint>
+#include <string>
+#include "HighwayConfig.h"
+
+class Highway;
+
+/**
+ * Saves the whole state of a highway to a binary file, and loads it back.
+ *
+ * The file holds the configuration and everything the next steps depend on: the lanes, column after column,
+ * the vehicles changing lane, the free ids and the random stream. A highway loaded from it steps on exactly
+ * like the one that was saved, on any number of threads.
+ *
+ * Everything is little-endian and versioned, and checked against a checksum when read back.
+ * The file is mapped and read in one go: on a little-endian machine, the columns are copied straight into the lanes.
+ */
+class Checkpoint {
+public:
+    /**
+     * Writes the state of the highway to path, tagged with key.
+     * The file is replaced in one go, so a crash never leaves a torn one behind.
+     * Throws an Error if it can't.
+     */
+    static void save(const Highway &highway, const std::string &path, uint64_t key = 0);
+
+    /**
+     * Replaces the state of the highway with the one saved in path.
+     * The highway has to be made with the same configuration, see Checkpoint::config.
+     * Throws an Error if the file can't be read, is damaged, was written by another version,
+     * or its key or number of lanes are different. The highway is left alone then.
+     */
+    static void load(Highway &highway, const std::string &path, uint64_t key = 0);
+
+    /**
+     * The configuration of the highway saved in path. Throws an Error if it can't be read.
+     * It has no trace or recording file: a resumed run only writes those if asked again, to new files.
+     */
+    static HighwayConfig config(const std::string &path);
+};
+
+#endif
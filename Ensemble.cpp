@@ -0,0 +1,184 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file Ensemble.cpp
+ * @brief Many independent highways, run side by side
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include "Ensemble.h"
+#include "Error.h"
+#include "Highway.h"
+#include "ThreadPool.h"
+
+std::vector<EnsembleRun> Ensemble::run(const std::vector<HighwayConfig> &configs, int runs, int firstSeed,
+                                       double duration, float dt, unsigned threads) {
+    if (runs < 1) {
+        throw Error("An ensemble needs at least one run");
+    }
+    if (firstSeed < 1 || firstSeed > std::numeric_limits<int>::max() - runs) {
+        // Seed 0 would pick a different seed every time
+        throw Error("The seeds of an ensemble must be positive");
+    }
+
+    std::vector<EnsembleRun> results(configs.size() * runs);
+    std::vector<size_t> order(results.size());
+    for (size_t i = 0; i < results.size(); i++) {
+        results[i].config = i / runs;
+        results[i].seed = firstSeed + (int) (i % runs);
+        order[i] = i;
+    }
+
+    // The pool hands out runs in this order: the biggest highways first
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        const HighwayConfig &ca = configs[results[a].config];
+        const HighwayConfig &cb = configs[results[b].config];
+        return (int64_t) ca.lanes * ca.vehiclesPerLane > (int64_t) cb.lanes * cb.vehiclesPerLane;
+    });
+
+    auto task = [&](size_t t) {
+        EnsembleRun &result = results[order[t]];
+        HighwayConfig config = configs[result.config];
+        config.seed = result.seed;
+        runOne(config, duration, dt, result);
+    };
+    ThreadPool pool(threads);
+    pool.run(order.size(), task);
+    return results;
+}
+
+void Ensemble::runOne(const HighwayConfig &base, double duration, float dt, EnsembleRun &result) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // Nothing shared between the runs: no trace, recording or counters, and one thread each
+    HighwayConfig config = base;
+    config.threads = 1;
+    config.traceFile.clear();
+    config.recordFile.clear();
+    config.perfCounters = false;
+
+    long steps = (long) (duration / dt + 0.5);
+    double speedSum = 0;
+    long taken = 0;
+    try {
+        config.validate();
+        Highway high(config);
+        high.reportCollisions = false;
+        high.stabilise();
+
+        uint64_t laneChanges = high.laneChanges;
+        uint64_t accLaneChanges = high.preferredLaneChanges;
+        uint64_t collisions = high.collisions;
+        for (; taken < steps; taken++) {
+            high.step(dt);
+            Vehicle acc = high.preferredVehicle();
+            speedSum += acc.getV();
+            if (high.preferredVehicleFrontDistance < acc.getTargetDistance()) {
+                result.timeTooClose += dt;
+            }
+        }
+        result.laneChanges = high.laneChanges - laneChanges;
+        result.accLaneChanges = high.preferredLaneChanges - accLaneChanges;
+        result.collisions = high.collisions - collisions;
+    } catch (const Error &e) {
+        result.error = e.what();
+    }
+
+    result.simulated = taken * (double) dt;
+    result.accMeanSpeed = taken > 0 ? speedSum / taken : 0;
+    result.wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Adds up a metric over the runs, then works out its mean and spread.
+ */
+class MetricSum {
+public:
+    void add(double value) {
+        if (count == 0) {
+            metric.min = metric.max = value;
+        }
+        metric.min = std::min(metric.min, value);
+        metric.max = std::max(metric.max, value);
+        count++;
+        sum += value;
+        squares += value * value;
+    }
+
+    EnsembleMetric result() const {
+        EnsembleMetric m = metric;
+        if (count > 0) {
+            m.mean = sum / count;
+        }
+        if (count > 1) {
+            // Sample standard deviation; rounding can leave the variance a hair under 0
+            m.stddev = std::sqrt(std::max(0.0, (squares - sum * m.mean) / (count - 1)));
+        }
+        return m;
+    }
+
+private:
+    EnsembleMetric metric;
+    size_t count = 0;
+    double sum = 0;
+    double squares = 0;
+};
+
+EnsembleSummary Ensemble::summarise(const std::vector<EnsembleRun> &runs, size_t config) {
+    EnsembleSummary summary;
+    MetricSum accMeanSpeed, laneChanges, accLaneChanges, collisions, timeTooClose;
+    for (const EnsembleRun &r: runs) {
+        if (r.config != config) {
+            continue;
+        }
+        summary.runs++;
+        if (!r.error.empty()) {
+            summary.failed++;
+            continue;
+        }
+        accMeanSpeed.add(r.accMeanSpeed);
+        laneChanges.add((double) r.laneChanges);
+        accLaneChanges.add((double) r.accLaneChanges);
+        collisions.add((double) r.collisions);
+        timeTooClose.add(r.timeTooClose);
+    }
+    summary.accMeanSpeed = accMeanSpeed.result();
+    summary.laneChanges = laneChanges.result();
+    summary.accLaneChanges = accLaneChanges.result();
+    summary.collisions = collisions.result();
+    summary.timeTooClose = timeTooClose.result();
+    return summary;
+}
@@ -0,0 +1,147 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEC_ACC_CPP_ENSEMBLE_H
+#define LEC_ACC_CPP_ENSEMBLE_H
+
+/**
+ * @file Ensemble.h
+ * @brief Many independent highways, run side by side
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "HighwayConfig.h"
+
+/**
+ * What one run of an ensemble measured, after stabilising.
+ */
+struct EnsembleRun {
+    /**
+     * Index of its configuration, and the seed it ran with.
+     */
+    size_t config = 0;
+    int seed = 0;
+
+    /**
+     * Simulated time, in seconds. Short of the duration asked for if the run failed.
+     */
+    double simulated = 0;
+
+    /**
+     * Mean speed of the ACC, in m/s.
+     */
+    double accMeanSpeed = 0;
+
+    /**
+     * Lane changes started by any vehicle, and by the ACC.
+     */
+    uint64_t laneChanges = 0;
+    uint64_t accLaneChanges = 0;
+
+    /**
+     * Overlapping neighbours, counted once per step they overlap (Highway::testForCollision).
+     */
+    uint64_t collisions = 0;
+
+    /**
+     * Time, in seconds, the ACC spent closer to the vehicle ahead than its target distance.
+     */
+    double timeTooClose = 0;
+
+    /**
+     * Wall time of the run, stabilising included, in seconds.
+     */
+    double wallTime = 0;
+
+    /**
+     * Why the run stopped early. Empty if it didn't.
+     */
+    std::string error;
+};
+
+/**
+ * Mean, standard deviation and range of one metric over the runs of a configuration.
+ */
+struct EnsembleMetric {
+    double mean = 0;
+    double stddev = 0;
+    double min = 0;
+    double max = 0;
+};
+
+/**
+ * The runs of one configuration, summed up. Failed runs are left out of the metrics.
+ */
+struct EnsembleSummary {
+    size_t runs = 0;
+    size_t failed = 0;
+    EnsembleMetric accMeanSpeed;
+    EnsembleMetric laneChanges;
+    EnsembleMetric accLaneChanges;
+    EnsembleMetric collisions;
+    EnsembleMetric timeTooClose;
+};
+
+/**
+ * Runs many independent highways, every one with its own configuration and seed, to see how
+ * the ACC does on average and how much that varies, instead of over a single run.
+ *
+ * Every run steps its highway on one thread, with no trace, recording or performance counters,
+ * and the runs are spread over a ThreadPool: whichever thread is free takes the next run,
+ * the biggest highways first, so a long run doesn't start last and hold up the batch.
+ * A run plays out the same whichever thread it lands on, so the results only depend on the seeds.
+ */
+class Ensemble {
+public:
+    /**
+     * Runs every configuration with the seeds firstSeed, firstSeed + 1... firstSeed + runs - 1,
+     * each for duration seconds of steps of dt, after stabilising.
+     * A run that fails reports its Error, and the others carry on.
+     * @param threads Runs going at once. 0 uses every core.
+     * @return The runs of the first configuration, in seed order, then those of the second one...
+     */
+    static std::vector<EnsembleRun> run(const std::vector<HighwayConfig> &configs, int runs, int firstSeed,
+                                        double duration, float dt, unsigned threads);
+
+    /**
+     * Sums up the runs of one configuration.
+     */
+    static EnsembleSummary summarise(const std::vector<EnsembleRun> &runs, size_t config);
+
+private:
+    static void runOne(const HighwayConfig &config, double duration, float dt, EnsembleRun &result);
+};
+
+#endif
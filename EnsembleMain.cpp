@@ -0,0 +1,245 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file EnsembleMain.cpp
+ * @brief Entry point of the ensemble runner: many independent highways, summed up
+ */
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Ensemble.h"
+#include "Error.h"
+#include "Trace.h"
+
+/**
+ * What to run, on top of the highway options.
+ */
+struct EnsembleOptions {
+    /**
+     * Runs per configuration, and the seed of the first one.
+     */
+    int runs = 10;
+    int seed = 1;
+
+    /**
+     * Simulated time of every run, in seconds, and the simulation step.
+     */
+    double duration = 60;
+    float dt = 1.0f / 60.0f;
+
+    /**
+     * Runs going at once. 0 uses every core.
+     */
+    int jobs = 0;
+
+    /**
+     * Config files, each one a configuration of its own on top of the highway options. None runs those alone.
+     */
+    std::vector<std::string> configs;
+
+    /**
+     * Where to write a CSV line per run. Empty for none.
+     */
+    std::string csv;
+};
+
+static double parseSeconds(const std::string &key, const std::string &value) {
+    std::istringstream in(value);
+    double s;
+    if (!(in >> s) || !(in >> std::ws).eof() || s <= 0) {
+        throw Error("Bad duration for " + key + ": '" + value + "'");
+    }
+    return s;
+}
+
+static int parseCount(const std::string &key, const std::string &value, int least) {
+    std::istringstream in(value);
+    int n;
+    if (!(in >> n) || !(in >> std::ws).eof() || n < least) {
+        throw Error("Bad number for " + key + ": '" + value + "'");
+    }
+    return n;
+}
+
+static std::vector<std::string> splitList(const std::string &list) {
+    std::vector<std::string> items;
+    std::istringstream in(list);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+/**
+ * Takes out the ensemble options, and passes the rest on to HighwayConfig::fromArgs.
+ * @return One configuration per config file, or the highway options alone.
+ */
+static std::vector<HighwayConfig> parseArgs(int argc, char **argv, EnsembleOptions &options) {
+    std::vector<char *> rest;
+    rest.push_back(argv[0]);
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if ((arg == "--duration" || arg == "--dt") && i + 1 < argc) {
+            double s = parseSeconds(arg, argv[++i]);
+            if (arg == "--duration") {
+                options.duration = s;
+            } else {
+                options.dt = (float) s;
+            }
+        } else if (arg == "--runs" && i + 1 < argc) {
+            options.runs = parseCount(arg, argv[++i], 1);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            options.seed = parseCount(arg, argv[++i], 1);
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            options.jobs = parseCount(arg, argv[++i], 0);
+        } else if (arg == "--configs" && i + 1 < argc) {
+            options.configs = splitList(argv[++i]);
+        } else if (arg == "--csv" && i + 1 < argc) {
+            options.csv = argv[++i];
+        } else if (arg == "--help") {
+            throw Error("Usage: acc_ensemble [options]\n"
+                        "  --runs K                  runs per configuration\n"
+                        "  --seed S                  seed of the first run, the others take S + 1, S + 2...\n"
+                        "  --duration S              simulated time of every run, in seconds\n"
+                        "  --dt S                    simulation step, in seconds\n"
+                        "  --jobs N                  runs going at once, one thread each (0: every core)\n"
+                        "  --configs A.cfg,B.cfg     compare configurations, each on top of the options below\n"
+                        "  --csv FILE                also write a line per run to FILE\n"
+                        + HighwayConfig::usage());
+        } else {
+            rest.push_back(argv[i]);
+        }
+    }
+
+    HighwayConfig base = HighwayConfig::fromArgs((int) rest.size(), rest.data());
+    std::vector<HighwayConfig> configs;
+    for (const std::string &path: options.configs) {
+        HighwayConfig config = base;
+        config.load(path);
+        config.validate();
+        configs.push_back(config);
+    }
+    if (configs.empty()) {
+        configs.push_back(base);
+    }
+    return configs;
+}
+
+static void writeCsv(std::ostream &out, const std::vector<EnsembleRun> &runs, const std::vector<std::string> &names) {
+    out << "config,seed,simulated_s,acc_mean_speed_kmh,lane_changes,acc_lane_changes,collisions,"
+           "time_too_close_s,wall_time_s,error\n";
+    for (const EnsembleRun &r: runs) {
+        out << names[r.config] << "," << r.seed << "," << r.simulated << "," << r.accMeanSpeed * 3.6 << ","
+            << r.laneChanges << "," << r.accLaneChanges << "," << r.collisions << "," << r.timeTooClose << ","
+            << r.wallTime << "," << r.error << "\n";
+    }
+}
+
+static void printMetric(const char *name, const EnsembleMetric &m, double scale) {
+    std::cout << "  " << std::left << std::setw(20) << name << std::right
+              << std::setw(12) << m.mean * scale << " " << std::setw(12) << m.stddev * scale << " "
+              << std::setw(12) << m.min * scale << " " << std::setw(12) << m.max * scale << "\n";
+}
+
+int main(int argc, char **argv) {
+    Trace::setThreadName("Main");
+    EnsembleOptions options;
+    std::vector<HighwayConfig> configs;
+    try {
+        configs = parseArgs(argc, argv, options);
+    } catch (const Error &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> names = options.configs;
+    if (names.empty()) {
+        names.push_back("default");
+    }
+
+    std::vector<EnsembleRun> runs;
+    try {
+        runs = Ensemble::run(configs, options.runs, options.seed, options.duration, options.dt,
+                             (unsigned) options.jobs);
+    } catch (const Error &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    double wallTime = 0;
+    for (const EnsembleRun &r: runs) {
+        if (!r.error.empty()) {
+            std::cerr << names[r.config] << ", seed " << r.seed << ": " << r.error << std::endl;
+        }
+        wallTime += r.wallTime;
+    }
+
+    if (!options.csv.empty()) {
+        std::ofstream out(options.csv.c_str());
+        writeCsv(out, runs, names);
+        if (!out) {
+            std::cerr << "Can't write " << options.csv << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << runs.size() << " runs of " << options.duration << " s, " << wallTime << " s of run time\n"
+              << std::fixed << std::setprecision(3);
+    bool failed = false;
+    for (size_t c = 0; c < configs.size(); c++) {
+        EnsembleSummary s = Ensemble::summarise(runs, c);
+        failed = failed || s.failed > 0;
+        std::cout << "\n" << names[c] << ": " << s.runs << " runs";
+        if (s.failed > 0) {
+            std::cout << ", " << s.failed << " failed";
+        }
+        std::cout << "\n  " << std::left << std::setw(20) << "" << std::right << std::setw(12) << "mean"
+                  << " " << std::setw(12) << "stddev" << " " << std::setw(12) << "min"
+                  << " " << std::setw(12) << "max" << "\n";
+        printMetric("ACC speed (km/h)", s.accMeanSpeed, 3.6);
+        printMetric("lane changes", s.laneChanges, 1);
+        printMetric("ACC lane changes", s.accLaneChanges, 1);
+        printMetric("collisions", s.collisions, 1);
+        printMetric("ACC too close (s)", s.timeTooClose, 1);
+    }
+    std::cout << std::flush;
+
+    return failed ? 1 : 0;
+}
@@ -48,7 +48,7 @@ static Interval intPosition(-POSITION_MAX, POSITION_MAX);
 static Interval intHeight(-55, 55);
 
 
-FoliageTriangle::FoliageTriangle(float centerX, float ratio) {
+FoliageTriangle::FoliageTriangle(double centerX, float ratio) {
     g = intGreen.uniform();
     r = intRedBlue.uniform();
     b = intRedBlue.uniform();
@@ -61,7 +61,7 @@ FoliageTriangle::FoliageTriangle(float centerX, float ratio) {
     dx = centerX + intPosition.uniform() * (ratio + 1) / ratio;
 }
 
-void Foliage2D::draw(float centerX) {
+void Foliage2D::draw(double centerX) {
     glBegin(GL_TRIANGLES);
     for (FoliageTriangle *tr: triangles) {
         if (tr->dx < centerX + -POSITION_MAX / ratio - POSITION_MAX) {
@@ -79,7 +79,7 @@ void Foliage2D::draw(float centerX) {
     glEnd();
 }
 
-Foliage2D::Foliage2D(float ratio, float centerX) : ratio(ratio) {
+Foliage2D::Foliage2D(float ratio, double centerX) : ratio(ratio) {
     for (int i = 0; i < N_FOLIAGES; i++) {
         triangles.push_back(new FoliageTriangle(centerX, ratio));
     }
@@ -45,9 +45,9 @@
 struct FoliageTriangle {
     float r, g, b;
     float pos[6];
-    float dx;
+    double dx;
 
-    FoliageTriangle(float centerX, float ratio);
+    FoliageTriangle(double centerX, float ratio);
 };
 
 /**
@@ -56,9 +56,9 @@ struct FoliageTriangle {
  */
 class Foliage2D {
 public:
-    void draw(float centerX);
+    void draw(double centerX);
 
-    Foliage2D(float ratio, float centerX);
+    Foliage2D(float ratio, double centerX);
 
     virtual ~Foliage2D();
 
@@ -0,0 +1,271 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file HeadlessMain.cpp
+ * @brief Entry point of the simulation without a window
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "AccelerationKernel.h"
+#include "AllocationCounter.h"
+#include "Checkpoint.h"
+#include "Error.h"
+#include "Trace.h"
+#include "Highway.h"
+#include "PerfCounters.h"
+#include "TrajectoryRecorder.h"
+
+/**
+ * What to run, on top of the highway options.
+ */
+struct HeadlessOptions {
+    /**
+     * Simulated time, in seconds.
+     */
+    double duration = 60;
+
+    /**
+     * Simulation step, in seconds.
+     */
+    float dt = 1.0f / 60.0f;
+
+    /**
+     * Where to save checkpoints. Empty for none.
+     */
+    std::string checkpoint;
+
+    /**
+     * Simulated time between two checkpoints, in seconds. 0 only saves one at the end.
+     */
+    double checkpointEvery = 0;
+
+    /**
+     * Checkpoint to carry on from, instead of starting afresh.
+     */
+    std::string resume;
+};
+
+static double parseSeconds(const std::string &key, const std::string &value) {
+    std::istringstream in(value);
+    double s;
+    if (!(in >> s) || !(in >> std::ws).eof() || s <= 0) {
+        throw Error("Bad duration for " + key + ": '" + value + "'");
+    }
+    return s;
+}
+
+/**
+ * Takes out the headless options, and passes the rest on to HighwayConfig::fromArgs.
+ */
+static HighwayConfig parseArgs(int argc, char **argv, HeadlessOptions &options) {
+    std::vector<char *> rest;
+    rest.push_back(argv[0]);
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if ((arg == "--duration" || arg == "--dt" || arg == "--checkpoint-every") && i + 1 < argc) {
+            double s = parseSeconds(arg, argv[++i]);
+            if (arg == "--duration") {
+                options.duration = s;
+            } else if (arg == "--dt") {
+                options.dt = (float) s;
+            } else {
+                options.checkpointEvery = s;
+            }
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            options.checkpoint = argv[++i];
+        } else if (arg == "--resume" && i + 1 < argc) {
+            options.resume = argv[++i];
+        } else if (arg == "--help") {
+            throw Error("Usage: acc_sim_headless [options]\n"
+                        "  --duration S              simulated time, in seconds\n"
+                        "  --dt S                    simulation step, in seconds\n"
+                        "  --checkpoint FILE         save the highway to FILE at the end, see --checkpoint-every\n"
+                        "  --checkpoint-every S      also save it every S seconds of simulated time\n"
+                        "  --resume FILE             carry on from a checkpoint, with its options, up to --duration\n"
+                        + HighwayConfig::usage());
+        } else {
+            rest.push_back(argv[i]);
+        }
+    }
+
+    // The options after --resume override the ones saved with the highway
+    HighwayConfig base;
+    if (!options.resume.empty()) {
+        base = Checkpoint::config(options.resume);
+    }
+    return HighwayConfig::fromArgs((int) rest.size(), rest.data(), base);
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+    Trace::setThreadName("Main");
+    HeadlessOptions options;
+    HighwayConfig config;
+    try {
+        config = parseArgs(argc, argv, options);
+    } catch (const Error &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    try {
+        Highway high(config);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (options.resume.empty()) {
+            high.stabilise();
+        } else {
+            Checkpoint::load(high, options.resume);
+        }
+        double stabiliseTime = secondsSince(start);
+
+        PerfCounters::reset();
+        long steps = (long) (options.duration / options.dt + 0.5);
+        long checkpointSteps = (long) (options.checkpointEvery / options.dt + 0.5);
+        // A resumed run already took some of them
+        long first = std::min(steps, std::max(0L, (long) high.stepsTaken - config.stabiliseSteps));
+        size_t vehicleSteps = 0;
+        size_t inversions = 0;
+        int checkpoints = 0;
+        double checkpointTime = 0;
+        uint64_t checkpointAllocations = 0;
+        uint64_t allocations = AllocationCounter::count();
+
+        auto saveCheckpoint = [&]() {
+            std::chrono::steady_clock::time_point saveStart = std::chrono::steady_clock::now();
+            uint64_t saveAllocations = AllocationCounter::count();
+            Checkpoint::save(high, options.checkpoint);
+            checkpointAllocations += AllocationCounter::count() - saveAllocations;
+            checkpointTime += secondsSince(saveStart);
+            checkpoints++;
+        };
+
+        start = std::chrono::steady_clock::now();
+        for (long s = first; s < steps; s++) {
+            high.step(options.dt);
+            inversions += high.lastSortInversions;
+            for (Lane *l: high.lanes) {
+                vehicleSteps += l->size();
+            }
+            if (!options.checkpoint.empty() && checkpointSteps > 0 && (s + 1) % checkpointSteps == 0
+                && s + 1 < steps) {
+                saveCheckpoint();
+            }
+        }
+        if (!options.checkpoint.empty()) {
+            saveCheckpoint();
+        }
+        double wallTime = secondsSince(start) - checkpointTime;
+        allocations = AllocationCounter::count() - allocations - checkpointAllocations;
+        steps -= first;
+
+        size_t vehicles = 0;
+        double speedSum = 0;
+        for (Lane *l: high.lanes) {
+            vehicles += l->size();
+            for (float v: l->v) {
+                speedSum += v;
+            }
+        }
+        Vehicle acc = high.preferredVehicle();
+
+        std::cout << "lanes              " << config.lanes << "\n"
+                  << "vehicles           " << vehicles << "\n"
+                  << "threads            " << high.threads() << "\n"
+                  << "simd               " << AccelerationKernel::instructionSet() << "\n"
+                  << "simulated          " << steps * options.dt << " s in " << steps << " steps\n"
+                  << "stabilise time     " << stabiliseTime << " s"
+                  << (high.warmStarted ? " (warm start)" : options.resume.empty() ? "" : " (resumed)") << "\n"
+                  << "wall time          " << wallTime << " s\n"
+                  << "throughput         " << vehicleSteps / wallTime << " vehicle-steps/s\n"
+                  << "time per vehicle   " << wallTime * 1e9 / vehicleSteps << " ns/vehicle-step\n"
+                  << "mean speed         " << speedSum / vehicles * 3.6 << " km/h\n"
+                  << "ACC speed          " << acc.getV() * 3.6 << " km/h\n"
+                  << "ACC front distance " << high.preferredVehicleFrontDistance << " m\n"
+                  << "overtakes sorted   " << inversions << "\n"
+                  << "heap allocations   " << allocations << std::endl;
+
+        if (checkpoints > 0) {
+            std::cout << "checkpoints        " << checkpoints << ", " << checkpointTime * 1000 / checkpoints
+                      << " ms each" << std::endl;
+        }
+
+        const TrajectoryRecorder *recorder = high.trajectoryRecorder();
+        if (recorder != nullptr) {
+            high.stopRecording();
+            // Raw, a vehicle takes an id, a lane, a double position, a speed, an acceleration, a length and a width: 32 bytes
+            std::cout << "recorded           " << recorder->frames() << " steps, " << recorder->bytesWritten()
+                      << " bytes, " << (double) recorder->bytesWritten() / vehicleSteps
+                      << " bytes/vehicle-step (32 raw), " << recorder->stalls() << " stalls" << std::endl;
+        }
+
+        if (high.ringLength() > 0) {
+            // The population is fixed, so density and flow hold still once the traffic settles
+            double density = vehicles / (high.ringLength() / 1000 * config.lanes);
+            std::cout << "ring length        " << high.ringLength() << " m\n"
+                      << "density            " << density << " vehicles/km/lane\n"
+                      << "flow               " << density * speedSum / vehicles * 3.6 << " vehicles/h/lane"
+                      << std::endl;
+        }
+
+#ifdef ACC_PROFILE_STEP
+        const StepProfile &profile = high.profile;
+        std::cout << "\nstep phases, last " << profile.size() << " steps (ms, mean / p99):\n"
+                  << std::fixed << std::setprecision(4);
+        for (size_t p = 0; p < STEP_PHASE_COUNT; p++) {
+            StepPhase phase = (StepPhase) p;
+            std::cout << "  " << std::left << std::setw(20) << StepProfile::name(phase) << std::right
+                      << std::setw(10) << profile.mean(phase) << " / " << profile.p99(phase) << "\n";
+        }
+        std::cout << std::flush;
+#endif
+
+        if (config.perfCounters) {
+            std::cout << "\n" << PerfCounters::report() << std::flush;
+        }
+    } catch (const Error &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
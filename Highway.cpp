@@ -36,13 +36,20 @@
  */
 
 #include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <iostream>
-#include <map>
-#include <sstream>
+#include <random>
 #include "Highway.h"
+#include "AccelerationKernel.h"
 #include "RandomVehicle.h"
 #include "ACCVehicle.h"
 #include "Error.h"
+#include "AllocationCounter.h"
+#include "PerfCounters.h"
+#include "Trace.h"
+#include "TrajectoryRecorder.h"
+#include "WarmStart.h"
 
 /**
  * Max X coordinate for any vehicle.
@@ -50,245 +57,746 @@
  */
 const float MAX_X_COORDINATE = 1e12f;
 
-/**
- * Number of lanes on the highway. All lanes go right.
- */
-const int N_LANES = 3;
 const float MAX_DELTA_X = 165;
 const float MIN_DELTA_X = 125;
-const int N_VEHICLES_PER_LANE = 40;
-const float TELEPORT_DISTANCE = N_VEHICLES_PER_LANE * MAX_DELTA_X / 1.6f;
 const float TELEPORT_INTERVAL = 2.0f;
 
-const float MAX_VIEW_DISTANCE = 200.0f;
-
-const int STABILISE_STEPS = 2000;
 const float STABILISE_DT = 1.0f / 60.0f;
 
+/**
+ * Most vehicles stepped as one task by the parallel phases of Highway::step.
+ */
+const size_t STEP_CHUNK_SIZE = 4096;
+
+/**
+ * Smaller highways are stepped on the calling thread: waking the pool would cost more than it saves.
+ */
+const size_t MIN_PARALLEL_VEHICLES = 2 * STEP_CHUNK_SIZE;
+
+/**
+ * Most orders from the user waiting for the next step. A batch of vehicles is a single order.
+ */
+const size_t COMMAND_CAPACITY = 1024;
+
+/**
+ * Room reserved on every lane beyond its share of vehicles, for the ones changing lanes or added by hand.
+ */
+const size_t LANE_HEADROOM = 64;
+
 Interval deltaX(MIN_DELTA_X, MAX_DELTA_X); // m
+Interval accShare(0, 1);
+Interval placement(0, 1);
 
 const Target FAR_IN_FRONT = Target(0, 1e6f); // 1000km, basically infinity
 const Target FAR_IN_BACK = Target(0, -1e6f); // 1000km, basically infinity
 
-static void check_coordinate(float x) {
+/**
+ * Times a phase of the step for the statistics, the hardware counters and the trace.
+ */
+#define STEP_PHASE(phase, region) \
+    ACC_PROFILE_SCOPE(profile.current(phase)); \
+    ACC_PERF_REGION(region); \
+    ACC_TRACE_SCOPE(StepProfile::name(phase))
+
+static void check_coordinate(double x) {
     if(std::isnan(x) || std::abs(x) > MAX_X_COORDINATE) {
         throw Error("The X coordinate of some car is diverging!");
     }
 }
 
-Highway::Highway() : preferredVehicle(nullptr), lastTeleportTime(0) {
-    for (int i = 0; i < N_LANES; i++) {
+Highway::Highway(const HighwayConfig &config) :
+        preferredVehicleId(NO_VEHICLE),
+        config(config),
+        commands(new SpscQueue<HighwayCommand>(COMMAND_CAPACITY)),
+        recorder(nullptr),
+        lastTeleportTime(0) {
+    config.validate();
+
+    // Before the threads start, so they're counted too
+    if (config.perfCounters && !PerfCounters::enable()) {
+        std::cerr << PerfCounters::status() << std::endl;
+    }
+    if (!config.traceFile.empty()) {
+        Trace::enable(config.traceFile);
+    }
+    pool = new ThreadPool((unsigned) config.threads);
+
+    randomSeed = (uint64_t) config.seed;
+    if (randomSeed == 0) {
+        randomSeed = ((uint64_t) std::random_device{}() << 32) | std::random_device{}();
+    }
+    random = RandomStream(randomSeed, NO_VEHICLE, 0);
+
+    int nLanes = config.lanes;
+    int perLane = config.vehiclesPerLane;
+
+    teleportDistance = config.teleportDistance;
+    if (teleportDistance <= 0) {
+        teleportDistance = perLane * MAX_DELTA_X / 1.6f;
+    }
+
+    // Lane changes move vehicles around, the busiest lane ends up with up to one and a half times its share
+    // on a long run. Leave every lane room for twice that share, so none has to grow during a step
+    size_t laneCapacity = 2 * (size_t) perLane + LANE_HEADROOM;
+    // And some room for vehicles added by hand
+    size_t vehicleCapacity = (size_t) nLanes * (perLane + perLane / 4 + LANE_HEADROOM);
+    slots.reserve(vehicleCapacity);
+    freeIds.reserve(vehicleCapacity);
+    for (int i = 0; i < nLanes; i++) {
         Lane *lane = new Lane;
+        lane->reserve(laneCapacity);
 
-        float x = deltaX.uniform();
-        for (int j = 0; j < N_VEHICLES_PER_LANE; j++) {
-            x += deltaX.uniform();
-            RandomVehicle *vehicle = new RandomVehicle(this, x, i);
-            lane->vehicles.push_back(vehicle);
+        if (config.ringLength > 0) {
+            // Spread evenly around the ring, so nobody starts too close
+            double spacing = config.ringLength / perLane;
+            for (int j = 0; j < perLane; j++) {
+                lane->push_back(spawn((j + 0.5) * spacing, i));
+            }
+        } else {
+            double x = deltaX.uniform(random);
+            for (int j = 0; j < perLane; j++) {
+                x += deltaX.uniform(random);
+                lane->push_back(spawn(x, i));
+            }
         }
         lanes.push_back(lane);
     }
 
-    preferredVehicle = (lanes[N_LANES / 2]->vehicles.at(N_VEHICLES_PER_LANE / 2));
-    lanes[N_LANES / 2]->vehicles[N_VEHICLES_PER_LANE / 2] = new ACCVehicle(*preferredVehicle);
-    delete preferredVehicle;
+    // The lane changes under way, up to a tenth of the vehicles on a busy road, and the vehicles they move
+    size_t changeCapacity = (size_t) perLane / 4 + LANE_HEADROOM;
+    laneChangers.reserve(nLanes * changeCapacity);
+    arrivals.reserve(nLanes * changeCapacity);
+    departures.reserve(nLanes * changeCapacity);
+    laneSlots.resize(nLanes);
+    for (std::vector<uint32_t> &slotList: laneSlots) {
+        slotList.reserve(changeCapacity);
+    }
+
+    Lane &middle = *lanes[nLanes / 2];
+    VehicleData acc = middle.get(perLane / 2);
+    ACCVehicle::convert(acc);
+    middle.set(perLane / 2, acc);
+
+    preferredVehicleId = acc.id;
+    reindex();
 
-    preferredVehicle = lanes[N_LANES / 2]->vehicles[N_VEHICLES_PER_LANE / 2];
+    if (!config.recordFile.empty()) {
+        recorder = new TrajectoryRecorder(config.recordFile, (uint32_t) nLanes, config.ringLength);
+    }
 }
 
 Highway::Highway(const Highway &orig) :
-        lanes(orig.lanes),
-        preferredVehicle(orig.preferredVehicle),
-        lastTeleportTime(0) {
+        preferredVehicleId(orig.preferredVehicleId),
+        selectedVehicleId(orig.selectedVehicleId),
+        preferredVehicleFrontDistance(orig.preferredVehicleFrontDistance),
+        stepsTaken(orig.stepsTaken),
+        config(orig.config),
+        pool(new ThreadPool(orig.pool->size())),
+        randomSeed(orig.randomSeed),
+        random(orig.random),
+        commands(new SpscQueue<HighwayCommand>(COMMAND_CAPACITY)),
+        recorder(nullptr),
+        teleportDistance(orig.teleportDistance),
+        lastTeleportTime(orig.lastTeleportTime),
+        laneChangers(orig.laneChangers),
+        slots(orig.slots),
+        freeIds(orig.freeIds) {
+    // Each highway owns its lanes, with the same room to grow
+    for (const Lane *l: orig.lanes) {
+        Lane *lane = new Lane(*l);
+        lane->reserve(l->x.capacity());
+        lanes.push_back(lane);
+    }
+    slots.reserve(orig.slots.capacity());
+    freeIds.reserve(orig.freeIds.capacity());
+    laneChangers.reserve(orig.laneChangers.capacity());
+    arrivals.reserve(orig.arrivals.capacity());
+    departures.reserve(orig.departures.capacity());
+    laneSlots.resize(lanes.size());
+    for (size_t l = 0; l < orig.laneSlots.size(); l++) {
+        laneSlots[l].reserve(orig.laneSlots[l].capacity());
+    }
 }
 
 Highway::~Highway() {
+    delete recorder;
     for (Lane *l: lanes) {
         delete l;
     }
     lanes.clear();
+    delete pool;
+    delete commands;
+}
+
+VehicleData Highway::spawn(double X, float lane) {
+    VehicleData d = RandomVehicle::create(X, lane, random);
+    if (config.accRatio > 0 && accShare.uniform(random) < config.accRatio) {
+        ACCVehicle::convert(d);
+    }
+    if (freeIds.empty()) {
+        d.id = (VehicleId) slots.size();
+        slots.push_back(VehicleSlot());
+    } else {
+        d.id = freeIds.back();
+        freeIds.pop_back();
+    }
+    return d;
+}
+
+void Highway::release(VehicleId id) {
+    if (id == selectedVehicleId) {
+        selectedVehicleId = NO_VEHICLE;
+    }
+    freeIds.push_back(id);
+}
+
+void Highway::reindex() {
+    for (uint32_t l = 0; l < lanes.size(); l++) {
+        reindex(l, 0);
+    }
+}
+
+Vehicle Highway::vehicle(VehicleId id) {
+    if (id == NO_VEHICLE) {
+        return Vehicle();
+    }
+    const VehicleSlot &s = slots[id];
+    return Vehicle(lanes[s.lane], s.index);
 }
 
 void Highway::teleportVehicles() {
-    float centerX = preferredVehicle->getX();
-    float X;
+    double centerX = preferredVehicle().getX();
+    double X;
 
-    Vehicle *v;
     float lane = 0;
+    int64_t teleported = 0;
     for (Lane *l: lanes) {
-        int addFront = 0, addBack = 0;
-        while (std::abs(l->vehicles.front()->getX() - centerX) > TELEPORT_DISTANCE) {
-            v = l->vehicles.front();
-            l->vehicles.pop_front();
+        size_t n = l->size();
+        size_t addFront = 0, addBack = 0;
+        while (addBack < n && std::abs(l->x[addBack] - centerX) > teleportDistance) {
             addBack++;
-            delete v;
         }
-
-        while (std::abs(l->vehicles.back()->getX() - centerX) > TELEPORT_DISTANCE) {
-            v = l->vehicles.back();
-            l->vehicles.pop_back();
+        while (addBack + addFront < n && std::abs(l->x[n - 1 - addFront] - centerX) > teleportDistance) {
             addFront++;
-            delete v;
+        }
+        if (addBack + addFront == n) {
+            // Nothing left to line the new vehicles up against
+            lane += 1;
+            continue;
         }
 
-        X = l->vehicles.back()->getX() + deltaX.uniform() * 2;
-        for (int i = 0; i < addBack; i++) {
-            v = new RandomVehicle(this, X, lane);
-            l->vehicles.push_back(v);
-            X += deltaX.uniform();
+        for (size_t i = 0; i < addBack; i++) {
+            release(l->id[i]);
+        }
+        for (size_t i = n; i > n - addFront; i--) {
+            release(l->id[i - 1]);
         }
 
-        X = l->vehicles.front()->getX() - deltaX.uniform() * 2;
-        for (int i = 0; i < addFront; i++) {
-            v = new RandomVehicle(this, X, lane);
-            l->vehicles.push_front(v);
-            X -= deltaX.uniform();
+        // Line up the vehicles that stay at [addFront, n - addBack),
+        // and reuse the slots around them for the teleported ones.
+        if (addBack > addFront) {
+            l->rotate(addBack - addFront);
+        } else if (addFront > addBack) {
+            l->rotate(n - (addFront - addBack));
+        }
+
+        size_t first = addFront, last = n - addBack;
+
+        X = l->x[last - 1] + deltaX.uniform(random) * 2;
+        for (size_t i = last; i < n; i++) {
+            l->set(i, spawn(X, lane));
+            X += deltaX.uniform(random);
+        }
+
+        X = l->x[first] - deltaX.uniform(random) * 2;
+        for (size_t i = first; i > 0; i--) {
+            l->set(i - 1, spawn(X, lane));
+            X -= deltaX.uniform(random);
         }
         lane += 1;
+        teleported += addFront + addBack;
     }
+    Trace::counter("Vehicles teleported", teleported);
 }
 
 
-Target *Highway::target(const Vehicle *current, const Vehicle *targ) {
-    Target *t = new Target();
-    // If the target is in front, make the distance positive
-    if (targ->getX() > current->getX()) {
-        t->dist = (targ->getX() - targ->getLength() / 2) - (current->getX() + current->getLength() / 2);
-    } else {
-        t->dist = (targ->getX() + targ->getLength() / 2) - (current->getX() - current->getLength() / 2);
+void Highway::wrapVehicles() {
+    double length = config.ringLength;
+    int64_t wrapped = 0;
+    for (Lane *l: lanes) {
+        size_t n = l->size();
+        size_t past = 0;
+        while (past < n && l->x[n - 1 - past] >= length) {
+            l->x[n - 1 - past] -= length;
+            l->nextX[n - 1 - past] -= length;
+            past++;
+        }
+        l->rotate(n - past);
+        wrapped += past;
     }
+    Trace::counter("Vehicles wrapped", wrapped);
+}
 
-    t->vRel = targ->getV() - current->getV();
-
-    if (std::abs(t->dist) > MAX_VIEW_DISTANCE) {
-        t->dist = std::abs(t->dist) / t->dist * 1e6f; // 1000km, basically infinity.
-        t->vRel = 0;
+double Highway::wrap(double X) const {
+    double length = config.ringLength;
+    if (length <= 0) {
+        return X;
     }
-    return t;
+    X = std::fmod(X, length);
+    return X < 0 ? X + length : X;
 }
 
-void Highway::sort() {
-    for (Lane *l: lanes) {
-        std::sort(l->vehicles.begin(), l->vehicles.end(),
-                  [](const Vehicle *a, const Vehicle *b) {
-                      return a->getX() < b->getX();
-                  });
+double Highway::unwrap(double X, double around) const {
+    double length = config.ringLength;
+    if (length <= 0) {
+        return X;
     }
+    return X + std::round((around - X) / length) * length;
 }
 
-void Highway::step(float dt) {
 
-    lastTeleportTime += dt;
-    if (lastTeleportTime > TELEPORT_INTERVAL) {
-        teleportVehicles();
-        lastTeleportTime -= TELEPORT_INTERVAL;
+Target Highway::target(const Lane &curLane, size_t i, const Lane &targLane, size_t j, double shift) {
+    double curX = curLane.x[i], targX = targLane.x[j] + shift;
+    float curLength = curLane.length[i], targLength = targLane.length[j];
+
+    Target t;
+    // If the target is in front, make the distance positive.
+    // Subtract the positions first, they're too far from 0 for float precision
+    float dx = (float) (targX - curX);
+    if (targX > curX) {
+        t.dist = (dx - targLength / 2) - curLength / 2;
+    } else {
+        t.dist = (dx + targLength / 2) + curLength / 2;
     }
 
-    sort();
+    t.vRel = targLane.v[j] - curLane.v[i];
 
-    testForCollision();
+    if (std::abs(t.dist) > config.maxViewDistance) {
+        t.dist = std::abs(t.dist) / t.dist * 1e6f; // 1000km, basically infinity.
+        t.vRel = 0;
+    }
+    return t;
+}
 
-    std::map<Vehicle *, Neighbours *> links;
-    std::vector<std::deque<Vehicle *>::iterator> iters;
+void Highway::findSideNeighbours(const Lane &cur, const Lane &side, Neighbours *n, bool left,
+                                 size_t begin, size_t end) {
+    if (begin == end) {
+        return;
+    }
 
-    for (Lane *l: lanes) {
-        auto it = l->vehicles.begin();
-        iters.push_back(it + 1);
-        links[*(it)] = new Neighbours(target(*it, *(it + 1)), new Target(FAR_IN_BACK));
+    // Both lanes are sorted, so we walk them together like in a merge:
+    // side[j] is the first vehicle on the side lane that's not behind cur[i].
+    size_t j = side.lowerBound(cur.x[begin]);
+    size_t sideCount = side.size();
+    double ring = config.ringLength;
+    for (size_t i = begin; i < end; i++) {
+        double X = cur.x[i];
+        while (j < sideCount && side.x[j] < X) {
+            ++j;
+        }
 
-        ++it;
+        Target front, back;
+        if (j < sideCount) {
+            front = target(cur, i, side, j);
+        } else {
+            front = ring > 0 && sideCount > 0 ? target(cur, i, side, 0, ring) : FAR_IN_FRONT;
+        }
+        if (j > 0) {
+            back = target(cur, i, side, j - 1);
+        } else {
+            back = ring > 0 && sideCount > 0 ? target(cur, i, side, sideCount - 1, -ring) : FAR_IN_BACK;
+        }
+        if (left) {
+            n[i].withLeft(front, back);
+        } else {
+            n[i].withRight(front, back);
+        }
+    }
+}
 
-        auto e1 = l->vehicles.end() - 1;
+void Highway::sort() {
+    sortInversions.resize(lanes.size());
+    auto sortLane = [this](size_t l) {
+        sortInversions[l] = lanes[l]->sort();
+    };
 
-        while (it != e1) {
-            links[*it] = new Neighbours(target(*it, *(it + 1)), target(*it, *(it - 1)));
-            ++it;
+    size_t total = 0;
+    for (Lane *l: lanes) {
+        total += l->size();
+    }
+    if (total >= MIN_PARALLEL_VEHICLES) {
+        pool->run(lanes.size(), sortLane);
+    } else {
+        for (size_t l = 0; l < lanes.size(); l++) {
+            sortLane(l);
         }
+    }
 
-        links[*(it)] = new Neighbours(new Target(FAR_IN_FRONT), target(*it, *(it - 1)));
+    lastSortInversions = 0;
+    for (size_t inversions: sortInversions) {
+        lastSortInversions += inversions;
     }
+    reindex();
+}
 
+void Highway::planChunks() {
+    chunks.clear();
+    linkOffsets.resize(lanes.size());
 
-    while (!iters.empty()) {
-        uint maxI = 0;
-        for (uint i = 1; i < iters.size(); i++) {
-            if ((*iters[i])->getX() < (*iters[maxI])->getX()) {
-                maxI = i;
-            }
+    size_t total = 0;
+    for (uint32_t l = 0; l < lanes.size(); l++) {
+        linkOffsets[l] = total;
+        total += lanes[l]->size();
+    }
+    // However the vehicles are spread over the lanes, each lane adds at most one short chunk
+    size_t maxChunks = total / STEP_CHUNK_SIZE + lanes.size();
+    chunks.reserve(maxChunks);
+
+    for (uint32_t l = 0; l < lanes.size(); l++) {
+        lanes[l]->beginStep();
+        size_t count = lanes[l]->size();
+
+        for (size_t begin = 0; begin < count; begin += STEP_CHUNK_SIZE) {
+            StepChunk c;
+            c.lane = l;
+            c.begin = begin;
+            c.end = std::min(begin + STEP_CHUNK_SIZE, count);
+            chunks.push_back(c);
         }
+    }
 
-        check_coordinate((*iters[maxI])->getX());
-
-        if (maxI < lanes.size() - 1) {
-            Target *prev = target(*iters[maxI], *(iters[maxI + 1] - 1));
-            Target *next = target(*iters[maxI], *iters[maxI + 1]);
-            // we have a lane to the right
-            links[*iters[maxI]]->withLeft(next, prev);
+    if (links.size() < total) {
+        links.resize(total);
+        frontDist.resize(total);
+        frontVRel.resize(total);
+    }
+    if (collectors.size() < maxChunks) {
+        collectors.resize(maxChunks);
+        chunkTimes.resize(maxChunks);
+        // Room for every vehicle of a chunk to ask for a lane change
+        for (DecisionCollector &collector: collectors) {
+            collector.laneChanges.reserve(STEP_CHUNK_SIZE);
         }
-        if (maxI > 0) {
-            Target *prev = target(*iters[maxI], *(iters[maxI - 1] - 1));
-            Target *next = target(*iters[maxI], *iters[maxI - 1]);
-            // we have a lane to the left
-            links[*iters[maxI]]->withRight(next, prev);
+    }
+    for (DecisionCollector &collector: collectors) {
+        collector.seed = randomSeed;
+        collector.step = (uint32_t) stepsTaken;
+    }
+}
+
+template<typename F>
+void Highway::forEachChunk(F &f) {
+    size_t total = linkOffsets.back() + lanes.back()->size();
+    if (total >= MIN_PARALLEL_VEHICLES) {
+        pool->run(chunks.size(), f);
+    } else {
+        for (size_t c = 0; c < chunks.size(); c++) {
+            f(c);
         }
+    }
+}
 
-        ++iters[maxI];
-        if ((iters[maxI] + 1) == lanes[maxI]->vehicles.end()) {
-            break;
+void Highway::findNeighbours(const StepChunk &chunk) {
+    uint32_t li = chunk.lane;
+    const Lane &l = *lanes[li];
+    Neighbours *n = &links[linkOffsets[li]];
+    float *dist = &frontDist[linkOffsets[li]];
+    float *vRel = &frontVRel[linkOffsets[li]];
+    size_t count = l.size();
+
+    // On a ring road, the first and last vehicles see each other across the seam
+    bool ring = config.ringLength > 0 && count > 1;
+    for (size_t i = chunk.begin; i < chunk.end; i++) {
+        check_coordinate(l.x[i]);
+        Target front = i + 1 < count ? target(l, i, l, i + 1)
+                                     : ring ? target(l, i, l, 0, config.ringLength) : FAR_IN_FRONT;
+        Target back = i > 0 ? target(l, i, l, i - 1)
+                            : ring ? target(l, i, l, count - 1, -config.ringLength) : FAR_IN_BACK;
+        n[i] = Neighbours(front, back);
+        dist[i] = n[i].front.dist;
+        vRel[i] = n[i].front.vRel;
+    }
+
+    if (li + 1 < lanes.size()) {
+        // we have a lane to the left
+        findSideNeighbours(l, *lanes[li + 1], n, true, chunk.begin, chunk.end);
+    }
+    if (li > 0) {
+        // we have a lane to the right
+        findSideNeighbours(l, *lanes[li - 1], n, false, chunk.begin, chunk.end);
+    }
+}
+
+void Highway::step(float dt) {
+    ACC_TRACE_SCOPE("Highway::step");
+    uint64_t allocations = AllocationCounter::count();
+#ifdef ACC_PROFILE_STEP
+    profile.beginStep();
+#endif
+    executeCommands();
+
+    {
+        STEP_PHASE(StepPhase::teleport, PerfRegion::teleport);
+        lastTeleportTime += dt;
+        if (config.ringLength > 0) {
+            wrapVehicles();
+        } else if (lastTeleportTime > TELEPORT_INTERVAL) {
+            teleportVehicles();
+            lastTeleportTime -= TELEPORT_INTERVAL;
         }
     }
 
+    {
+        STEP_PHASE(StepPhase::sort, PerfRegion::sort);
+        sort();
+    }
 
-    for (Lane *l: lanes) {
-        for (Vehicle *v: l->vehicles) {
-            v->think(links[v]);
+    {
+        STEP_PHASE(StepPhase::collisions, PerfRegion::collisions);
+        testForCollision();
+    }
+
+    planChunks();
+
+    // Vehicles only read the current state of the others, and write their own next state,
+    // so the chunks can go in any order, or at the same time
+    {
+        ACC_PERF_REGION(PerfRegion::update);
+        ACC_TRACE_SCOPE("Update");
+        auto update = [this, dt](size_t c) {
+            updateChunk(c, dt);
+        };
+        forEachChunk(update);
+
+        for (Lane *l: lanes) {
+            l->commitStep();
         }
     }
+    PerfCounters::addVehicleSteps(linkOffsets.back() + lanes.back()->size());
+
+#ifdef ACC_PROFILE_STEP
+    for (size_t c = 0; c < chunks.size(); c++) {
+        profile.current(StepPhase::neighbours) += chunkTimes[c].neighbours;
+        profile.current(StepPhase::think) += chunkTimes[c].think;
+        profile.current(StepPhase::integrate) += chunkTimes[c].integrate;
+    }
+#endif
 
-    this->preferredVehicleFrontDistance = links[preferredVehicle]->front->dist;
+    const VehicleSlot &preferred = slots[preferredVehicleId];
+    this->preferredVehicleFrontDistance = links[linkOffsets[preferred.lane] + preferred.index].front.dist;
 
-    for (auto &p: links) {
-        delete p.second;
+    {
+        STEP_PHASE(StepPhase::commit, PerfRegion::commit);
+        commitDecisions(dt);
     }
+    stepsTaken++;
 
+    if (recorder != nullptr && !stabilising) {
+        STEP_PHASE(StepPhase::record, PerfRegion::record);
+        recorder->capture(*this, dt);
+    }
 
-    for (Lane *l: lanes) {
-        for (Vehicle *v: l->vehicles) {
-            v->step(dt);
+#ifdef ACC_PROFILE_STEP
+    profile.endStep();
+#endif
+    lastStepAllocations = AllocationCounter::count() - allocations;
+}
+
+void Highway::updateChunk(size_t c, float dt) {
+    ACC_TRACE_SCOPE("Update chunk");
+    const StepChunk &chunk = chunks[c];
+    ChunkTimes &times = chunkTimes[c];
+    times = ChunkTimes();
+
+    {
+        ACC_PROFILE_SCOPE(times.neighbours);
+        findNeighbours(chunk);
+    }
+
+    Lane &l = *lanes[chunk.lane];
+    size_t offset = linkOffsets[chunk.lane];
+    {
+        ACC_PROFILE_SCOPE(times.think);
+        AccelerationKernel::run(l, chunk.begin, chunk.end, &frontDist[offset], &frontVRel[offset]);
+
+        const Neighbours *n = &links[offset];
+        DecisionCollector *collector = &collectors[c];
+        for (size_t i = chunk.begin; i < chunk.end; i++) {
+            Vehicle::think(l, i, n[i], collector);
         }
     }
 
-    auto i = laneChangers.begin();
-    while (i != laneChangers.end()) {
-        auto &p = *i;
-        Vehicle *v = p.first;
-        LaneChangeData &data = p.second;
+    {
+        ACC_PROFILE_SCOPE(times.integrate);
+        for (size_t i = chunk.begin; i < chunk.end; i++) {
+            Vehicle::step(l, i, dt);
+        }
+    }
+}
+
+void Highway::commitDecisions(float dt) {
+    // Same order as on a single thread: lane after lane, in slot order within a lane
+    for (size_t c = 0; c < chunks.size(); c++) {
+        DecisionCollector &collector = collectors[c];
+        for (const LaneChangeRequest &r: collector.laneChanges) {
+            notifyLaneChange(r.vehicle, r.direction);
+        }
+        collector.laneChanges.clear();
+    }
 
+    // All the vehicles starting to change lanes move in one go: each lane shifts once, however many come and go
+    int64_t started = 0;
+    arrivals.clear();
+    departures.clear();
+    for (LaneChangeData &data: laneChangers) {
         if (!data.changed) {
             data.changed = true;
-            lanes[data.to]->vehicles.push_back(v);
-            auto it = lanes[data.from]->vehicles.begin();
-            while (it != lanes[data.from]->vehicles.end() && *it != v) ++it;
-            lanes[data.from]->vehicles.erase(it);
+            const VehicleSlot &slot = slots[data.vehicle];
+            const Lane &from = *lanes[slot.lane];
+            LaneArrival arrival;
+            arrival.data = from.get(slot.index);
+            arrival.previousX = from.nextX[slot.index];
+            arrival.lane = (uint32_t) data.to;
+            arrival.order = (uint32_t) arrivals.size();
+            arrivals.push_back(arrival);
+            departures.push_back(slot);
+            started++;
+            if (data.vehicle == preferredVehicleId) {
+                preferredLaneChanges++;
+            }
         }
+    }
+    if (started > 0) {
+        moveVehicles();
+    }
+    laneChanges += started;
+    Trace::counter("Lane changes started", started);
+
+    // The finished ones drop out in one pass, the others keep their order
+    size_t kept = 0;
+    for (size_t i = 0; i < laneChangers.size(); i++) {
+        LaneChangeData &data = laneChangers[i];
+        Vehicle v = vehicle(data.vehicle);
 
         data.progress += dt;
-        v->setLane(data.from + data.progress * data.direction);
+        v.setLane(data.from + data.progress * data.direction);
 
         if (data.progress >= 1) {
-            v->setLane(std::round(v->getLane()));
-            i = laneChangers.erase(i);
+            v.setLane(std::round(v.getLane()));
+            slots[data.vehicle].changingLane = false;
         } else {
-            ++i;
+            laneChangers[kept++] = data;
         }
+    }
+    laneChangers.resize(kept);
+}
 
+void Highway::reindex(uint32_t lane, size_t first) {
+    const std::vector<VehicleId> &ids = lanes[lane]->id;
+    for (size_t i = first; i < ids.size(); i++) {
+        slots[ids[i]].lane = lane;
+        slots[ids[i]].index = (uint32_t) i;
     }
 }
 
-void Highway::notifyLaneChange(Vehicle *v, int direction) {
+void Highway::moveVehicles() {
+    std::sort(departures.begin(), departures.end(), [](const VehicleSlot &a, const VehicleSlot &b) {
+        return a.lane != b.lane ? a.lane < b.lane : a.index < b.index;
+    });
+    std::sort(arrivals.begin(), arrivals.end(), [](const LaneArrival &a, const LaneArrival &b) {
+        if (a.lane != b.lane) {
+            return a.lane < b.lane;
+        }
+        return a.data.x != b.data.x ? a.data.x < b.data.x : a.order < b.order;
+    });
+
+    // Where each lane's share of the batch starts
+    moveOffsets.resize(2 * (lanes.size() + 1));
+    size_t *departuresBegin = &moveOffsets[0];
+    size_t *arrivalsBegin = &moveOffsets[lanes.size() + 1];
+    size_t d = 0, a = 0;
+    for (uint32_t l = 0; l <= lanes.size(); l++) {
+        while (d < departures.size() && departures[d].lane < l) d++;
+        while (a < arrivals.size() && arrivals[a].lane < l) a++;
+        departuresBegin[l] = d;
+        arrivalsBegin[l] = a;
+    }
+    laneSlots.resize(lanes.size());
+
+    // Lane changes keep piling onto the busiest lanes for a while. Those grow here, before they run out of room,
+    // all columns at once and to twice what they hold, rather than a column at a time in moveLane, so they
+    // soon stop growing, usually while the highway is still stabilising
+    for (uint32_t l = 0; l < lanes.size(); l++) {
+        Lane &lane = *lanes[l];
+        size_t size = lane.size() + (arrivalsBegin[l + 1] - arrivalsBegin[l]);
+        if (size + LANE_HEADROOM > lane.x.capacity()) {
+            lane.reserve(2 * size + LANE_HEADROOM);
+        }
+    }
+
+    // Each lane only touches its own vehicles, and their own entries in Highway::slots
+    auto moveLane = [&](size_t l) {
+        size_t firstDeparture = departuresBegin[l], lastDeparture = departuresBegin[l + 1];
+        size_t firstArrival = arrivalsBegin[l], lastArrival = arrivalsBegin[l + 1];
+        if (firstDeparture == lastDeparture && firstArrival == lastArrival) {
+            return;
+        }
+        Lane &lane = *lanes[l];
+        std::vector<uint32_t> &slotList = laneSlots[l];
+        size_t first = SIZE_MAX;
+
+        slotList.clear();
+        for (size_t k = firstDeparture; k < lastDeparture; k++) {
+            slotList.push_back(departures[k].index);
+        }
+        if (!slotList.empty()) {
+            lane.erase(slotList);
+            first = slotList.front();
+        }
+
+        slotList.clear();
+        for (size_t k = firstArrival; k < lastArrival; k++) {
+            // Keep the lane sorted, so the next sort has nothing to do.
+            // The lane may be a little out of order until then; the gaps still have to come in order
+            uint32_t before = (uint32_t) lane.lowerBound(arrivals[k].data.x);
+            slotList.push_back(slotList.empty() ? before : std::max(before, slotList.back()));
+        }
+        if (!slotList.empty()) {
+            lane.openGaps(slotList);
+            for (size_t k = 0; k < slotList.size(); k++) {
+                const LaneArrival &arrival = arrivals[firstArrival + k];
+                size_t slot = slotList[k] + k;
+                lane.set(slot, arrival.data);
+                lane.nextX[slot] = arrival.previousX;
+            }
+            first = std::min(first, (size_t) slotList.front());
+        }
+
+        reindex((uint32_t) l, first);
+    };
+
+    size_t total = 0;
+    for (Lane *l: lanes) {
+        total += l->size();
+    }
+    if (departures.size() + arrivals.size() > 1 && total >= MIN_PARALLEL_VEHICLES) {
+        pool->run(lanes.size(), moveLane);
+    } else {
+        for (size_t l = 0; l < lanes.size(); l++) {
+            moveLane(l);
+        }
+    }
+}
+
+RandomStream Highway::dice(VehicleId v) {
+    return RandomStream(randomSeed, v, (uint32_t) stepsTaken);
+}
+
+void Highway::notifyLaneChange(VehicleId v, int direction) {
     LaneChangeData data;
+    data.vehicle = v;
     data.direction = direction;
-    data.from = (int) std::round(v->getLane());
+    data.from = (int) std::round(vehicle(v).getLane());
     data.to = data.from + direction;
     data.changed = false;
 
@@ -300,69 +808,114 @@ void Highway::notifyLaneChange(Vehicle *v, int direction) {
         return;
     }
 
-    if (laneChangers.find(v) != laneChangers.end()) {
+    if (slots[v].changingLane) {
         return;
     }
 
     data.progress = 0;
-    laneChangers[v] = data;
+    laneChangers.push_back(data);
+    slots[v].changingLane = true;
 }
 
 
+void Highway::stopRecording() {
+    if (recorder != nullptr) {
+        recorder->close();
+    }
+}
+
 void Highway::stabilise() {
-    preferredVehicle->setTargetSpeed(300 / 3.6f);
-    for (int i = 0; i < STABILISE_STEPS; i++) {
+    warmStarted = WarmStart::load(*this);
+    if (warmStarted) {
+        return;
+    }
+
+    preferredVehicle().setTargetSpeed(300 / 3.6f, random);
+    stabilising = true;
+    for (int i = 0; i < config.stabiliseSteps; i++) {
         step(STABILISE_DT);
     }
-    preferredVehicle->setTargetSpeed(130 / 3.6f);
+    stabilising = false;
+    preferredVehicle().setTargetSpeed(130 / 3.6f, random);
+    WarmStart::save(*this);
 }
 
 
-bool Highway::addVehicleAt(float X, float lane, float speed) {
+bool Highway::addVehicleAt(double X, float lane, float speed) {
+    arrivals.clear();
+    departures.clear();
+    if (!planArrival(X, lane, speed)) {
+        return false;
+    }
+    moveVehicles();
+    return true;
+}
+
+bool Highway::planArrival(double X, float lane, float speed) {
     const float MIN_DISTANCE = 20.0f;
     const float BUFF_DISTANCE = 50.0f;
     int l = (int) std::round(lane);
     if (l < 0 || l >= static_cast<int>(lanes.size())) {
         return false;
     }
-    auto begin = lanes[l]->vehicles.begin();
-    auto it = begin;
-    auto end = lanes[l]->vehicles.end();
-    while (it != end && (*it)->getX() < X) {
-        ++it;
+    const Lane &ln = *lanes[l];
+    X = wrap(X);
+    size_t it = ln.lowerBound(X);
+
+    // The vehicles either side of X: on the lane, or queued for it earlier in the batch
+    struct Side {
+        bool found;
+        double x;
+        float length;
+        float v;
+    };
+    Side v1 = {false, 0, 0, 0}, v2 = {false, 0, 0, 0};
+    if (it > 0) {
+        v1 = {true, ln.x[it - 1], ln.length[it - 1], ln.v[it - 1]};
+    }
+    if (it < ln.size()) {
+        v2 = {true, ln.x[it], ln.length[it], ln.v[it]};
+    }
+    for (const LaneArrival &other: arrivals) {
+        const VehicleData &d = other.data;
+        if (other.lane != (uint32_t) l) {
+            continue;
+        }
+        if (d.x < X && (!v1.found || d.x > v1.x)) {
+            v1 = {true, d.x, d.length, d.v};
+        } else if (d.x >= X && (!v2.found || d.x < v2.x)) {
+            v2 = {true, d.x, d.length, d.v};
+        }
     }
 
     float realSpeed = speed;
 
-    if (it == end) {
+    if (!v2.found && v1.found) {
         // We're at the end of our list
-        X = lanes[l]->vehicles.back()->getX() + deltaX.uniform();
-    } else if(it == begin) {
+        X = v1.x + deltaX.uniform(random);
+    } else if (!v1.found && v2.found) {
         // We're at the start of the list
-        X = lanes[l]->vehicles.front()->getX() - deltaX.uniform();
-    } else {
-        Vehicle *v2 = *it;
-        Vehicle *v1 = *(it - 1);
-
-        auto mi = [](float a, float b, float x) {
+        X = v2.x - deltaX.uniform(random);
+    } else if (v1.found && v2.found) {
+        auto mi = [](double a, double b, double x) {
             return std::min(std::abs(a - x), std::abs(b - x));
         };
 
-        auto dist = [&mi](const Vehicle *v, float x) {
-            return mi(v->getX() - v->getLength() / 2, v->getX() + v->getLength() / 2, x);
+        auto dist = [&mi](const Side &v, double x) {
+            return mi(v.x - v.length / 2, v.x + v.length / 2, x);
         };
 
-        realSpeed = (v1->getV() + v2->getV()) / 2;
+        realSpeed = (v1.v + v2.v) / 2;
 
         if(dist(v1, X) < MIN_DISTANCE || dist(v2, X) < MIN_DISTANCE) {
             // We're close to either of these
 
-            if(std::abs(v1->getX() - v2->getX())  < MIN_DISTANCE + v1->getLength() + v2->getLength()) {
+            if(std::abs(v1.x - v2.x)  < MIN_DISTANCE + v1.length + v2.length) {
                 // Can't do it
                 return false;
             }
 
-            X = (v1->getX() + v2->getX()) / 2;
+            X = (v1.x + v2.x) / 2;
         }
 
         float minDist = std::min(dist(v1, X), dist(v2, X));
@@ -372,70 +925,146 @@ bool Highway::addVehicleAt(float X, float lane, float speed) {
     }
 
 
-    Vehicle *v = new RandomVehicle(this, X, std::round(lane));
-    v->setV(realSpeed);
-    v->setTargetSpeed(speed);
-    lanes[l]->vehicles.insert(it, v);
+    if (ringLength() > 0) {
+        // Stepping off either end of the lane lands on the other side of the seam
+        X = wrap(X);
+    }
+
+    VehicleData v = spawn(X, std::round(lane));
+    v.v = realSpeed;
+    v.targetSpeed = speed;
+    // Picks the rest of its targets on a lane of its own, until it joins the real one
+    staging.push_back(v);
+    Vehicle(&staging, 0).setTargetSpeed(speed, random);
+
+    LaneArrival arrival;
+    arrival.data = staging.get(0);
+    arrival.previousX = X;
+    arrival.lane = (uint32_t) l;
+    arrival.order = (uint32_t) arrivals.size();
+    arrivals.push_back(arrival);
+    staging.erase(0);
     return true;
 }
 
 bool Highway::addVehicleInFrontOfPreferred(float speed) {
-    return addVehicleAt(preferredVehicle->getX() + 18.0f, preferredVehicle->getLane(), speed);
+    Vehicle acc = preferredVehicle();
+    return addVehicleAt(acc.getX() + 18.0f, acc.getLane(), speed);
+}
+
+bool Highway::post(const HighwayCommand &command) {
+    return commands->push(command);
+}
+
+void Highway::executeCommands() {
+    HighwayCommand command;
+    while (commands->pop(command)) {
+        execute(command);
+        commandsExecuted++;
+    }
+}
+
+void Highway::execute(const HighwayCommand &command) {
+    Vehicle v = vehicle(command.vehicle);
+    bool added;
+    double spread;
+    switch (command.type) {
+        case CommandType::setTargetSpeed:
+            if (v.valid()) v.setTargetSpeed(command.value, random);
+            break;
+        case CommandType::setTargetDistance:
+            if (v.valid()) v.setTargetDistance(command.value, random);
+            break;
+        case CommandType::setAction:
+            if (v.valid()) v.setAction(command.action, random);
+            break;
+        case CommandType::addVehicleAt:
+        case CommandType::addVehicleInFrontOfPreferred:
+            if (command.type == CommandType::addVehicleAt) {
+                unselectVehicle();
+                added = addVehicleAt(command.x, command.lane, command.value);
+            } else {
+                added = addVehicleInFrontOfPreferred(command.value);
+            }
+            if (added) {
+                vehiclesAdded++;
+            } else {
+                vehiclesNotAdded++;
+            }
+            break;
+        case CommandType::addVehicles:
+            // Anywhere a vehicle could have been teleported to, or anywhere on the ring
+            spread = config.ringLength > 0 ? config.ringLength / 2 : teleportDistance;
+            // Placed one by one, then merged into every lane at once
+            arrivals.clear();
+            departures.clear();
+            for (uint32_t i = 0; i < command.count; i++) {
+                double X = preferredVehicle().getX() + (placement.uniform(random) * 2 - 1) * spread;
+                float lane = std::floor(placement.uniform(random) * lanes.size());
+                if (planArrival(X, std::min(lane, lanes.size() - 1.0f), command.value)) {
+                    vehiclesAdded++;
+                } else {
+                    vehiclesNotAdded++;
+                }
+            }
+            if (!arrivals.empty()) {
+                moveVehicles();
+            }
+            break;
+        case CommandType::selectVehicleAt:
+            selectVehicleAt(command.x, command.lane);
+            if (selectedVehicleId == preferredVehicleId) {
+                // The ACC has its own controls
+                unselectVehicle();
+            }
+            break;
+        case CommandType::unselectVehicle:
+            unselectVehicle();
+            break;
+    }
 }
 
-void Highway::selectVehicleAt(float X, float lane) {
-    selectedVehicle = nullptr;
+void Highway::selectVehicleAt(double X, float lane) {
+    selectedVehicleId = NO_VEHICLE;
 
     int l = (int) std::round(lane);
     if (l < 0 || l >= (int) lanes.size()) return;
-    auto it = lanes[l]->vehicles.begin();
-    auto end = lanes[l]->vehicles.end();
-    while (it != end && (*it)->getX() < X - 10) {
-        ++it;
-    }
-    if (it == end) {
+    const Lane &ln = *lanes[l];
+    X = wrap(X);
+    size_t it = ln.lowerBound(X - 10);
+    if (it == ln.size()) {
         return;
     }
-    Vehicle *v = *it;
 
-    if (v->getLength() < std::abs(X - v->getX())) return;
-    selectedVehicle = v;
+    if (ln.length[it] < std::abs(X - ln.x[it])) return;
+    selectedVehicleId = ln.id[it];
 }
 
 void Highway::unselectVehicle() {
-    selectedVehicle = nullptr;
+    selectedVehicleId = NO_VEHICLE;
 }
 
 void Highway::testForCollision() {
-    static int step = 0;
-    step++;
     for(Lane *l: lanes) {
-        int i = 0;
-        auto it = l->vehicles.begin() + 1;
-        auto end = l->vehicles.end() - 2;
-        for(; it != end; it++) {
-            if(it == end) {
-                return;
-            }
-            i++;
-            Vehicle *va = *it;
-            Vehicle *vb = *(it + 1);
-
-            float Xa = va->getX() + va->getLength() / 2;
-            float Xb = vb->getX() - vb->getLength() / 2;
+        const std::vector<double> &x = l->x;
+        const std::vector<float> &length = l->length;
+        for(size_t i = 1; i + 2 < l->size(); i++) {
+            double Xa = x[i] + length[i] / 2;
+            double Xb = x[i + 1] - length[i + 1] / 2;
 
             if(Xb < Xa) {
-                std::stringstream ss;
-                ss << "Collision happened " << " at step " << step;
-                ss << " at car " << i;
-                ss << " (out of " << N_VEHICLES_PER_LANE << ")";
-                ss << " of lane " << static_cast<int>(va->getLane());
-
-//                throw Error(ss.str());
-                std::cerr << ss.str() << std::endl;
+                collisions++;
+                if (!reportCollisions) {
+                    continue;
+                }
+                // Formatted on the stack: the step doesn't allocate
+                char message[128];
+                std::snprintf(message, sizeof(message), "Collision happened  at step %llu at car %zu (out of %zu) of lane %d\n",
+                              (unsigned long long) stepsTaken, i, l->size(), static_cast<int>(l->lane[i]));
+
+//                throw Error(message);
+                std::fputs(message, stderr);
             }
         }
     }
 }
-
-
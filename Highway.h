@@ -39,15 +39,23 @@
  */
 
 
-#include <map>
+#include <cstdint>
 #include <vector>
+#include "HighwayCommand.h"
+#include "HighwayConfig.h"
 #include "Lane.h"
+#include "SpscQueue.h"
+#include "StepProfile.h"
+#include "ThreadPool.h"
 #include "Vehicle.h"
 
+class TrajectoryRecorder;
+
 /**
  * Data kept for each vehicle currently chaing lane.
  */
 struct LaneChangeData {
+    VehicleId vehicle;
     int from;
     int to;
     float progress;
@@ -55,16 +63,106 @@ struct LaneChangeData {
     bool changed;
 };
 
+/**
+ * Where a vehicle is stored: the lane and the slot in that lane.
+ */
+struct VehicleSlot {
+    uint32_t lane;
+    uint32_t index;
+
+    /**
+     * The vehicle is in Highway::laneChangers, so it can't start another lane change.
+     */
+    bool changingLane;
+};
+
+/**
+ * A vehicle about to join a lane, see Highway::moveVehicles.
+ */
+struct LaneArrival {
+    VehicleData data;
+
+    /**
+     * Where it was at the start of the step, to draw it in between (Lane::nextX).
+     */
+    double previousX;
+
+    uint32_t lane;
+
+    /**
+     * Place in the batch. Breaks ties in X, so the lanes come out the same whatever the sort does.
+     */
+    uint32_t order;
+};
+
+/**
+ * A lane change asked for by a vehicle, not yet registered with the highway.
+ */
+struct LaneChangeRequest {
+    VehicleId vehicle;
+    int direction;
+};
+
+/**
+ * Keeps the decisions reported while the vehicles think in parallel.
+ * The highway carries them out afterwards, on one thread and in lane order.
+ */
+class DecisionCollector : public VehicleObserver {
+public:
+    void notifyLaneChange(VehicleId v, int direction) {
+        LaneChangeRequest r;
+        r.vehicle = v;
+        r.direction = direction;
+        laneChanges.push_back(r);
+    }
+
+    RandomStream dice(VehicleId v) {
+        return RandomStream(seed, v, step);
+    }
+
+    std::vector<LaneChangeRequest> laneChanges;
+
+    /**
+     * Seed of the highway and number of the step, set by the highway before every step.
+     */
+    uint64_t seed = 0;
+    uint32_t step = 0;
+};
+
+/**
+ * A run of consecutive slots on one lane, stepped as a single task.
+ */
+struct StepChunk {
+    uint32_t lane;
+    size_t begin;
+    size_t end;
+};
+
+/**
+ * Time spent on one chunk in each part of the update, in nanoseconds.
+ */
+struct ChunkTimes {
+    uint64_t neighbours;
+    uint64_t think;
+    uint64_t integrate;
+};
+
 /**
  * The one-way highway, with all it's algorithms.
  * This is basically our simulation driver.
  */
-class Highway : public LaneChangeObserver {
+class Highway : public VehicleObserver {
 public:
-    Highway();
+    Highway(const HighwayConfig &config = HighwayConfig());
 
+    /**
+     * A copy that steps on exactly like the original, with lanes and threads of its own.
+     * The orders posted to the original and not carried out yet aren't copied.
+     */
     Highway(const Highway &orig);
 
+    Highway &operator=(const Highway &) = delete;
+
     virtual ~Highway();
 
     /**
@@ -75,56 +173,273 @@ public:
     /**
      * Register the request for a vehicle to change lane.
      */
-    void notifyLaneChange(Vehicle *v, int direction);
+    void notifyLaneChange(VehicleId v, int direction);
+
+    /**
+     * The dice of a vehicle for the current step.
+     */
+    RandomStream dice(VehicleId v);
 
     /**
      * Run a number of steps to stabilise the system.
+     * Loads the result instead if a previous run cached it, see WarmStart.
      */
     void stabilise();
 
+    /**
+     * Finishes the trajectory file, see HighwayConfig::recordFile. Throws an Error if it couldn't be written.
+     * Nothing is recorded afterwards.
+     */
+    void stopRecording();
+
+    /**
+     * Records the trajectories, or nullptr if HighwayConfig::recordFile is empty.
+     */
+    const TrajectoryRecorder *trajectoryRecorder() const {
+        return recorder;
+    }
+
     /**
      * Adds random vehicle at that approximate road coordinate.
      */
-    bool addVehicleAt(float X, float lane, float speed);
+    bool addVehicleAt(double X, float lane, float speed);
 
     /**
      * Adds random vehicle in front of the ACC.
      */
     bool addVehicleInFrontOfPreferred(float speed);
 
+    /**
+     * Queues an order from the user, carried out at the start of the next step.
+     * Safe to call from one other thread (the UI) while the highway is being stepped. Doesn't allocate.
+     * @return false if too many orders are waiting already, and this one was dropped.
+     */
+    bool post(const HighwayCommand &command);
+
+    /**
+     * Carries out an order from the user. Call it between steps, or post it instead.
+     * The vehicles added are counted in Highway::vehiclesAdded and Highway::vehiclesNotAdded,
+     * since whoever sent the command isn't around for the answer.
+     */
+    void execute(const HighwayCommand &command);
+
     /**
      * Tries to select a vehicle at given road coordinate.
-     * If succeeded, will set the Highway::selectedVehicle pointer.
+     * If succeeded, will set Highway::selectedVehicleId.
      */
-    void selectVehicleAt(float X, float lane);
+    void selectVehicleAt(double X, float lane);
 
     /**
      * Tries to select a vehicle at given road coordinate.
-     * Unsets the Highway::selectedVehicle pointer.
+     * Unsets Highway::selectedVehicleId.
      */
     void unselectVehicle();
 
+    /**
+     * Returns a handle to the given vehicle, or an invalid handle if there's no such vehicle.
+     * The handle is good until the next step.
+     */
+    Vehicle vehicle(VehicleId id);
+
+    /**
+     * Handle to the vehicle that will be tracked by the camera, the ACC.
+     */
+    Vehicle preferredVehicle() {
+        return vehicle(preferredVehicleId);
+    }
+
+    /**
+     * Handle to the vehicle selected by the user. Invalid if there's none.
+     */
+    Vehicle selectedVehicle() {
+        return vehicle(selectedVehicleId);
+    }
+
+    /**
+     * Length of the ring road, or 0 if the road is straight. See HighwayConfig::ringLength.
+     */
+    double ringLength() const {
+        return config.ringLength;
+    }
+
+    /**
+     * Brings a road coordinate back onto the ring, in [0, ringLength()).
+     * Leaves it alone on a straight road.
+     */
+    double wrap(double X) const;
+
+    /**
+     * The copy of a road coordinate, one lap ahead or behind, that's closest to around.
+     * Used to draw the vehicles on the other side of the seam of a ring road.
+     */
+    double unwrap(double X, double around) const;
+
+    /**
+     * Number of threads stepping the highway.
+     */
+    unsigned threads() const {
+        return pool->size();
+    }
+
+    /**
+     * The size and tuning this highway was made with.
+     */
+    const HighwayConfig &getConfig() const {
+        return config;
+    }
+
     /**
      * The lanes of our highway. All point to the right.
      */
     std::vector<Lane *> lanes;
 
     /**
-     * Pointer to the vehicle that will be tracked by the camera, the ACC.
+     * The vehicle that will be tracked by the camera, the ACC.
      */
-    Vehicle *preferredVehicle = nullptr;
+    VehicleId preferredVehicleId = NO_VEHICLE;
 
     /**
      * The vehicle selected by the user, if any.
      */
-    Vehicle *selectedVehicle = nullptr;
+    VehicleId selectedVehicleId = NO_VEHICLE;
 
     /**
      * The distance from the ACC to the next vehicle is stored in this field.
      */
     float preferredVehicleFrontDistance = 0;
 
+    /**
+     * Number of heap allocations made by the last call to Highway::step.
+     * Should stay at zero once the simulation is running.
+     */
+    uint64_t lastStepAllocations = 0;
+
+    /**
+     * Number of vehicle pairs that were out of order on their lane, and got sorted, in the last step.
+     */
+    size_t lastSortInversions = 0;
+
+    /**
+     * Vehicles added by Highway::execute so far, and the ones that didn't fit.
+     */
+    uint32_t vehiclesAdded = 0;
+    uint32_t vehiclesNotAdded = 0;
+
+    /**
+     * Orders posted and carried out so far.
+     */
+    uint64_t commandsExecuted = 0;
+
+    /**
+     * Steps taken so far, stabilising included.
+     */
+    uint64_t stepsTaken = 0;
+
+    /**
+     * Lane changes started so far, by any vehicle and by the ACC.
+     */
+    uint64_t laneChanges = 0;
+    uint64_t preferredLaneChanges = 0;
+
+    /**
+     * Overlapping neighbours found by Highway::testForCollision so far, once per step they overlap.
+     */
+    uint64_t collisions = 0;
+
+    /**
+     * Prints every collision to stderr. Batches of runs count them quietly instead.
+     */
+    bool reportCollisions = true;
+
+    /**
+     * The last Highway::stabilise loaded a cached highway instead of stepping.
+     */
+    bool warmStarted = false;
+
+    /**
+     * Seed of the random numbers: HighwayConfig::seed, or one picked at random if that was 0.
+     * Together with the orders carried out, and the step they were carried out at, it decides the whole run.
+     */
+    uint64_t seed() const {
+        return randomSeed;
+    }
+
+    /**
+     * Time spent in each phase of the last steps. Only filled in when built with ACC_PROFILE_STEP.
+     */
+    StepProfile profile;
+
 private:
+    /**
+     * Times the private phases of the step, see bench/HighwayBench.cpp.
+     */
+    friend class HighwayBench;
+
+    /**
+     * Saves and loads all of the state below.
+     */
+    friend class Checkpoint;
+
+    HighwayConfig config;
+
+    /**
+     * Threads that step the lanes in parallel.
+     */
+    ThreadPool *pool;
+
+    uint64_t randomSeed;
+
+    /**
+     * Random numbers for the highway itself: placing and sampling new vehicles, and carrying out orders.
+     * Only drawn from between the parallel phases, in a fixed order. The vehicles roll their own dice.
+     */
+    RandomStream random;
+
+    /**
+     * Orders posted by the UI, carried out at the start of Highway::step.
+     */
+    SpscQueue<HighwayCommand> *commands;
+
+    /**
+     * Writes every step to HighwayConfig::recordFile, if set. Copies don't record.
+     */
+    TrajectoryRecorder *recorder;
+
+    /**
+     * Highway::stabilise is stepping; those steps aren't recorded.
+     */
+    bool stabilising = false;
+
+    /**
+     * Carries out the orders posted so far.
+     */
+    void executeCommands();
+
+    /**
+     * The lanes cut into chunks for the parallel phases of Highway::step.
+     * Replanned every step, as lanes grow and shrink.
+     */
+    std::vector<StepChunk> chunks;
+
+    /**
+     * Decisions reported in each chunk. Never shrinks, so the buffers stay allocated.
+     */
+    std::vector<DecisionCollector> collectors;
+
+    /**
+     * Time spent on each chunk, added to Highway::profile once the chunks are done.
+     */
+    std::vector<ChunkTimes> chunkTimes;
+
+    /**
+     * Number of inversions fixed on each lane by the last sort.
+     */
+    std::vector<size_t> sortInversions;
+
+    /**
+     * Vehicles farther than this from the ACC get teleported.
+     */
+    float teleportDistance;
 
     void testForCollision();
 
@@ -136,24 +451,156 @@ private:
     /**
      * Stores the vehicles that are currently chaning lane.
      */
-    std::map<Vehicle *, LaneChangeData> laneChangers;
+    std::vector<LaneChangeData> laneChangers;
+
+    /**
+     * The neighbours of every vehicle, lane after lane, in the same order as the lane slots.
+     * The vehicle in slot i of lane l is at linkOffsets[l] + i.
+     * Rewritten on every step; kept around so the step doesn't allocate.
+     */
+    std::vector<Neighbours> links;
+
+    /**
+     * Distance to the vehicle in front, laid out like Highway::links.
+     * Kept apart so AccelerationKernel can load it for several vehicles at once.
+     */
+    std::vector<float> frontDist;
+
+    /**
+     * Relative speed of the vehicle in front, laid out like Highway::links.
+     */
+    std::vector<float> frontVRel;
+
+    /**
+     * Where each lane starts in Highway::links.
+     */
+    std::vector<size_t> linkOffsets;
+
+    /**
+     * The slot of every vehicle, indexed by VehicleId.
+     * Rebuilt by Highway::reindex whenever vehicles move around.
+     */
+    std::vector<VehicleSlot> slots;
+
+    /**
+     * Ids given back by removed vehicles, reused before making new ones.
+     */
+    std::vector<VehicleId> freeIds;
+
+    /**
+     * Creates a random vehicle with a fresh id.
+     * Converts it to ACC for a share HighwayConfig::accRatio of the vehicles.
+     */
+    VehicleData spawn(double X, float lane);
+
+    /**
+     * Gives back the id of a removed vehicle.
+     */
+    void release(VehicleId id);
+
+    /**
+     * Rebuilds Highway::slots from the lanes.
+     */
+    void reindex();
+
+    /**
+     * Rebuilds Highway::slots for the vehicles in slots [first, size()) of a lane.
+     */
+    void reindex(uint32_t lane, size_t first);
+
+    /**
+     * Vehicles joining a lane, and the slots of the ones leaving theirs, carried out together by
+     * Highway::moveVehicles. Kept around so the step doesn't allocate.
+     */
+    std::vector<LaneArrival> arrivals;
+    std::vector<VehicleSlot> departures;
+
+    /**
+     * Scratch for Highway::moveVehicles: where each lane's departures and arrivals start,
+     * and the slots handed to Lane::erase and Lane::openGaps, one list per lane.
+     */
+    std::vector<size_t> moveOffsets;
+    std::vector<std::vector<uint32_t>> laneSlots;
+
+    /**
+     * Takes the Highway::departures off their lanes, and puts the Highway::arrivals on theirs,
+     * where their X keeps the lanes sorted. Each lane shifts its vehicles once, however many come and go,
+     * and the lanes are done in parallel. Highway::slots is fixed for what moved.
+     */
+    void moveVehicles();
+
+    /**
+     * Picks where a vehicle added near (X, lane) goes, and how fast, and queues it in Highway::arrivals.
+     * Leaves room around the vehicles on the lane and the ones queued already.
+     * @return false if there's no room for it there.
+     */
+    bool planArrival(double X, float lane, float speed);
+
+    /**
+     * Holds a vehicle being added while it picks its targets, see Highway::planArrival.
+     */
+    Lane staging;
 
     /**
      * Moves the vehicles too far to the back at the front of our column, and the other way around.
-     * This is a trick to reuse resources.
+     * This is a trick to reuse resources: the slots of the vehicles that leave are rotated to the
+     * other end of the lane and filled in with freshly sampled vehicles, so nothing is allocated.
      */
     void teleportVehicles();
 
     /**
-     * Helper function, returns a Target object.
+     * On a ring road, brings the vehicles that drove past its end back to its start.
+     * They're the last ones on their lanes, so one rotation puts them first.
+     */
+    void wrapVehicles();
+
+    /**
+     * Helper function, returns a Target object for the vehicle in slot j of targLane,
+     * as seen from the vehicle in slot i of curLane.
+     * @param shift Added to the position of the target, to see it across the seam of a ring road.
      */
-    Target *target(const Vehicle *current, const Vehicle *targ);
+    Target target(const Lane &curLane, size_t i, const Lane &targLane, size_t j, double shift = 0);
+
+    /**
+     * Fills in the left or right neighbours of the vehicles in slots [begin, end) of cur,
+     * from the adjacent lane side.
+     * Linear in the number of vehicles walked on both lanes.
+     * @param n The neighbours of the vehicles on cur, in slot order.
+     */
+    void findSideNeighbours(const Lane &cur, const Lane &side, Neighbours *n, bool left,
+                            size_t begin, size_t end);
 
     /**
      * Sorts the vehicles on all the lanes, after their X coordinate.
      */
     void sort();
+
+    /**
+     * Cuts the lanes into Highway::chunks and makes room for their neighbours and next state.
+     */
+    void planChunks();
+
+    /**
+     * Calls f(c) for every chunk index c. In parallel when the highway is big enough.
+     */
+    template<typename F>
+    void forEachChunk(F &f);
+
+    /**
+     * Fills in Highway::links for the vehicles of one chunk.
+     */
+    void findNeighbours(const StepChunk &chunk);
+
+    /**
+     * Finds the neighbours of the vehicles in one chunk, lets them think, and integrates them.
+     */
+    void updateChunk(size_t c, float dt);
+
+    /**
+     * Carries out the decisions collected while thinking, then moves the vehicles
+     * that start changing lane to their new lane.
+     */
+    void commitDecisions(float dt);
 };
 
 #endif /* HIGHWAY_H */
-
@@ -0,0 +1,161 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEC_ACC_CPP_HIGHWAYCOMMAND_H
+#define LEC_ACC_CPP_HIGHWAYCOMMAND_H
+
+/**
+ * @file HighwayCommand.h
+ * @brief An order from the user to the simulation
+ */
+
+#include "Vehicle.h"
+
+/**
+ * What a HighwayCommand does.
+ */
+enum class CommandType : uint8_t {
+    setTargetSpeed,
+    setTargetDistance,
+    setAction,
+    addVehicleAt,
+    addVehicleInFrontOfPreferred,
+    addVehicles,
+    selectVehicleAt,
+    unselectVehicle
+};
+
+/**
+ * An order from the user, carried out by Highway::execute at the start of a step.
+ *
+ * The UI doesn't touch the highway while it's being stepped: it posts these instead (Highway::post).
+ * A plain value, so queuing one doesn't allocate, and a log of them, with the step they ran before,
+ * plays the user's part of a run back exactly. Use the static functions to make them.
+ */
+struct HighwayCommand {
+    CommandType type;
+
+    /**
+     * The vehicle the order is for, if any.
+     */
+    VehicleId vehicle;
+
+    /**
+     * Road coordinate, for the orders that pick a place.
+     */
+    double x;
+
+    float lane;
+
+    /**
+     * Speed (m/s) or distance (m), depending on the type.
+     */
+    float value;
+
+    Action action;
+
+    /**
+     * How many times to carry out the order, for the ones that come in batches.
+     */
+    uint32_t count;
+
+    static HighwayCommand setTargetSpeed(VehicleId vehicle, float speed) {
+        HighwayCommand c = make(CommandType::setTargetSpeed);
+        c.vehicle = vehicle;
+        c.value = speed;
+        return c;
+    }
+
+    static HighwayCommand setTargetDistance(VehicleId vehicle, float distance) {
+        HighwayCommand c = make(CommandType::setTargetDistance);
+        c.vehicle = vehicle;
+        c.value = distance;
+        return c;
+    }
+
+    static HighwayCommand setAction(VehicleId vehicle, Action action) {
+        HighwayCommand c = make(CommandType::setAction);
+        c.vehicle = vehicle;
+        c.action = action;
+        return c;
+    }
+
+    static HighwayCommand addVehicleAt(double x, float lane, float speed) {
+        HighwayCommand c = make(CommandType::addVehicleAt);
+        c.x = x;
+        c.lane = lane;
+        c.value = speed;
+        return c;
+    }
+
+    static HighwayCommand addVehicleInFrontOfPreferred(float speed) {
+        HighwayCommand c = make(CommandType::addVehicleInFrontOfPreferred);
+        c.value = speed;
+        return c;
+    }
+
+    /**
+     * Adds a number of vehicles at random places on the road around the ACC, in one go.
+     */
+    static HighwayCommand addVehicles(uint32_t count, float speed) {
+        HighwayCommand c = make(CommandType::addVehicles);
+        c.count = count;
+        c.value = speed;
+        return c;
+    }
+
+    static HighwayCommand selectVehicleAt(double x, float lane) {
+        HighwayCommand c = make(CommandType::selectVehicleAt);
+        c.x = x;
+        c.lane = lane;
+        return c;
+    }
+
+    static HighwayCommand unselectVehicle() {
+        return make(CommandType::unselectVehicle);
+    }
+
+private:
+    static HighwayCommand make(CommandType type) {
+        HighwayCommand c;
+        c.type = type;
+        c.vehicle = NO_VEHICLE;
+        c.x = 0;
+        c.lane = 0;
+        c.value = 0;
+        c.action = Action::none;
+        c.count = 1;
+        return c;
+    }
+};
+
+#endif
@@ -0,0 +1,254 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file HighwayConfig.cpp
+ * @brief Size and tuning of the highway simulation
+ */
+
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include "HighwayConfig.h"
+#include "Error.h"
+
+/**
+ * Least road, in meters, a vehicle gets on a ring road.
+ */
+static const float MIN_RING_SPACING = 20.0f;
+
+static int parseInt(const std::string &key, const std::string &value) {
+    std::istringstream in(value);
+    int n;
+    if (!(in >> n) || !(in >> std::ws).eof()) {
+        throw Error("Bad integer for " + key + ": '" + value + "'");
+    }
+    return n;
+}
+
+static float parseFloat(const std::string &key, const std::string &value) {
+    std::istringstream in(value);
+    float f;
+    if (!(in >> f) || !(in >> std::ws).eof()) {
+        throw Error("Bad number for " + key + ": '" + value + "'");
+    }
+    return f;
+}
+
+void HighwayConfig::set(const std::string &key, const std::string &value) {
+    if (key == "lanes") {
+        lanes = parseInt(key, value);
+    } else if (key == "vehicles-per-lane") {
+        vehiclesPerLane = parseInt(key, value);
+    } else if (key == "acc-ratio") {
+        accRatio = parseFloat(key, value);
+    } else if (key == "teleport-distance") {
+        teleportDistance = parseFloat(key, value);
+    } else if (key == "ring-length") {
+        ringLength = parseFloat(key, value);
+    } else if (key == "view-distance") {
+        maxViewDistance = parseFloat(key, value);
+    } else if (key == "stabilise-steps") {
+        stabiliseSteps = parseInt(key, value);
+    } else if (key == "step-rate") {
+        stepRate = parseFloat(key, value);
+    } else if (key == "max-substeps") {
+        maxSubsteps = parseInt(key, value);
+    } else if (key == "sim-thread") {
+        simulationThread = parseInt(key, value) != 0;
+    } else if (key == "threads") {
+        threads = parseInt(key, value);
+    } else if (key == "seed") {
+        seed = parseInt(key, value);
+    } else if (key == "warm-start") {
+        warmStartDir = value;
+    } else if (key == "perf-counters") {
+        perfCounters = parseInt(key, value) != 0;
+    } else if (key == "trace") {
+        traceFile = value;
+    } else if (key == "record") {
+        recordFile = value;
+    } else {
+        throw Error("Unknown option: " + key);
+    }
+}
+
+void HighwayConfig::load(const std::string &path) {
+    std::ifstream in(path.c_str());
+    if (!in) {
+        throw Error("Can't read config file " + path);
+    }
+    read(in, path);
+}
+
+void HighwayConfig::read(std::istream &in, const std::string &path) {
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+
+        size_t eq = line.find('=');
+        std::istringstream keyStream(line.substr(0, eq));
+        std::string key;
+        if (!(keyStream >> key)) {
+            // Blank line or comment
+            continue;
+        }
+        if (eq == std::string::npos) {
+            std::ostringstream ss;
+            ss << path << ":" << lineNumber << ": expected key = value";
+            throw Error(ss.str());
+        }
+
+        // The whole rest of the line, so paths can have spaces; numbers reject anything after them
+        std::string value = line.substr(eq + 1);
+        size_t first = value.find_first_not_of(" \t\r");
+        size_t last = value.find_last_not_of(" \t\r");
+        value = first == std::string::npos ? "" : value.substr(first, last - first + 1);
+        set(key, value);
+    }
+}
+
+void HighwayConfig::validate() const {
+    std::ostringstream ss;
+    if (lanes < 1 || lanes > MAX_LANES) {
+        ss << "lanes must be between 1 and " << MAX_LANES;
+    } else if (vehiclesPerLane < 2 || vehiclesPerLane > MAX_VEHICLES_PER_LANE) {
+        ss << "vehicles-per-lane must be between 2 and " << MAX_VEHICLES_PER_LANE;
+    } else if (!(accRatio >= 0 && accRatio <= 1)) {
+        ss << "acc-ratio must be between 0 and 1";
+    } else if (teleportDistance < 0) {
+        ss << "teleport-distance can't be negative";
+    } else if (!(ringLength >= 0)) {
+        ss << "ring-length can't be negative";
+    } else if (ringLength > 0 && ringLength < vehiclesPerLane * MIN_RING_SPACING) {
+        ss << "ring-length must leave every vehicle at least " << MIN_RING_SPACING << " m";
+    } else if (maxViewDistance <= 0) {
+        ss << "view-distance must be positive";
+    } else if (stabiliseSteps < 0) {
+        ss << "stabilise-steps can't be negative";
+    } else if (!(stepRate > 0)) {
+        ss << "step-rate must be positive";
+    } else if (maxSubsteps < 1) {
+        ss << "max-substeps must be at least 1";
+    } else if (threads < 0 || threads > MAX_THREADS) {
+        ss << "threads must be between 0 and " << MAX_THREADS;
+    } else if (seed < 0) {
+        ss << "seed can't be negative";
+    } else {
+        return;
+    }
+    throw Error(ss.str());
+}
+
+std::string HighwayConfig::toString() const {
+    std::ostringstream ss;
+    // Enough digits for the floats to read back the same
+    ss << std::setprecision(std::numeric_limits<float>::max_digits10)
+       << "lanes = " << lanes << "\n"
+       << "vehicles-per-lane = " << vehiclesPerLane << "\n"
+       << "acc-ratio = " << accRatio << "\n"
+       << "teleport-distance = " << teleportDistance << "\n"
+       << "ring-length = " << ringLength << "\n"
+       << "view-distance = " << maxViewDistance << "\n"
+       << "stabilise-steps = " << stabiliseSteps << "\n"
+       << "step-rate = " << stepRate << "\n"
+       << "max-substeps = " << maxSubsteps << "\n"
+       << "sim-thread = " << simulationThread << "\n"
+       << "threads = " << threads << "\n"
+       << "seed = " << seed << "\n"
+       << "perf-counters = " << perfCounters << "\n";
+    if (!warmStartDir.empty()) {
+        ss << "warm-start = " << warmStartDir << "\n";
+    }
+    if (!traceFile.empty()) {
+        ss << "trace = " << traceFile << "\n";
+    }
+    if (!recordFile.empty()) {
+        ss << "record = " << recordFile << "\n";
+    }
+    return ss.str();
+}
+
+HighwayConfig HighwayConfig::fromArgs(int argc, char **argv) {
+    return fromArgs(argc, argv, HighwayConfig());
+}
+
+HighwayConfig HighwayConfig::fromArgs(int argc, char **argv, const HighwayConfig &base) {
+    HighwayConfig config = base;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) {
+            throw Error("Unexpected argument: " + arg + "\n" + usage());
+        }
+        if (i + 1 >= argc) {
+            throw Error("Missing value for " + arg + "\n" + usage());
+        }
+
+        std::string key = arg.substr(2);
+        std::string value = argv[++i];
+        if (key == "config") {
+            config.load(value);
+        } else {
+            config.set(key, value);
+        }
+    }
+
+    config.validate();
+    return config;
+}
+
+std::string HighwayConfig::usage() {
+    std::ostringstream ss;
+    ss << "Options:\n"
+       << "  --config FILE             read options from FILE (key = value per line)\n"
+       << "  --lanes N                 number of lanes, 1 to " << MAX_LANES << "\n"
+       << "  --vehicles-per-lane N     vehicles on each lane, 2 to " << MAX_VEHICLES_PER_LANE << "\n"
+       << "  --acc-ratio R             share of the other vehicles with ACC, 0 to 1\n"
+       << "  --teleport-distance M     teleport vehicles farther than M meters from the ACC (0: automatic)\n"
+       << "  --ring-length M           drive around a ring road M meters long, no teleporting (0: straight road)\n"
+       << "  --view-distance M         how far vehicles can see, in meters\n"
+       << "  --stabilise-steps N       steps run before the simulation is shown\n"
+       << "  --step-rate HZ            simulation steps per second, whatever the frame rate\n"
+       << "  --max-substeps N          most steps run in one frame before the simulation falls behind\n"
+       << "  --sim-thread 0            step the simulation on the window's thread, between frames\n"
+       << "  --threads N               threads stepping the simulation (0: every core)\n"
+       << "  --seed N                  seed for the random numbers (0: different on every run)\n"
+       << "  --warm-start DIR          keep stabilised highways in DIR, and start from there next time (needs --seed)\n"
+       << "  --perf-counters 1         read hardware performance counters per phase (Linux)\n"
+       << "  --trace FILE              write a timeline of frames and step phases to FILE, as a Chrome trace\n"
+       << "  --record FILE             write where every vehicle is after every step to FILE, compressed\n";
+    return ss.str();
+}
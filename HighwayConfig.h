@@ -0,0 +1,202 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEC_ACC_CPP_HIGHWAYCONFIG_H
+#define LEC_ACC_CPP_HIGHWAYCONFIG_H
+
+/**
+ * @file HighwayConfig.h
+ * @brief Size and tuning of the highway simulation
+ */
+
+#include <istream>
+#include <string>
+
+/**
+ * Size and tuning of the highway, chosen at run time.
+ *
+ * Can be read from the command line or from a file with one "key = value" per line.
+ * The keys are the command line options without the leading dashes:
+ *
+ *     lanes, vehicles-per-lane, acc-ratio, teleport-distance, ring-length, view-distance, stabilise-steps,
+ *     step-rate, max-substeps, sim-thread, threads, seed, warm-start, perf-counters, trace,
+ *     record
+ */
+struct HighwayConfig {
+    /**
+     * Most lanes we support.
+     */
+    static const int MAX_LANES = 16;
+
+    /**
+     * Most vehicles per lane we support.
+     */
+    static const int MAX_VEHICLES_PER_LANE = 100000;
+
+    /**
+     * Most threads we step the highway with.
+     */
+    static const int MAX_THREADS = 256;
+
+    /**
+     * Number of lanes on the highway. All lanes go right.
+     */
+    int lanes = 3;
+
+    /**
+     * Number of vehicles put on each lane at the start.
+     */
+    int vehiclesPerLane = 40;
+
+    /**
+     * Share of the other vehicles that also drive with adaptive cruise control, from 0 to 1.
+     * The preferred vehicle always does.
+     */
+    float accRatio = 0;
+
+    /**
+     * Vehicles farther than this from the ACC get teleported to the other end of their lane.
+     * 0 picks a distance that fits the number of vehicles per lane.
+     */
+    float teleportDistance = 0;
+
+    /**
+     * Length of a ring road, in meters: vehicles that drive past its end come back at its start,
+     * and nobody is teleported. 0 for a straight road.
+     */
+    float ringLength = 0;
+
+    /**
+     * Vehicles can't see farther than this, in meters.
+     */
+    float maxViewDistance = 200.0f;
+
+    /**
+     * Number of steps run by Highway::stabilise.
+     */
+    int stabiliseSteps = 2000;
+
+    /**
+     * Steps per second of simulated time, whatever the frame rate. See StepClock.
+     */
+    float stepRate = 100;
+
+    /**
+     * Most steps run for one frame. If a frame takes longer than that, the simulation falls behind.
+     */
+    int maxSubsteps = 10;
+
+    /**
+     * Steps the highway on its own thread in the viewer, so drawing and stepping don't hold each other back.
+     * See Simulation.
+     */
+    bool simulationThread = true;
+
+    /**
+     * Number of threads stepping the highway. 0 uses every core.
+     */
+    int threads = 0;
+
+    /**
+     * Seed for the random numbers. A given seed plays out the same on any number of threads.
+     * 0 picks a different seed on every run.
+     */
+    int seed = 0;
+
+    /**
+     * Directory where stabilised highways are cached, see WarmStart. Empty for none.
+     * Only highways with a fixed seed are cached.
+     */
+    std::string warmStartDir;
+
+    /**
+     * Reads the hardware performance counters for each phase of the step, see PerfCounters.
+     */
+    bool perfCounters = false;
+
+    /**
+     * Records a timeline of the frames and the phases of the step to this file,
+     * in the Chrome trace format (see Trace). Empty for none.
+     */
+    std::string traceFile;
+
+    /**
+     * Records where every vehicle is after every step to this file, compressed (see TrajectoryRecorder).
+     * The stabilising steps aren't recorded. Empty for none.
+     */
+    std::string recordFile;
+
+    /**
+     * Sets one option. Throws an Error for unknown keys or bad values.
+     */
+    void set(const std::string &key, const std::string &value);
+
+    /**
+     * Reads the options in the given file. Throws an Error if it can't.
+     */
+    void load(const std::string &path);
+
+    /**
+     * Reads the options from a stream, in the same format as HighwayConfig::load.
+     * @param path Where the stream comes from, for the error messages.
+     */
+    void read(std::istream &in, const std::string &path);
+
+    /**
+     * All the options, in the format HighwayConfig::read reads back.
+     */
+    std::string toString() const;
+
+    /**
+     * Throws an Error if the values are out of range.
+     */
+    void validate() const;
+
+    /**
+     * Reads the options from the command line, as "--key value" pairs.
+     * "--config file" loads a file at that point, so later options override it.
+     * Throws an Error on bad input, or if the result doesn't validate.
+     */
+    static HighwayConfig fromArgs(int argc, char **argv);
+
+    /**
+     * Reads the options from the command line on top of base, see HighwayConfig::fromArgs.
+     */
+    static HighwayConfig fromArgs(int argc, char **argv, const HighwayConfig &base);
+
+    /**
+     * Short description of the command line options.
+     */
+    static std::string usage();
+};
+
+#endif
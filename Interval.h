@@ -39,45 +39,61 @@
  * @brief Random number intervals
  */
 
-#include <random>
+#include <algorithm>
+#include <cmath>
+#include "Random.h"
 
 /**
  * Float interval that can be sampled.
+ *
+ * Intervals only hold their bounds, and draw from the RandomStream they're given,
+ * so they're safe to use while the highway steps in parallel.
  */
 class Interval {
 private:
-    std::random_device r;
-    std::mt19937 e1;
-    std::uniform_real_distribution<float> uniform_dist;
-    std::normal_distribution<float> normal_dist;
     float min;
     float max;
 
     template<typename T>
-    T clip(const T &n, const T &lower, const T &upper) {
+    static T clip(const T &n, const T &lower, const T &upper) {
         return std::max(lower, std::min(n, upper));
     }
 
 public:
     Interval(float min, float max) : min(min), max(max) {
-        e1 = std::mt19937(r());
-        uniform_dist = std::uniform_real_distribution<float>(min, max);
-        normal_dist = std::normal_distribution<float>((min + max) / 2, (max - min) / 6);
     }
 
     /**
      * Samples the uniform random distribution.
      */
-    float uniform() {
-        return uniform_dist(e1);
+    float uniform(RandomStream &random) const {
+        return min + (max - min) * random.unit();
     }
 
     /**
      * Samples the normal random distribution.
      * Mean is (min+max)/2, and max-min is 6 sigma.
      */
-    float normal() {
-        return clip(normal_dist(e1), min, max);
+    float normal(RandomStream &random) const {
+        // Box-Muller, with the first uniform kept off 0
+        float u1 = 1.0f - random.unit();
+        float u2 = random.unit();
+        float z = std::sqrt(-2.0f * std::log(u1)) * std::cos(6.2831853f * u2);
+        return clip((min + max) / 2 + z * (max - min) / 6, min, max);
+    }
+
+    /**
+     * Samples the uniform random distribution, from the stream of the calling thread.
+     */
+    float uniform() const {
+        return uniform(RandomStream::local());
+    }
+
+    /**
+     * Samples the normal random distribution, from the stream of the calling thread.
+     */
+    float normal() const {
+        return normal(RandomStream::local());
     }
 };
 
@@ -35,18 +35,424 @@
  * @brief Car lane
  */
 
+#include <algorithm>
+#include <cstring>
+#include "ByteOrder.h"
 #include "Lane.h"
 
+namespace {
+
+/**
+ * Inserts a default value before the given slot.
+ */
+struct InsertColumn {
+    size_t i;
+
+    template<typename T>
+    void operator()(std::vector<T> &column) {
+        column.insert(column.begin() + i, T());
+    }
+};
+
+/**
+ * Removes the value in the given slot.
+ */
+struct EraseColumn {
+    size_t i;
+
+    template<typename T>
+    void operator()(std::vector<T> &column) {
+        column.erase(column.begin() + i);
+    }
+};
+
+/**
+ * Removes the values in the given slots, sorted, sliding the rest down in one pass.
+ */
+struct EraseSlotsColumn {
+    const std::vector<uint32_t> &slots;
+
+    template<typename T>
+    void operator()(std::vector<T> &column) {
+        typename std::vector<T>::iterator to = column.begin() + slots[0];
+        for (size_t k = 0; k < slots.size(); k++) {
+            size_t end = k + 1 < slots.size() ? slots[k + 1] : column.size();
+            to = std::move(column.begin() + slots[k] + 1, column.begin() + end, to);
+        }
+        column.erase(to, column.end());
+    }
+};
+
+/**
+ * Opens a gap before each of the given slots, sorted, sliding the rest up in one pass from the back.
+ */
+struct OpenGapsColumn {
+    const std::vector<uint32_t> &before;
+
+    template<typename T>
+    void operator()(std::vector<T> &column) {
+        size_t from = column.size();
+        column.resize(from + before.size());
+        typename std::vector<T>::iterator to = column.end();
+        for (size_t k = before.size(); k > 0; k--) {
+            to = std::move_backward(column.begin() + before[k - 1], column.begin() + from, to) - 1;
+            from = before[k - 1];
+        }
+    }
+};
+
+/**
+ * Moves the slots [first, size) to the front of the column, in one pass.
+ */
+struct RotateColumn {
+    size_t first;
+
+    template<typename T>
+    void operator()(std::vector<T> &column) {
+        std::rotate(column.begin(), column.begin() + first, column.end());
+    }
+};
+
+/**
+ * Makes room for a number of slots, so inserting up to that many doesn't allocate.
+ */
+struct ReserveColumn {
+    size_t n;
+
+    template<typename T>
+    void operator()(std::vector<T> &column) {
+        column.reserve(n);
+    }
+};
+
+/**
+ * Appends the whole column to a buffer, little-endian.
+ */
+struct SaveColumn {
+    std::vector<char> &out;
+
+    template<typename T>
+    void operator()(std::vector<T> &column) {
+        const char *bytes = reinterpret_cast<const char *>(column.data());
+        size_t start = out.size();
+        out.insert(out.end(), bytes, bytes + column.size() * sizeof(T));
+        ByteOrder::convert(out.data() + start, sizeof(T), column.size());
+    }
+};
+
+/**
+ * Replaces the column with n little-endian values read from a buffer, and moves past them.
+ */
+struct LoadColumn {
+    const char *&in;
+    size_t n;
+
+    template<typename T>
+    void operator()(std::vector<T> &column) {
+        column.resize(n);
+        std::memcpy(column.data(), in, n * sizeof(T));
+        ByteOrder::convert(column.data(), sizeof(T), n);
+        in += n * sizeof(T);
+    }
+};
+
+/**
+ * Adds up the size of one value of every column.
+ */
+struct ColumnBytes {
+    size_t bytes;
+
+    template<typename T>
+    void operator()(std::vector<T> &) {
+        bytes += sizeof(T);
+    }
+};
+
+/**
+ * Moves column[order[j]] to column[j], in place, following the cycles of the permutation.
+ * Slots outside [first, last) are known to stay put.
+ */
+struct PermuteColumn {
+    const std::vector<uint32_t> &order;
+    std::vector<uint8_t> &done;
+    size_t first;
+    size_t last;
+
+    template<typename T>
+    void operator()(std::vector<T> &column) {
+        std::fill(done.begin() + first, done.begin() + last, 0);
+        for (size_t start = first; start < last; start++) {
+            if (done[start] || order[start] == start) continue;
+
+            T first = column[start];
+            size_t j = start;
+            while (order[j] != start) {
+                column[j] = column[order[j]];
+                done[j] = 1;
+                j = order[j];
+            }
+            column[j] = first;
+            done[j] = 1;
+        }
+    }
+};
+
+}
+
 Lane::Lane() {
 }
 
-Lane::Lane(const Lane &orig) : vehicles(orig.vehicles) {
+Lane::Lane(const Lane &orig) :
+        id(orig.id), kind(orig.kind), x(orig.x), v(orig.v), a(orig.a),
+        targetSpeed(orig.targetSpeed), targetDistance(orig.targetDistance),
+        width(orig.width), length(orig.length), lane(orig.lane),
+        panicDistance(orig.panicDistance), reactionTime(orig.reactionTime),
+        terminalSpeed(orig.terminalSpeed), maxAcceleration(orig.maxAcceleration),
+        action(orig.action), timeUntilNextAction(orig.timeUntilNextAction),
+        unsatisfied(orig.unsatisfied), unsatisfiedTime(orig.unsatisfiedTime),
+        nextX(orig.nextX) {
+}
+
+Lane &Lane::operator=(const Lane &orig) {
+    id = orig.id;
+    kind = orig.kind;
+    x = orig.x;
+    v = orig.v;
+    a = orig.a;
+    targetSpeed = orig.targetSpeed;
+    targetDistance = orig.targetDistance;
+    width = orig.width;
+    length = orig.length;
+    lane = orig.lane;
+    panicDistance = orig.panicDistance;
+    reactionTime = orig.reactionTime;
+    terminalSpeed = orig.terminalSpeed;
+    maxAcceleration = orig.maxAcceleration;
+    action = orig.action;
+    timeUntilNextAction = orig.timeUntilNextAction;
+    unsatisfied = orig.unsatisfied;
+    unsatisfiedTime = orig.unsatisfiedTime;
+    nextX = orig.nextX;
+    return *this;
 }
 
 Lane::~Lane() {
-    for (Vehicle *v: vehicles) {
-        delete v;
+}
+
+template<typename F>
+void Lane::forEachColumn(F &f) {
+    f(id);
+    f(kind);
+    f(x);
+    f(v);
+    f(a);
+    f(targetSpeed);
+    f(targetDistance);
+    f(width);
+    f(length);
+    f(lane);
+    f(panicDistance);
+    f(reactionTime);
+    f(terminalSpeed);
+    f(maxAcceleration);
+    f(action);
+    f(timeUntilNextAction);
+    f(unsatisfied);
+    f(unsatisfiedTime);
+    f(nextX);
+}
+
+VehicleData Lane::get(size_t i) const {
+    VehicleData d;
+    d.id = id[i];
+    d.kind = kind[i];
+    d.x = x[i];
+    d.v = v[i];
+    d.a = a[i];
+    d.targetSpeed = targetSpeed[i];
+    d.targetDistance = targetDistance[i];
+    d.width = width[i];
+    d.length = length[i];
+    d.lane = lane[i];
+    d.panicDistance = panicDistance[i];
+    d.reactionTime = reactionTime[i];
+    d.terminalSpeed = terminalSpeed[i];
+    d.maxAcceleration = maxAcceleration[i];
+    d.action = action[i];
+    d.timeUntilNextAction = timeUntilNextAction[i];
+    d.unsatisfied = unsatisfied[i] != 0;
+    d.unsatisfiedTime = unsatisfiedTime[i];
+    return d;
+}
+
+void Lane::set(size_t i, const VehicleData &d) {
+    id[i] = d.id;
+    kind[i] = d.kind;
+    x[i] = d.x;
+    v[i] = d.v;
+    a[i] = d.a;
+    targetSpeed[i] = d.targetSpeed;
+    targetDistance[i] = d.targetDistance;
+    width[i] = d.width;
+    length[i] = d.length;
+    lane[i] = d.lane;
+    panicDistance[i] = d.panicDistance;
+    reactionTime[i] = d.reactionTime;
+    terminalSpeed[i] = d.terminalSpeed;
+    maxAcceleration[i] = d.maxAcceleration;
+    action[i] = d.action;
+    timeUntilNextAction[i] = d.timeUntilNextAction;
+    unsatisfied[i] = d.unsatisfied;
+    unsatisfiedTime[i] = d.unsatisfiedTime;
+    nextX[i] = d.x;
+}
+
+void Lane::insert(size_t i, const VehicleData &d) {
+    InsertColumn f = {i};
+    forEachColumn(f);
+    set(i, d);
+}
+
+void Lane::erase(size_t i) {
+    EraseColumn f = {i};
+    forEachColumn(f);
+}
+
+void Lane::erase(const std::vector<uint32_t> &slots) {
+    if (slots.empty()) {
+        return;
+    }
+    EraseSlotsColumn f = {slots};
+    forEachColumn(f);
+}
+
+void Lane::openGaps(const std::vector<uint32_t> &before) {
+    if (before.empty()) {
+        return;
+    }
+    OpenGapsColumn f = {before};
+    forEachColumn(f);
+}
+
+void Lane::rotate(size_t first) {
+    if (first == 0 || first >= size()) {
+        return;
     }
-    vehicles.clear();
+    RotateColumn f = {first};
+    forEachColumn(f);
+}
+
+void Lane::reserve(size_t n) {
+    ReserveColumn f = {n};
+    forEachColumn(f);
+    nextV.reserve(n);
+    // And the room Lane::sort works in
+    order.reserve(n);
+    merged.reserve(n);
+    done.reserve(n);
+}
+
+void Lane::save(std::vector<char> &out) const {
+    // Only reads the columns
+    SaveColumn f = {out};
+    const_cast<Lane *>(this)->forEachColumn(f);
+}
+
+void Lane::load(const char *&in, size_t n) {
+    LoadColumn f = {in, n};
+    forEachColumn(f);
 }
 
+size_t Lane::savedVehicleSize() const {
+    ColumnBytes f = {0};
+    const_cast<Lane *>(this)->forEachColumn(f);
+    return f.bytes;
+}
+
+size_t Lane::find(VehicleId vehicle) const {
+    return std::find(id.begin(), id.end(), vehicle) - id.begin();
+}
+
+size_t Lane::lowerBound(double X) const {
+    return std::lower_bound(x.begin(), x.end(), X) - x.begin();
+}
+
+void Lane::beginStep() {
+    nextX.resize(size());
+    nextV.resize(size());
+}
+
+void Lane::commitStep() {
+    x.swap(nextX);
+    v.swap(nextV);
+}
+
+size_t Lane::sort() {
+    if (std::is_sorted(x.begin(), x.end())) {
+        return 0;
+    }
+
+    size_t n = size();
+    order.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        order[i] = (uint32_t) i;
+    }
+
+    // Insertion sort: every shift fixes exactly one inversion.
+    // Give up once that costs more than a merge sort would.
+    size_t inversions = 0;
+    size_t i = 1;
+    for (; i < n && inversions <= n; i++) {
+        uint32_t key = order[i];
+        double keyX = x[key];
+        size_t j = i;
+        while (j > 0 && x[order[j - 1]] > keyX) {
+            order[j] = order[j - 1];
+            --j;
+        }
+        order[j] = key;
+        inversions += i - j;
+    }
+    if (i < n) {
+        inversions += mergeSort();
+    }
+
+    size_t first = 0, last = n;
+    while (first < last && order[first] == first) ++first;
+    while (last > first && order[last - 1] == last - 1) --last;
+
+    done.resize(n);
+    PermuteColumn f = {order, done, first, last};
+    forEachColumn(f);
+
+    return inversions;
+}
+
+size_t Lane::mergeSort() {
+    size_t n = order.size();
+    size_t inversions = 0;
+    merged.resize(n);
+
+    for (size_t width = 1; width < n; width *= 2) {
+        for (size_t lo = 0; lo < n; lo += 2 * width) {
+            size_t mid = std::min(lo + width, n);
+            size_t hi = std::min(lo + 2 * width, n);
+            size_t i = lo, j = mid, k = lo;
+
+            while (i < mid && j < hi) {
+                if (x[order[j]] < x[order[i]]) {
+                    // order[j] jumps over everything left in the first run
+                    inversions += mid - i;
+                    merged[k++] = order[j++];
+                } else {
+                    merged[k++] = order[i++];
+                }
+            }
+            while (i < mid) merged[k++] = order[i++];
+            while (j < hi) merged[k++] = order[j++];
+        }
+        order.swap(merged);
+    }
+
+    return inversions;
+}
@@ -38,12 +38,17 @@
  * @brief Car lane
  */
 
-#include <deque>
+#include <cstdint>
+#include <vector>
 #include "Vehicle.h"
 
 /**
- * Proxy for the deque.
- * Practically useless.
+ * The vehicles on one lane, sorted by their X coordinate.
+ *
+ * Every vehicle field is kept in its own contiguous array, and slot i of every array
+ * belongs to the same vehicle. The simulation sweeps these arrays front to back,
+ * so it doesn't chase a pointer for every vehicle.
+ * See VehicleData for what each field means.
  */
 class Lane {
 public:
@@ -51,10 +56,195 @@ public:
 
     Lane(const Lane &orig);
 
+    /**
+     * Copies the vehicles, and Lane::nextX, like the copy constructor. Lane::nextV and the scratch space
+     * are left as they were: the next step and the next sort fill them in.
+     */
+    Lane &operator=(const Lane &orig);
+
     virtual ~Lane();
 
-    std::deque<Vehicle *> vehicles;
+    /**
+     * Number of vehicles on the lane.
+     */
+    size_t size() const {
+        return x.size();
+    }
+
+    bool empty() const {
+        return x.empty();
+    }
+
+    /**
+     * Gathers all the fields of the vehicle in slot i.
+     */
+    VehicleData get(size_t i) const;
+
+    /**
+     * Overwrites all the fields of the vehicle in slot i.
+     */
+    void set(size_t i, const VehicleData &d);
+
+    /**
+     * Inserts a vehicle before slot i.
+     */
+    void insert(size_t i, const VehicleData &d);
+
+    void push_back(const VehicleData &d) {
+        insert(size(), d);
+    }
+
+    void push_front(const VehicleData &d) {
+        insert(0, d);
+    }
+
+    /**
+     * Removes the vehicle in slot i.
+     */
+    void erase(size_t i);
+
+    /**
+     * Removes the vehicles in the given slots, in increasing order.
+     * Costs one pass over the lane, however many go.
+     */
+    void erase(const std::vector<uint32_t> &slots);
+
+    /**
+     * Makes room for a batch of vehicles: the k-th one goes before slot before[k] of the lane as it is now,
+     * and ends up in slot before[k] + k, to be filled in with Lane::set. before has to be in increasing order.
+     * Costs one pass over the lane, however many come in.
+     */
+    void openGaps(const std::vector<uint32_t> &before);
+
+    /**
+     * Moves the vehicles in slots [first, size()) to the front, keeping their order,
+     * and the ones before them to the back. Costs one pass over the lane, however many move.
+     */
+    void rotate(size_t first);
+
+    /**
+     * Makes room for n vehicles, so the lane grows up to that without allocating.
+     */
+    void reserve(size_t n);
+
+    /**
+     * Appends every vehicle field to out, column after column, little-endian. See Checkpoint.
+     */
+    void save(std::vector<char> &out) const;
+
+    /**
+     * Replaces the vehicles with n of them read from in, as written by Lane::save, and moves in past them.
+     * The caller checks there are n * Lane::savedVehicleSize() bytes to read.
+     */
+    void load(const char *&in, size_t n);
+
+    /**
+     * Bytes taken by one vehicle in Lane::save.
+     */
+    size_t savedVehicleSize() const;
+
+    /**
+     * Returns the slot of the vehicle, or size() if it's not on this lane.
+     */
+    size_t find(VehicleId vehicle) const;
+
+    /**
+     * Returns the first slot with an X coordinate not less than X.
+     */
+    size_t lowerBound(double X) const;
+
+    /**
+     * Sorts the vehicles after their X coordinate.
+     *
+     * Vehicles rarely overtake each other between two steps, so the lane is usually sorted
+     * or close to it. This fixes the order with an insertion sort, which is linear in that case,
+     * and switches to a merge sort once there are more inversions than vehicles.
+     * @return The number of inversions (pairs of vehicles out of order) that were fixed.
+     */
+    size_t sort();
+
+    /**
+     * Sizes Lane::nextX and Lane::nextV for the step about to be computed.
+     * Doesn't allocate once they're big enough.
+     */
+    void beginStep();
+
+    /**
+     * Makes the state computed in Lane::nextX and Lane::nextV the current one.
+     * Constant time: only the arrays are swapped.
+     */
+    void commitStep();
+
+    /**
+     * Position of the vehicle in slot i, a fraction alpha of the way through the last step.
+     * Lets the renderer draw in between two fixed steps.
+     */
+    double interpolatedX(size_t i, float alpha) const {
+        return nextX[i] + alpha * (x[i] - nextX[i]);
+    }
+
+    std::vector<VehicleId> id;
+    std::vector<VehicleKind> kind;
+    std::vector<double> x;
+    std::vector<float> v;
+    std::vector<float> a;
+    std::vector<float> targetSpeed;
+    std::vector<float> targetDistance;
+    std::vector<float> width;
+    std::vector<float> length;
+    std::vector<float> lane;
+    std::vector<float> panicDistance;
+    std::vector<float> reactionTime;
+    std::vector<float> terminalSpeed;
+    std::vector<float> maxAcceleration;
+    std::vector<Action> action;
+    std::vector<float> timeUntilNextAction;
+    std::vector<uint8_t> unsatisfied;
+    std::vector<float> unsatisfiedTime;
+
+    /**
+     * Position at the end of the step being computed.
+     * Vehicle::step writes here, so Lane::x stays untouched while other vehicles read it.
+     *
+     * After Lane::commitStep, it holds the positions from the start of that step,
+     * which the renderer interpolates from (see Lane::interpolatedX).
+     * Unlike Lane::nextV, it's kept in slot order by insert, erase, rotate and sort,
+     * and insert and set start it at the vehicle's position.
+     */
+    std::vector<double> nextX;
+
+    /**
+     * Speed at the end of the step being computed. See Lane::nextX.
+     */
+    std::vector<float> nextV;
+
+private:
+    /**
+     * Calls f on every array above, except Lane::nextV.
+     */
+    template<typename F>
+    void forEachColumn(F &f);
+
+    /**
+     * Scratch space for Lane::sort, kept around so sorting doesn't allocate.
+     */
+    std::vector<uint32_t> order;
+
+    /**
+     * Scratch space for Lane::sort.
+     */
+    std::vector<uint32_t> merged;
+
+    /**
+     * Scratch space for Lane::sort.
+     */
+    std::vector<uint8_t> done;
+
+    /**
+     * Finishes sorting Lane::order with a bottom-up merge sort.
+     * @return The number of inversions fixed.
+     */
+    size_t mergeSort();
 };
 
 #endif /* LANE_H */
-
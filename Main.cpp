@@ -37,12 +37,49 @@
  */
 
 #include <iostream>
+#include <string>
+#include <vector>
+#include "Error.h"
+#include "Replay.h"
+#include "Trace.h"
 #include "Window.h"
 #include "Window2D.h"
 
-int main() {
+int main(int argc, char **argv) {
+    Trace::setThreadName("Main");
 
-    Highway high;
+    // A recording plays back without a highway
+    std::string replayFile;
+    std::vector<char *> rest;
+    rest.push_back(argv[0]);
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--replay" && i + 1 < argc) {
+            replayFile = argv[++i];
+        } else {
+            rest.push_back(argv[i]);
+        }
+    }
+    if (!replayFile.empty()) {
+        try {
+            Replay replay(replayFile);
+            Window2D win(replay);
+            win.start();
+        } catch (const Error &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    HighwayConfig config;
+    try {
+        config = HighwayConfig::fromArgs((int) rest.size(), rest.data());
+    } catch (const Error &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    Highway high(config);
 
     high.stabilise();
 
@@ -37,50 +37,25 @@
 #include "Neighbours.h"
 
 
-Neighbours::Neighbours(Target *front, Target *back) {
-    this->back = back;
-    this->front = front;
-    backLeft = backRight = frontLeft = frontRight = nullptr;
+Neighbours::Neighbours(const Target &front, const Target &back) :
+        front(front), back(back),
+        left(false), right(false) {
 }
 
-Neighbours *Neighbours::withLeft(Target *front, Target *back) {
+Neighbours &Neighbours::withLeft(const Target &front, const Target &back) {
     frontLeft = front;
     backLeft = back;
-    return this;
+    left = true;
+    return *this;
 }
 
-Neighbours *Neighbours::withRight(Target *front, Target *back) {
+Neighbours &Neighbours::withRight(const Target &front, const Target &back) {
     frontRight = front;
     backRight = back;
-    return this;
-}
-
-Neighbours::Neighbours(const Neighbours &other) {
-    if (other.front != nullptr) front = new Target(*other.front);
-    if (other.back != nullptr) back = new Target(*other.back);
-    if (other.frontLeft != nullptr) frontLeft = new Target(*other.frontLeft);
-    if (other.frontRight != nullptr) frontRight = new Target(*other.frontRight);
-    if (other.backLeft != nullptr) backLeft = new Target(*other.backLeft);
-    if (other.backRight != nullptr) backRight = new Target(*other.backRight);
+    right = true;
+    return *this;
 }
 
 Neighbours::Neighbours() :
-        front(nullptr), back(nullptr),
-        frontLeft(nullptr), frontRight(nullptr),
-        backLeft(nullptr), backRight(nullptr) {
-
-}
-
-Neighbours::~Neighbours() {
-    if (front != nullptr) delete front;
-    if (back != nullptr) delete back;
-    if (frontLeft != nullptr) delete frontLeft;
-    if (frontRight != nullptr) delete frontRight;
-    if (backLeft != nullptr) delete backLeft;
-    if (backRight != nullptr) delete backRight;
+        left(false), right(false) {
 }
-
-
-
-
-
@@ -41,23 +41,29 @@
 
 /**
  * Contains the data for a vehicle's neighbours on the highway.
+ * Plain value: the highway writes these into a buffer it reuses every step.
  */
 struct Neighbours {
 public:
     Neighbours();
 
-    Target *front, *back, *frontLeft, *frontRight, *backLeft, *backRight;
+    Target front, back, frontLeft, frontRight, backLeft, backRight;
 
-    Neighbours(Target *front, Target *back);
+    /**
+     * False if there's no lane to the left, in which case frontLeft and backLeft mean nothing.
+     */
+    bool left;
 
-    Neighbours *withLeft(Target *front, Target *back);
+    /**
+     * False if there's no lane to the right, in which case frontRight and backRight mean nothing.
+     */
+    bool right;
 
-    Neighbours *withRight(Target *front, Target *back);
+    Neighbours(const Target &front, const Target &back);
 
-    Neighbours(const Neighbours &other);
+    Neighbours &withLeft(const Target &front, const Target &back);
 
-
-    virtual ~Neighbours();
+    Neighbours &withRight(const Target &front, const Target &back);
 };
 
 
@@ -0,0 +1,246 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file PerfCounters.cpp
+ * @brief Hardware performance counters, per part of the frame
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static bool isEnabled = false;
+static std::string statusMessage = "Hardware counters are off";
+static int fds[PerfCounters::EVENT_COUNT] = {-1, -1, -1, -1, -1};
+static uint64_t totals[PERF_REGION_COUNT][PerfCounters::EVENT_COUNT];
+static uint64_t steps = 0;
+
+#ifdef __linux__
+
+static int openCounter(uint32_t type, uint64_t config) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+bool PerfCounters::enable() {
+    if (isEnabled) {
+        return true;
+    }
+
+    const uint64_t l1dReadMiss = PERF_COUNT_HW_CACHE_L1D
+                                 | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                 | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    fds[cycles] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    int error = errno;
+    fds[instructions] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds[l1dMisses] = openCounter(PERF_TYPE_HW_CACHE, l1dReadMiss);
+    fds[llcMisses] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    fds[branchMisses] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+
+    std::ostringstream ss;
+    int opened = 0;
+    for (int e = 0; e < EVENT_COUNT; e++) {
+        if (fds[e] >= 0) {
+            opened++;
+        }
+    }
+    if (opened == 0) {
+        ss << "Hardware counters unavailable: " << std::strerror(error);
+        if (error == EACCES || error == EPERM) {
+            ss << " (see /proc/sys/kernel/perf_event_paranoid)";
+        }
+        statusMessage = ss.str();
+        return false;
+    }
+
+    ss << "Hardware counters on";
+    for (int e = 0; e < EVENT_COUNT; e++) {
+        if (fds[e] < 0) {
+            ss << ", no " << name((Event) e);
+        }
+    }
+    statusMessage = ss.str();
+    isEnabled = true;
+    return true;
+}
+
+void PerfCounters::read(uint64_t *values) {
+    for (int e = 0; e < EVENT_COUNT; e++) {
+        uint64_t data[3] = {0, 0, 0};
+        if (fds[e] < 0 || ::read(fds[e], data, sizeof(data)) != (ssize_t) sizeof(data)) {
+            values[e] = 0;
+            continue;
+        }
+        // value, time enabled, time running: scale up when the kernel multiplexed the counter
+        if (data[2] > 0 && data[2] < data[1]) {
+            values[e] = (uint64_t) ((double) data[0] * data[1] / data[2]);
+        } else {
+            values[e] = data[0];
+        }
+    }
+}
+
+#else
+
+bool PerfCounters::enable() {
+    statusMessage = "Hardware counters are only supported on Linux";
+    return false;
+}
+
+void PerfCounters::read(uint64_t *values) {
+    for (int e = 0; e < EVENT_COUNT; e++) {
+        values[e] = 0;
+    }
+}
+
+#endif
+
+bool PerfCounters::enabled() {
+    return isEnabled;
+}
+
+bool PerfCounters::available(Event e) {
+    return fds[e] >= 0;
+}
+
+const std::string &PerfCounters::status() {
+    return statusMessage;
+}
+
+void PerfCounters::add(PerfRegion region, const uint64_t *start) {
+    uint64_t now[EVENT_COUNT];
+    read(now);
+    for (int e = 0; e < EVENT_COUNT; e++) {
+        // Scaled multiplexed counts can go down a little
+        if (now[e] > start[e]) {
+            totals[(size_t) region][e] += now[e] - start[e];
+        }
+    }
+}
+
+void PerfCounters::addVehicleSteps(uint64_t n) {
+    // Only one highway steps while the counters are on; others may step on other threads when they're off
+    if (isEnabled) {
+        steps += n;
+    }
+}
+
+void PerfCounters::reset() {
+    std::memset(totals, 0, sizeof(totals));
+    steps = 0;
+}
+
+uint64_t PerfCounters::total(PerfRegion region, Event e) {
+    return totals[(size_t) region][e];
+}
+
+uint64_t PerfCounters::vehicleSteps() {
+    return steps;
+}
+
+const char *PerfCounters::name(Event e) {
+    switch (e) {
+        case cycles:
+            return "cycles";
+        case instructions:
+            return "instructions";
+        case l1dMisses:
+            return "L1D misses";
+        case llcMisses:
+            return "LLC misses";
+        case branchMisses:
+            return "branch misses";
+        default:
+            return "?";
+    }
+}
+
+const char *PerfCounters::name(PerfRegion region) {
+    switch (region) {
+        case PerfRegion::teleport:
+            return "Teleport";
+        case PerfRegion::sort:
+            return "Sort";
+        case PerfRegion::collisions:
+            return "Collision test";
+        case PerfRegion::update:
+            return "Update";
+        case PerfRegion::commit:
+            return "Lane change commit";
+        case PerfRegion::record:
+            return "Record";
+        case PerfRegion::draw:
+            return "Draw";
+        default:
+            return "?";
+    }
+}
+
+std::string PerfCounters::report() {
+    if (!isEnabled) {
+        return statusMessage + "\n";
+    }
+
+    std::ostringstream ss;
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-20s %10s %10s %6s %10s %10s %10s\n", "per vehicle-step",
+                  "cycles", "instr", "IPC", "L1D miss", "LLC miss", "br miss");
+    ss << line;
+
+    double n = steps > 0 ? (double) steps : 1.0;
+    for (size_t r = 0; r < PERF_REGION_COUNT; r++) {
+        const uint64_t *t = totals[r];
+        double ipc = t[cycles] > 0 ? (double) t[instructions] / t[cycles] : 0;
+        std::snprintf(line, sizeof(line), "%-20s %10.2f %10.2f %6.2f %10.3f %10.3f %10.3f\n",
+                      name((PerfRegion) r), t[cycles] / n, t[instructions] / n, ipc,
+                      t[l1dMisses] / n, t[llcMisses] / n, t[branchMisses] / n);
+        ss << line;
+    }
+    return ss.str();
+}
@@ -0,0 +1,159 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEC_ACC_CPP_PERFCOUNTERS_H
+#define LEC_ACC_CPP_PERFCOUNTERS_H
+
+/**
+ * @file PerfCounters.h
+ * @brief Hardware performance counters, per part of the frame
+ */
+
+#include <cstdint>
+#include <string>
+#include "StepProfile.h"
+
+/**
+ * The parts of a frame the hardware counters are split between.
+ * The update covers the neighbour search, think and integrate, which run together on the threads.
+ */
+enum class PerfRegion : uint8_t {
+    teleport,
+    sort,
+    collisions,
+    update,
+    commit,
+    record,
+    draw,
+    count
+};
+
+const size_t PERF_REGION_COUNT = (size_t) PerfRegion::count;
+
+/**
+ * Hardware counters (cycles, instructions, cache and branch misses) read through perf_event_open,
+ * and added up per PerfRegion.
+ *
+ * Off unless PerfCounters::enable is called. Only works on Linux, and only where perf is permitted
+ * (see /proc/sys/kernel/perf_event_paranoid); otherwise enable says why and everything reads 0.
+ * Counters the CPU doesn't have are left out, the others still work.
+ * Counts are for user space, on all the threads of the process started after enable.
+ */
+class PerfCounters {
+public:
+    enum Event {
+        cycles,
+        instructions,
+        l1dMisses,
+        llcMisses,
+        branchMisses,
+        EVENT_COUNT
+    };
+
+    /**
+     * Opens the counters. Call it before starting the threads that should be counted.
+     * @return false if no counter could be opened; PerfCounters::status tells why.
+     */
+    static bool enable();
+
+    static bool enabled();
+
+    /**
+     * Whether the given counter could be opened.
+     */
+    static bool available(Event e);
+
+    /**
+     * What happened when the counters were opened, for the user.
+     */
+    static const std::string &status();
+
+    /**
+     * Current value of every counter, scaled up if the kernel had to multiplex them.
+     */
+    static void read(uint64_t *values);
+
+    /**
+     * Adds what the counters went up by since start to a region.
+     */
+    static void add(PerfRegion region, const uint64_t *start);
+
+    /**
+     * Counts the vehicles stepped, to report the counters per vehicle-step.
+     */
+    static void addVehicleSteps(uint64_t n);
+
+    /**
+     * Forgets everything added so far.
+     */
+    static void reset();
+
+    static uint64_t total(PerfRegion region, Event e);
+
+    static uint64_t vehicleSteps();
+
+    static const char *name(Event e);
+
+    static const char *name(PerfRegion region);
+
+    /**
+     * Table of the counters per vehicle-step, with IPC, one region per line.
+     */
+    static std::string report();
+};
+
+/**
+ * Adds the counts until the end of the scope to a region. Costs a branch when the counters are off.
+ */
+class ScopedPerfRegion {
+public:
+    explicit ScopedPerfRegion(PerfRegion region) : region(region), on(PerfCounters::enabled()) {
+        if (on) {
+            PerfCounters::read(start);
+        }
+    }
+
+    ~ScopedPerfRegion() {
+        if (on) {
+            PerfCounters::add(region, start);
+        }
+    }
+
+private:
+    PerfRegion region;
+    bool on;
+    uint64_t start[PerfCounters::EVENT_COUNT];
+};
+
+#define ACC_PERF_REGION(region) ScopedPerfRegion ACC_PROFILE_CONCAT(perfRegion, __LINE__)(region)
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEC_ACC_CPP_RANDOM_H
+#define LEC_ACC_CPP_RANDOM_H
+
+/**
+ * @file Random.h
+ * @brief Counter-based random numbers
+ */
+
+#include <cstdint>
+
+/**
+ * Random numbers computed straight from a key and a counter, with Philox4x32-10
+ * (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3").
+ *
+ * The key is the seed of the run. Half of the counter numbers the draws, the other half names the stream,
+ * such as a vehicle and a step. Two streams never share a number, and a stream always draws the same
+ * numbers, whichever thread draws them and whatever the other streams did before.
+ * The whole state fits in a few words, so streams are cheap to make on the fly and to copy.
+ */
+class RandomStream {
+public:
+    /**
+     * Stream (a, b) of the given seed.
+     */
+    RandomStream(uint64_t seed = 0, uint32_t a = 0, uint32_t b = 0) : used(4) {
+        key[0] = (uint32_t) seed;
+        key[1] = (uint32_t) (seed >> 32);
+        counter[0] = counter[1] = 0;
+        counter[2] = a;
+        counter[3] = b;
+    }
+
+    /**
+     * Next 32 random bits.
+     */
+    uint32_t next() {
+        if (used == 4) {
+            block(counter, key, buffer);
+            if (++counter[0] == 0) {
+                ++counter[1];
+            }
+            used = 0;
+        }
+        return buffer[used++];
+    }
+
+    /**
+     * Uniform in [0, 1).
+     */
+    float unit() {
+        // The top 24 bits fill the float's mantissa exactly
+        return (next() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    /**
+     * Four random words for the given counter and key: ten rounds of Philox4x32.
+     */
+    static void block(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]) {
+        const uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+        const uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+
+        uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+        uint32_t k0 = key[0], k1 = key[1];
+        for (int round = 0; round < 10; round++) {
+            uint64_t p0 = (uint64_t) M0 * c0;
+            uint64_t p1 = (uint64_t) M1 * c2;
+            c0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+            c2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+            c1 = (uint32_t) p1;
+            c3 = (uint32_t) p0;
+            k0 += W0;
+            k1 += W1;
+        }
+        out[0] = c0;
+        out[1] = c1;
+        out[2] = c2;
+        out[3] = c3;
+    }
+
+    /**
+     * A stream for the calling thread, seeded differently on every run.
+     * For the looks of the viewer; the simulation draws from streams keyed by its own seed.
+     */
+    static RandomStream &local();
+
+private:
+    /**
+     * Saves and loads the whole stream, see Highway.
+     */
+    friend class Checkpoint;
+
+    uint32_t key[2];
+    uint32_t counter[4];
+    uint32_t buffer[4];
+    uint32_t used;
+};
+
+#endif
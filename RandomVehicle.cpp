@@ -35,8 +35,9 @@
  * @brief Random vehicle logic implementation
  */
 
-#include <iostream>
+#include <cmath>
 #include "RandomVehicle.h"
+#include "Lane.h"
 
 static Interval intSpeed(100 / 3.6f, 250 / 3.6f);
 static Interval intActionPeriod(5.7f, 13.6f);
@@ -45,123 +46,121 @@ static Interval longActionPeriod(16.0f, 24.0f);
 static Interval intActionDecider(0, 100);
 
 
-RandomVehicle::RandomVehicle(LaneChangeObserver *highway, float xx, float lane) : Vehicle(highway, lane) {
-    x = xx;
-    timeUntilNextAction = intActionPeriod.uniform();
+VehicleData RandomVehicle::create(double x, float lane, RandomStream &random) {
+    VehicleData d = Vehicle::sample(lane, random);
+    d.x = x;
+    d.timeUntilNextAction = intActionPeriod.uniform(random);
+    return d;
 }
 
-void RandomVehicle::decideAcceleration(const Neighbours *n) {
+void RandomVehicle::decideAcceleration(Lane &l, size_t i, const Target &front) {
+    float v = l.v[i];
+    float targetSpeed = l.targetSpeed[i];
+    float reactionTime = l.reactionTime[i];
+
     // positive -- we have space; negative -- we're too close
-    float distanceDrift = n->front->dist - targetDistance;
+    float distanceDrift = front.dist - l.targetDistance[i];
     // positive -- we're going too fast; negative -- we're too slow
     float speedDrift = v - targetSpeed;
 
     float exactAcceleration = 0;
 
-    if (n->front == nullptr) {
-        // No one in sight -- smoothly coast to target speed
-        a = -speedDrift / reactionTime;
-
-    } else {
-        // We may have a car in front
-        if (distanceDrift > 0) {
-            // Time until we reach the target distance
-            float reachTime = -distanceDrift / n->front->vRel;
-            if (reachTime < 0.0) {
-                // We will never reach the car in front
-                reachTime = 1e10;
-            }
-            float aCorrectRelativeSpeed = n->front->vRel / reachTime;
+    // There's always a car in front: far away when nobody's in sight,
+    // and then we just coast to target speed
+    if (distanceDrift > 0) {
+        // Time until we reach the target distance
+        float reachTime = -distanceDrift / front.vRel;
+        if (reachTime < 0.0) {
+            // We will never reach the car in front
+            reachTime = 1e10f;
+        }
+        float aCorrectRelativeSpeed = front.vRel / reachTime;
 
-            // Acceleration that gets us to the target speed within reactionTime
-            float aCorrectSpeed = -speedDrift / reactionTime;
+        // Acceleration that gets us to the target speed within reactionTime
+        float aCorrectSpeed = -speedDrift / reactionTime;
 
-            exactAcceleration = aCorrectSpeed + aCorrectRelativeSpeed;
+        exactAcceleration = aCorrectSpeed + aCorrectRelativeSpeed;
 
-        } else {
-            // Apply panic break if needed
-            float aPanicBreak = 0;
-            if (-distanceDrift > panicDistance) {
-                aPanicBreak = -maxAcceleration;
-            }
-
-            // Decelerate to target distance. Our speed doesn't matter anymore.
-            float aCorrectDistance = distanceDrift / reactionTime / reactionTime;
-            float aMatchSpeed = 2 * n->front->vRel / reactionTime;
-            exactAcceleration = aPanicBreak + aMatchSpeed + aCorrectDistance;
+    } else {
+        // Apply panic break if needed
+        float aPanicBreak = 0;
+        if (-distanceDrift > l.panicDistance[i]) {
+            aPanicBreak = -l.maxAcceleration[i];
         }
+
+        // Decelerate to target distance. Our speed doesn't matter anymore.
+        float aCorrectDistance = distanceDrift / reactionTime / reactionTime;
+        float aMatchSpeed = 2 * front.vRel / reactionTime;
+        exactAcceleration = aPanicBreak + aMatchSpeed + aCorrectDistance;
     }
 
-    a = exactAcceleration;
+    l.a[i] = exactAcceleration;
 }
 
-bool RandomVehicle::canChangeLane(Target *front, Target *back) {
-    if (front == nullptr || back == nullptr)
-        return false;
+bool RandomVehicle::canChangeLane(const Lane &l, size_t i, const Target &front, const Target &back) {
+    float reactionTime = l.reactionTime[i];
+    float panicDistance = l.panicDistance[i];
 
-    float timeToFront = -front->dist / front->vRel;
+    float timeToFront = -front.dist / front.vRel;
     if (timeToFront > 0 && timeToFront < reactionTime / 2) return false;
 
-    float timeToBack = back->dist / back->vRel;
+    float timeToBack = back.dist / back.vRel;
     if (timeToBack > 0 && timeToBack < reactionTime / 2) return false;
 
-    return !(std::abs(front->dist) < panicDistance * 2
-             || std::abs(back->dist) < panicDistance * 2.5);
+    return !(std::abs(front.dist) < panicDistance * 2
+             || std::abs(back.dist) < panicDistance * 2.5);
 }
 
-void RandomVehicle::decideAction() {
-    float decision = intActionDecider.uniform();
+void RandomVehicle::decideAction(Lane &l, size_t i, RandomStream &dice) {
+    float decision = intActionDecider.uniform(dice);
 
     if (decision < 25) {
-        action = Action::change_lane_right;
+        l.action[i] = Action::change_lane_right;
     } else if (decision < 50) {
-        if (targetSpeed > 130 / 3.6) {
-            action = Action::change_lane_left;
+        if (l.targetSpeed[i] > 130 / 3.6) {
+            l.action[i] = Action::change_lane_left;
         } else {
-            action = Action::change_lane_right;
+            l.action[i] = Action::change_lane_right;
         }
     } else if (decision < 80) {
-        targetSpeed = intSpeed.uniform();
-        action = Action::none;
+        l.targetSpeed[i] = intSpeed.uniform(dice);
+        l.action[i] = Action::none;
     }
 }
 
-void RandomVehicle::think(const Neighbours *n) {
-    Vehicle::think(n);
+void RandomVehicle::think(Lane &l, size_t i, const Neighbours &n, VehicleObserver *highway) {
+    Vehicle::applyAction(l, i, n, highway);
 
-    if (timeUntilNextAction < 0) {
-        timeUntilNextAction = intActionPeriod.uniform();
-        decideAction();
+    if (l.timeUntilNextAction[i] < 0) {
+        // Every vehicle rolls its own dice, keyed by its id and the step,
+        // so a given seed plays out the same however the step is split between threads
+        RandomStream dice = highway->dice(l.id[i]);
+        act(l, i, dice);
     }
 }
 
-RandomVehicle::~RandomVehicle() {
+void RandomVehicle::act(Lane &l, size_t i, RandomStream &dice) {
+    l.timeUntilNextAction[i] = intActionPeriod.uniform(dice);
+    decideAction(l, i, dice);
 }
 
-RandomVehicle::RandomVehicle(const RandomVehicle &other) :
-        Vehicle(other),
-        timeUntilNextAction(other.timeUntilNextAction) {
+void RandomVehicle::step(Lane &l, size_t i, float dt) {
+    Vehicle::integrate(l, i, dt);
+    l.timeUntilNextAction[i] -= dt;
 }
 
-
-void RandomVehicle::step(float dt) {
-    Vehicle::step(dt);
-    timeUntilNextAction -= dt;
+void RandomVehicle::setTargetSpeed(Lane &l, size_t i, float targetSpeed, RandomStream &random) {
+    l.targetSpeed[i] = targetSpeed;
+    l.timeUntilNextAction[i] = longActionPeriod.normal(random);
 }
 
-void RandomVehicle::setTargetSpeed(float targetSpeed) {
-    Vehicle::setTargetSpeed(targetSpeed);
-    timeUntilNextAction = longActionPeriod.normal();
+void RandomVehicle::setTargetDistance(Lane &l, size_t i, float targetDistance, RandomStream &random) {
+    l.targetDistance[i] = targetDistance;
+    l.timeUntilNextAction[i] = longActionPeriod.normal(random);
 }
 
-void RandomVehicle::setTargetDistance(float targetDistance) {
-    Vehicle::setTargetDistance(targetDistance);
-    timeUntilNextAction = longActionPeriod.normal();
-}
 
-
-void RandomVehicle::setAction(Action action) {
-    Vehicle::setAction(action);
-    timeUntilNextAction = longActionPeriod.normal();
+void RandomVehicle::setAction(Lane &l, size_t i, Action action, RandomStream &random) {
+    l.action[i] = action;
+    l.timeUntilNextAction[i] = longActionPeriod.normal(random);
 }
-
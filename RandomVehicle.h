@@ -45,50 +45,51 @@
  * Will change lane, speed and distance once in a while.
  * Can be ordered to change lane, speed or distance, and will hold onto those values
  * for a longer time, so the user can see the effect.
+ *
+ * The state lives in the Lane; these functions work on slot i of a lane.
  */
-class RandomVehicle : public Vehicle {
+class RandomVehicle {
 public:
 
     /**
-     * Override that sets a timeout on RandomVehicle::timeUntilNextAction
+     * Samples a new random vehicle at the given position.
      */
-    virtual void setAction(Action action) override;
-
-    virtual void think(const Neighbours *n) override;
+    static VehicleData create(double x, float lane, RandomStream &random);
 
-    virtual void step(float dt) override;
+    /**
+     * Sets the action and a timeout on VehicleData::timeUntilNextAction
+     */
+    static void setAction(Lane &l, size_t i, Action action, RandomStream &random);
 
-    RandomVehicle(LaneChangeObserver *highway, float x, float lane);
+    static void think(Lane &l, size_t i, const Neighbours &n, VehicleObserver *highway);
 
-    RandomVehicle(const RandomVehicle &orig);
+    /**
+     * Picks a new random action and restarts the timer on VehicleData::timeUntilNextAction.
+     * Called by RandomVehicle::think when the timer runs out, with the vehicle's dice for this step.
+     */
+    static void act(Lane &l, size_t i, RandomStream &dice);
 
-    virtual ~RandomVehicle();
+    static void step(Lane &l, size_t i, float dt);
 
     /**
-     * Override that sets a timeout on RandomVehicle::timeUntilNextAction
+     * Sets the target speed and a timeout on VehicleData::timeUntilNextAction
      */
-    virtual void setTargetSpeed(float targetSpeed) override;
+    static void setTargetSpeed(Lane &l, size_t i, float targetSpeed, RandomStream &random);
     /**
-     * Override that sets a timeout on RandomVehicle::timeUntilNextAction
+     * Sets the target distance and a timeout on VehicleData::timeUntilNextAction
      */
-    virtual void setTargetDistance(float targetDistance) override;
+    static void setTargetDistance(Lane &l, size_t i, float targetDistance, RandomStream &random);
 
+    static void decideAcceleration(Lane &l, size_t i, const Target &front);
 
-protected:
-
-    /**
-     * Time until the vehicle does another random thing.
-     */
-    float timeUntilNextAction;
+    static bool canChangeLane(const Lane &l, size_t i, const Target &front, const Target &back);
 
-    virtual void decideAcceleration(const Neighbours *n) override;
+protected:
 
     /**
      * Randomly selects an action to perform.
      */
-    void decideAction();
-
-    virtual bool canChangeLane(Target *front, Target *back) override;
+    static void decideAction(Lane &l, size_t i, RandomStream &dice);
 };
 
 
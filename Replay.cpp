@@ -0,0 +1,181 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file Replay.cpp
+ * @brief Plays back a recorded trajectory, see TrajectoryRecorder
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "Replay.h"
+
+/**
+ * How far a vehicle goes in a step at most, in meters, so the view of the step before is a bit wider.
+ */
+const double STEP_SLACK = 50;
+
+Replay::Replay(const std::string &path) :
+        reader(path),
+        recordedDt(reader.dt()),
+        playPosition((double) reader.firstStep()),
+        playSpeed(1),
+        isPaused(false),
+        captures(0) {
+}
+
+void Replay::seek(double step) {
+    playPosition = std::min(std::max(step, (double) firstStep()), (double) lastStep());
+}
+
+void Replay::setSpeed(float speed) {
+    playSpeed = speed;
+}
+
+void Replay::setPaused(bool paused) {
+    if (!paused && playSpeed > 0 && playPosition >= lastStep()) {
+        playPosition = firstStep();
+    } else if (!paused && playSpeed < 0 && playPosition <= firstStep()) {
+        playPosition = lastStep();
+    }
+    isPaused = paused;
+}
+
+void Replay::advance(float seconds) {
+    if (isPaused || recordedDt <= 0) {
+        return;
+    }
+    double position = playPosition + seconds * playSpeed / recordedDt;
+    seek(position);
+    if (position != playPosition) {
+        isPaused = true;
+    }
+}
+
+void Replay::capture(Snapshot &snapshot, double behind, double ahead) {
+    double ring = reader.ringLength();
+    uint64_t before = (uint64_t) std::floor(playPosition);
+    uint64_t after = std::min(before + 1, lastStep());
+    float alpha = after > before ? (float) (playPosition - before) : 1.0f;
+
+    TrajectoryVehicle acc = reader.preferred(after);
+    TrajectoryVehicle accBefore = reader.preferred(before);
+    double from = acc.x - behind, to = acc.x + ahead;
+
+    // Where the vehicles in view were a step before, to move them in between
+    captures++;
+    for (const TrajectoryBand *band: reader.bands(before, from - STEP_SLACK, to + STEP_SLACK)) {
+        uint64_t f = before - band->firstStep;
+        for (uint32_t k = band->frameStart[f]; k < band->frameStart[f + 1]; k++) {
+            VehicleId id = band->id[k];
+            if (id >= previousX.size()) {
+                previousX.resize(id + 1);
+                previousCapture.resize(id + 1, 0);
+            }
+            previousX[id] = band->x[k];
+            previousCapture[id] = captures;
+        }
+    }
+
+    // On a ring, the stretch in view can reach around the seam, once or more
+    int laps = ring > 0 ? (int) std::ceil((to - from) / ring) : 0;
+
+    snapshot.ringLength = ring;
+    snapshot.lanes.resize(reader.lanes());
+    for (LaneSnapshot &s: snapshot.lanes) {
+        s.id.clear();
+        s.x.clear();
+        s.previousX.clear();
+        s.lane.clear();
+        s.length.clear();
+        s.width.clear();
+    }
+
+    // The bands come lane after lane, and in slot order, so each lane comes out sorted
+    const std::vector<const TrajectoryBand *> &bands = reader.bands(after, from, to);
+    for (size_t begin = 0, end; begin < bands.size(); begin = end) {
+        uint32_t laneIndex = bands[begin]->laneIndex;
+        for (end = begin; end < bands.size() && bands[end]->laneIndex == laneIndex; end++) {
+        }
+        LaneSnapshot &s = snapshot.lanes[laneIndex];
+
+        for (int lap = -laps; lap <= laps; lap++) {
+            double shift = lap * ring;
+            for (size_t b = begin; b < end; b++) {
+                const TrajectoryBand &band = *bands[b];
+                uint64_t f = after - band.firstStep;
+                for (uint32_t k = band.frameStart[f]; k < band.frameStart[f + 1]; k++) {
+                    double x = band.x[k] + shift;
+                    if (x < from || x >= to) {
+                        continue;
+                    }
+                    VehicleId id = band.id[k];
+                    double previous = x;
+                    if (id < previousCapture.size() && previousCapture[id] == captures) {
+                        previous = snapshot.unwrap(previousX[id] + shift, x);
+                    }
+                    s.id.push_back(id);
+                    s.x.push_back(x);
+                    s.previousX.push_back(previous);
+                    s.lane.push_back(band.lane[k]);
+                    s.length.push_back(band.length[k]);
+                    s.width.push_back(band.width[k]);
+                }
+            }
+        }
+    }
+
+    VehicleSnapshot &p = snapshot.preferred;
+    p = VehicleSnapshot();
+    p.id = acc.id;
+    p.x = acc.x;
+    p.previousX = snapshot.unwrap(accBefore.x, acc.x);
+    p.lane = acc.lane;
+    p.v = acc.v;
+    p.length = acc.length;
+    p.width = acc.width;
+    snapshot.selected = VehicleSnapshot();
+
+    // Not recorded
+    snapshot.preferredFrontDistance = std::numeric_limits<float>::infinity();
+    snapshot.lastStepAllocations = 0;
+    snapshot.lastSortInversions = 0;
+    snapshot.threads = 0;
+    snapshot.profile = StepProfile();
+
+    snapshot.steps = after;
+    snapshot.droppedSteps = 0;
+    snapshot.dt = 0;
+    snapshot.alpha = alpha;
+    snapshot.taken = std::chrono::steady_clock::now();
+}
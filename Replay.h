@@ -0,0 +1,143 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEC_ACC_CPP_REPLAY_H
+#define LEC_ACC_CPP_REPLAY_H
+
+/**
+ * @file Replay.h
+ * @brief Plays back a recorded trajectory, see TrajectoryRecorder
+ */
+
+#include <string>
+#include <vector>
+#include "Snapshot.h"
+#include "Trajectory.h"
+
+/**
+ * Plays back a trajectory file, without simulating anything.
+ *
+ * The playback position is a fractional step: the vehicles are drawn in between the two recorded steps around it.
+ * It moves at any speed, backwards too, and jumps anywhere: the file is mapped, and only the bands of road
+ * around the preferred vehicle are decoded, for the block of steps being shown (see TrajectoryReader).
+ */
+class Replay {
+public:
+    /**
+     * Opens the file, and stops at its first step. Throws an Error if it can't be read.
+     */
+    explicit Replay(const std::string &path);
+
+    uint32_t lanes() const {
+        return reader.lanes();
+    }
+
+    uint64_t firstStep() const {
+        return reader.firstStep();
+    }
+
+    uint64_t lastStep() const {
+        return reader.lastStep();
+    }
+
+    /**
+     * Length of a recorded step, in seconds.
+     */
+    float dt() const {
+        return recordedDt;
+    }
+
+    /**
+     * The step being shown, with the fraction of the way to the next one.
+     */
+    double position() const {
+        return playPosition;
+    }
+
+    /**
+     * Jumps to that step, or to the nearest one recorded.
+     */
+    void seek(double step);
+
+    /**
+     * Recorded seconds played per second. Negative plays backwards.
+     */
+    float speed() const {
+        return playSpeed;
+    }
+
+    void setSpeed(float speed);
+
+    bool paused() const {
+        return isPaused;
+    }
+
+    /**
+     * Pauses or plays. Playing from the end the replay is heading for starts over from the other end.
+     */
+    void setPaused(bool paused);
+
+    /**
+     * Moves the playback by that much time, at the current speed. Pauses at either end.
+     */
+    void advance(float seconds);
+
+    /**
+     * Copies what's around the preferred vehicle at the current position into a snapshot, like Snapshot::capture.
+     * Snapshot::dt is 0, and Snapshot::alpha is how far between the two recorded steps the position is.
+     * @param behind, ahead The stretch of road to copy, in meters from the preferred vehicle.
+     */
+    void capture(Snapshot &snapshot, double behind, double ahead);
+
+    /**
+     * Bands decoded so far, see TrajectoryReader::bandsDecoded.
+     */
+    uint64_t bandsDecoded() const {
+        return reader.bandsDecoded();
+    }
+
+private:
+    TrajectoryReader reader;
+    float recordedDt;
+    double playPosition;
+    float playSpeed;
+    bool isPaused;
+
+    /**
+     * Where the vehicles were on the recorded step before, indexed by id, and the capture that wrote each.
+     */
+    std::vector<double> previousX;
+    std::vector<uint64_t> previousCapture;
+    uint64_t captures;
+};
+
+#endif
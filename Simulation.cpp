@@ -0,0 +1,159 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file Simulation.cpp
+ * @brief Steps the highway on its own thread, and hands snapshots to the window
+ */
+
+#include <chrono>
+#include "Simulation.h"
+#include "Trace.h"
+
+/**
+ * Stretch of road copied into the snapshots until the window says what it shows, in meters.
+ */
+static const double DEFAULT_VIEW = 2000;
+
+Simulation::Simulation(Highway &highway) :
+        highway(&highway),
+        replay(nullptr),
+        isThreaded(highway.getConfig().simulationThread && !highway.getConfig().perfCounters),
+        clock(1.0f / highway.getConfig().stepRate, highway.getConfig().maxSubsteps),
+        steps(0),
+        stopping(false),
+        viewBehind(DEFAULT_VIEW),
+        viewAhead(DEFAULT_VIEW),
+        postedCount(0) {
+    // Something to draw before the first step
+    stepAndPublish(0);
+    snapshots.update();
+}
+
+Simulation::Simulation(Replay &replay) :
+        highway(nullptr),
+        replay(&replay),
+        isThreaded(false),
+        clock(replay.dt(), 1),
+        steps(0),
+        stopping(false),
+        viewBehind(DEFAULT_VIEW),
+        viewAhead(DEFAULT_VIEW),
+        postedCount(0) {
+    stepAndPublish(0);
+    snapshots.update();
+}
+
+Simulation::~Simulation() {
+    stop();
+}
+
+void Simulation::start() {
+    if (isThreaded && !thread.joinable()) {
+        stopping = false;
+        thread = std::thread(&Simulation::run, this);
+    }
+}
+
+void Simulation::stop() {
+    if (thread.joinable()) {
+        stopping = true;
+        thread.join();
+    }
+}
+
+void Simulation::advance(float frameTime) {
+    if (replay != nullptr) {
+        replay->advance(frameTime);
+        stepAndPublish(0);
+    } else if (!isThreaded) {
+        stepAndPublish(clock.advance(frameTime));
+    }
+}
+
+const Snapshot &Simulation::acquire() {
+    snapshots.update();
+    return snapshots.front();
+}
+
+uint64_t Simulation::post(const HighwayCommand &command) {
+    if (highway == nullptr || !highway->post(command)) {
+        return 0;
+    }
+    return ++postedCount;
+}
+
+void Simulation::setView(double behind, double ahead) {
+    viewBehind = behind;
+    viewAhead = ahead;
+}
+
+void Simulation::run() {
+    Trace::setThreadName("Simulation");
+    std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+
+    while (!stopping) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        int due = clock.advance(std::chrono::duration<float>(now - last).count());
+        last = now;
+        if (due > 0) {
+            stepAndPublish(due);
+        }
+
+        // Sleep until the next step is due
+        float wait = (1 - clock.alpha()) * clock.stepLength();
+        std::this_thread::sleep_for(std::chrono::duration<float>(wait));
+    }
+}
+
+void Simulation::stepAndPublish(int count) {
+    if (replay != nullptr) {
+        ACC_TRACE_SCOPE("Replay::capture");
+        replay->capture(snapshots.back(), viewBehind, viewAhead);
+        snapshots.publish();
+        return;
+    }
+
+    for (int s = 0; s < count; s++) {
+        highway->step(clock.stepLength());
+    }
+    steps += count;
+
+    ACC_TRACE_SCOPE("Snapshot::capture");
+    Snapshot &snapshot = snapshots.back();
+    snapshot.capture(*highway, viewBehind, viewAhead);
+    snapshot.steps = steps;
+    snapshot.droppedSteps = clock.droppedSteps();
+    snapshot.dt = clock.stepLength();
+    snapshot.alpha = clock.alpha();
+    snapshots.publish();
+}
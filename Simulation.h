@@ -0,0 +1,170 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEC_ACC_CPP_SIMULATION_H
+#define LEC_ACC_CPP_SIMULATION_H
+
+/**
+ * @file Simulation.h
+ * @brief Steps the highway on its own thread, and hands snapshots to the window
+ */
+
+#include <atomic>
+#include <thread>
+#include "Highway.h"
+#include "HighwayCommand.h"
+#include "Replay.h"
+#include "Snapshot.h"
+#include "StepClock.h"
+#include "TripleBuffer.h"
+
+/**
+ * Runs the highway at a fixed rate, apart from the window.
+ *
+ * On its own thread, a slow step doesn't drop frames and a slow frame doesn't hold back the simulation.
+ * After every batch of steps the simulation publishes a Snapshot; the window reads the latest one
+ * (see Simulation::acquire), never the highway itself. The user's orders go the other way,
+ * as HighwayCommand values (see Simulation::post), through the highway's lock-free queue.
+ *
+ * Without a thread (HighwayConfig::simulationThread off, or when reading the hardware counters,
+ * which count the whole process), Simulation::advance runs the steps due on the caller's thread instead.
+ * Everything else works the same.
+ *
+ * It can also play back a recording (see Replay) instead of stepping a highway. Then nothing is simulated,
+ * there's no thread, and orders are dropped.
+ */
+class Simulation {
+public:
+    explicit Simulation(Highway &highway);
+
+    explicit Simulation(Replay &replay);
+
+    /**
+     * Stops the thread, if it's running.
+     */
+    ~Simulation();
+
+    Simulation(const Simulation &) = delete;
+
+    Simulation &operator=(const Simulation &) = delete;
+
+    /**
+     * Starts stepping on the simulation thread. Does nothing without one.
+     */
+    void start();
+
+    /**
+     * Waits for the simulation thread to finish its steps, and stops it.
+     */
+    void stop();
+
+    /**
+     * Without a simulation thread, runs the steps due after a frame of the given length,
+     * then publishes a snapshot. Does nothing with one. A replay moves on by that much time.
+     */
+    void advance(float frameTime);
+
+    /**
+     * Moves to the latest snapshot, and returns it. Call it once per frame, from the window's thread.
+     */
+    const Snapshot &acquire();
+
+    /**
+     * The snapshot picked by the last Simulation::acquire. Good until the next one.
+     */
+    const Snapshot &current() const {
+        return snapshots.front();
+    }
+
+    /**
+     * Queues an order from the user, carried out at the start of the next step (see Highway::post).
+     * Call it from the window's thread only.
+     * @return Its number: it's been carried out once Snapshot::commandsExecuted gets there.
+     * 0 if too many orders were waiting, and it was dropped.
+     */
+    uint64_t post(const HighwayCommand &command);
+
+    /**
+     * Sets the stretch of road copied into the snapshots, in meters from the ACC.
+     */
+    void setView(double behind, double ahead);
+
+    bool threaded() const {
+        return isThreaded;
+    }
+
+    /**
+     * The recording played back, or nullptr if a highway is being stepped. Only for the window's thread.
+     */
+    Replay *replaying() const {
+        return replay;
+    }
+
+private:
+    /**
+     * Body of the simulation thread.
+     */
+    void run();
+
+    /**
+     * Runs a number of steps, and publishes a snapshot.
+     */
+    void stepAndPublish(int steps);
+
+    /**
+     * Only one of them is set.
+     */
+    Highway *highway;
+    Replay *replay;
+
+    bool isThreaded;
+
+    StepClock clock;
+
+    uint64_t steps;
+
+    std::thread thread;
+
+    std::atomic<bool> stopping;
+
+    TripleBuffer<Snapshot> snapshots;
+
+    std::atomic<double> viewBehind;
+    std::atomic<double> viewAhead;
+
+    /**
+     * Orders posted so far. Only the window's thread touches it.
+     */
+    uint64_t postedCount;
+};
+
+#endif
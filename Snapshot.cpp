@@ -0,0 +1,117 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file Snapshot.cpp
+ * @brief What the renderer and the UI see of the highway after a step
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "Snapshot.h"
+
+namespace {
+
+void captureVehicle(const Vehicle &v, VehicleSnapshot &s) {
+    if (!v.valid()) {
+        s = VehicleSnapshot();
+        return;
+    }
+    s.id = v.getId();
+    s.x = v.getX();
+    s.previousX = v.getInterpolatedX(0);
+    s.lane = v.getLane();
+    s.v = v.getV();
+    s.targetSpeed = v.getTargetSpeed();
+    s.targetDistance = v.getTargetDistance();
+    s.length = v.getLength();
+    s.width = v.getWidth();
+}
+
+/**
+ * Appends the vehicles of l between from and to, moved by shift.
+ */
+void captureRange(const Lane &l, double from, double to, double shift, LaneSnapshot &s) {
+    size_t i = l.lowerBound(from - shift);
+    for (; i < l.size() && l.x[i] + shift < to; i++) {
+        s.id.push_back(l.id[i]);
+        s.x.push_back(l.x[i] + shift);
+        s.previousX.push_back(l.nextX[i] + shift);
+        s.lane.push_back(l.lane[i]);
+        s.length.push_back(l.length[i]);
+        s.width.push_back(l.width[i]);
+    }
+}
+
+}
+
+void Snapshot::capture(Highway &highway, double behind, double ahead) {
+    Vehicle acc = highway.preferredVehicle();
+    double from = acc.getX() - behind, to = acc.getX() + ahead;
+
+    double ring = highway.ringLength();
+    // On a ring, the stretch in view can reach around the seam, once or more
+    int laps = ring > 0 ? (int) std::ceil((to - from) / ring) : 0;
+
+    lanes.resize(highway.lanes.size());
+    for (size_t l = 0; l < lanes.size(); l++) {
+        LaneSnapshot &s = lanes[l];
+        s.id.clear();
+        s.x.clear();
+        s.previousX.clear();
+        s.lane.clear();
+        s.length.clear();
+        s.width.clear();
+        for (int lap = -laps; lap <= laps; lap++) {
+            captureRange(*highway.lanes[l], from, to, lap * ring, s);
+        }
+    }
+
+    captureVehicle(acc, preferred);
+    captureVehicle(highway.selectedVehicle(), selected);
+
+    ringLength = ring;
+    preferredFrontDistance = highway.preferredVehicleFrontDistance;
+    lastStepAllocations = highway.lastStepAllocations;
+    lastSortInversions = highway.lastSortInversions;
+    vehiclesAdded = highway.vehiclesAdded;
+    vehiclesNotAdded = highway.vehiclesNotAdded;
+    commandsExecuted = highway.commandsExecuted;
+    threads = highway.threads();
+    profile = highway.profile;
+    taken = std::chrono::steady_clock::now();
+}
+
+float Snapshot::alphaNow() const {
+    float since = std::chrono::duration<float>(std::chrono::steady_clock::now() - taken).count();
+    return dt > 0 ? std::min(1.0f, alpha + since / dt) : alpha;
+}
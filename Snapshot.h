@@ -0,0 +1,165 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEC_ACC_CPP_SNAPSHOT_H
+#define LEC_ACC_CPP_SNAPSHOT_H
+
+/**
+ * @file Snapshot.h
+ * @brief What the renderer and the UI see of the highway after a step
+ */
+
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include "Highway.h"
+#include "StepProfile.h"
+
+/**
+ * The vehicles of one lane that are in view, sorted by their X coordinate.
+ * On a ring road, positions are already moved by a lap where needed, so they line up with the ACC.
+ */
+struct LaneSnapshot {
+    std::vector<VehicleId> id;
+    std::vector<double> x;
+
+    /**
+     * Position at the start of the last step, see Lane::nextX.
+     */
+    std::vector<double> previousX;
+    std::vector<float> lane;
+    std::vector<float> length;
+    std::vector<float> width;
+
+    size_t size() const {
+        return x.size();
+    }
+
+    /**
+     * Position of the vehicle in slot i, a fraction alpha of the way through the last step.
+     */
+    double interpolatedX(size_t i, float alpha) const {
+        return previousX[i] + alpha * (x[i] - previousX[i]);
+    }
+};
+
+/**
+ * What the UI shows about one vehicle.
+ */
+struct VehicleSnapshot {
+    VehicleId id = NO_VEHICLE;
+    double x = 0;
+    double previousX = 0;
+    float lane = 0;
+    float v = 0;
+    float targetSpeed = 0;
+    float targetDistance = 0;
+    float length = 0;
+    float width = 0;
+
+    double interpolatedX(float alpha) const {
+        return previousX + alpha * (x - previousX);
+    }
+};
+
+/**
+ * A copy of the highway after a step, taken by the simulation and read by the window.
+ *
+ * Only the vehicles around the ACC that could be on screen are copied, so it's cheap
+ * even on a huge highway. The copies keep their capacity, and stop allocating after a while.
+ */
+struct Snapshot {
+    std::vector<LaneSnapshot> lanes;
+
+    VehicleSnapshot preferred;
+
+    /**
+     * The vehicle selected by the user; its id is NO_VEHICLE if there's none.
+     */
+    VehicleSnapshot selected;
+
+    /**
+     * Length of the ring road, or 0 if the road is straight. See Highway::ringLength.
+     */
+    double ringLength = 0;
+
+    float preferredFrontDistance = 0;
+    uint64_t lastStepAllocations = 0;
+    size_t lastSortInversions = 0;
+    uint32_t vehiclesAdded = 0;
+    uint32_t vehiclesNotAdded = 0;
+    unsigned threads = 0;
+    StepProfile profile;
+
+    /**
+     * Steps run so far, and dropped because the simulation couldn't keep up.
+     */
+    uint64_t steps = 0;
+    uint64_t droppedSteps = 0;
+
+    /**
+     * Orders from the user carried out so far, see Simulation::post.
+     */
+    uint64_t commandsExecuted = 0;
+
+    /**
+     * Length of a step, in seconds. 0 for a snapshot of a Replay, which holds still until the next one.
+     */
+    float dt = 0;
+
+    /**
+     * How far into the next step the simulation clock was when the snapshot was taken, from 0 to 1.
+     */
+    float alpha = 0;
+
+    std::chrono::steady_clock::time_point taken;
+
+    /**
+     * Copies the highway.
+     * @param behind, ahead The stretch of road to copy, in meters from the ACC.
+     */
+    void capture(Highway &highway, double behind, double ahead);
+
+    /**
+     * How far into the next step the simulation is by now, from 0 to 1, to interpolate with.
+     */
+    float alphaNow() const;
+
+    /**
+     * The position on the ring closest to around, like Highway::unwrap.
+     */
+    double unwrap(double X, double around) const {
+        return ringLength > 0 ? X + std::round((around - X) / ringLength) * ringLength : X;
+    }
+};
+
+#endif
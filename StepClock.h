@@ -0,0 +1,94 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEC_ACC_CPP_STEPCLOCK_H
+#define LEC_ACC_CPP_STEPCLOCK_H
+
+/**
+ * @file StepClock.h
+ * @brief Turns the time between frames into a whole number of fixed steps
+ */
+
+#include <cstdint>
+
+/**
+ * Runs the simulation at a fixed rate, whatever the frame rate.
+ *
+ * The time of every frame goes into an accumulator, and comes out as fixed steps of StepClock::dt.
+ * What's left, less than a step, is carried over to the next frame; StepClock::alpha tells the renderer
+ * how far into the next step that is, so it can draw in between the last two states.
+ * A frame never runs more than a given number of steps: after a stall, the simulation falls behind
+ * instead of taking ever longer frames to catch up.
+ */
+class StepClock {
+public:
+    /**
+     * @param dt Length of a step, in seconds.
+     * @param maxSteps Most steps run in one frame.
+     */
+    StepClock(float dt, int maxSteps);
+
+    /**
+     * Adds the time of a frame.
+     * @return The number of steps to run now.
+     */
+    int advance(float frameTime);
+
+    /**
+     * How far the time carried over is into the next step, from 0 to 1.
+     */
+    float alpha() const {
+        return (float) (accumulator / dt);
+    }
+
+    /**
+     * Length of a step, in seconds.
+     */
+    float stepLength() const {
+        return (float) dt;
+    }
+
+    /**
+     * Steps dropped so far, because a frame would have run more than the limit.
+     */
+    uint64_t droppedSteps() const {
+        return dropped;
+    }
+
+private:
+    double dt;
+    int maxSteps;
+    double accumulator;
+    uint64_t dropped;
+};
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file StepProfile.cpp
+ * @brief Time spent in each phase of Highway::step
+ */
+
+#include <algorithm>
+#include "StepProfile.h"
+
+// std::min takes it by reference, so it needs a definition
+const size_t StepProfile::WINDOW;
+
+const char *StepProfile::name(StepPhase phase) {
+    switch (phase) {
+        case StepPhase::teleport:
+            return "Teleport";
+        case StepPhase::sort:
+            return "Sort";
+        case StepPhase::collisions:
+            return "Collision test";
+        case StepPhase::neighbours:
+            return "Neighbours";
+        case StepPhase::think:
+            return "Think";
+        case StepPhase::integrate:
+            return "Integrate";
+        case StepPhase::commit:
+            return "Lane change commit";
+        case StepPhase::record:
+            return "Record";
+        default:
+            return "?";
+    }
+}
+
+void StepProfile::beginStep() {
+    std::fill(currentNs, currentNs + STEP_PHASE_COUNT, 0);
+}
+
+void StepProfile::endStep() {
+    for (size_t p = 0; p < STEP_PHASE_COUNT; p++) {
+        history[p][next] = currentNs[p] / 1e6f;
+    }
+    next = (next + 1) % WINDOW;
+    count = std::min(count + 1, WINDOW);
+}
+
+float StepProfile::last(StepPhase phase) const {
+    if (count == 0) {
+        return 0;
+    }
+    return history[(size_t) phase][(next + WINDOW - 1) % WINDOW];
+}
+
+float StepProfile::mean(StepPhase phase) const {
+    if (count == 0) {
+        return 0;
+    }
+    // Slots past count are still 0
+    const float *h = history[(size_t) phase];
+    float sum = 0;
+    for (size_t i = 0; i < WINDOW; i++) {
+        sum += h[i];
+    }
+    return sum / count;
+}
+
+float StepProfile::p99(StepPhase phase) const {
+    if (count == 0) {
+        return 0;
+    }
+    // The oldest step sits at next once the window is full, and at 0 before that
+    size_t first = count == WINDOW ? next : 0;
+    for (size_t i = 0; i < count; i++) {
+        scratch[i] = history[(size_t) phase][(first + i) % WINDOW];
+    }
+    size_t k = (count * 99) / 100;
+    std::nth_element(scratch, scratch + k, scratch + count);
+    return scratch[k];
+}
+
+const float *StepProfile::totals() const {
+    size_t first = count == WINDOW ? next : 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t slot = (first + i) % WINDOW;
+        float total = 0;
+        for (size_t p = 0; p < STEP_PHASE_COUNT; p++) {
+            total += history[p][slot];
+        }
+        scratch[i] = total;
+    }
+    return scratch;
+}
@@ -0,0 +1,177 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEC_ACC_CPP_STEPPROFILE_H
+#define LEC_ACC_CPP_STEPPROFILE_H
+
+/**
+ * @file StepProfile.h
+ * @brief Time spent in each phase of Highway::step
+ */
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * The phases of Highway::step, in the order they run.
+ */
+enum class StepPhase : uint8_t {
+    teleport,
+    sort,
+    collisions,
+    neighbours,
+    think,
+    integrate,
+    commit,
+    record,
+    count
+};
+
+const size_t STEP_PHASE_COUNT = (size_t) StepPhase::count;
+
+/**
+ * Rolling statistics on the time spent in each phase of the last steps.
+ *
+ * Highway::step fills this in only when built with ACC_PROFILE_STEP defined; otherwise the timers
+ * compile to nothing and all the times read 0.
+ * The neighbours, think and integrate phases run on every thread at once: their times are summed
+ * over the threads.
+ */
+class StepProfile {
+public:
+    /**
+     * Number of steps the statistics are taken over.
+     */
+    static const size_t WINDOW = 240;
+
+    /**
+     * Display name of a phase.
+     */
+    static const char *name(StepPhase phase);
+
+    /**
+     * Clears the times of the step about to run.
+     */
+    void beginStep();
+
+    /**
+     * Where the time spent in a phase of the current step adds up, in nanoseconds.
+     */
+    uint64_t &current(StepPhase phase) {
+        return currentNs[(size_t) phase];
+    }
+
+    /**
+     * Moves the times of the current step into the window.
+     */
+    void endStep();
+
+    /**
+     * Number of steps in the window.
+     */
+    size_t size() const {
+        return count;
+    }
+
+    /**
+     * Time spent in the phase in the last step, in milliseconds.
+     */
+    float last(StepPhase phase) const;
+
+    /**
+     * Mean time spent in the phase over the window, in milliseconds.
+     */
+    float mean(StepPhase phase) const;
+
+    /**
+     * 99th percentile of the time spent in the phase over the window, in milliseconds.
+     */
+    float p99(StepPhase phase) const;
+
+    /**
+     * Total time of the last steps, oldest first, in milliseconds. StepProfile::size() values.
+     */
+    const float *totals() const;
+
+private:
+    uint64_t currentNs[STEP_PHASE_COUNT] = {};
+
+    /**
+     * Milliseconds per phase and step, a ring buffer.
+     */
+    float history[STEP_PHASE_COUNT][WINDOW] = {};
+
+    /**
+     * Slot of the next step in StepProfile::history.
+     */
+    size_t next = 0;
+
+    size_t count = 0;
+
+    /**
+     * Scratch space for StepProfile::totals and StepProfile::p99.
+     */
+    mutable float scratch[WINDOW];
+};
+
+/**
+ * Adds the time until the end of the scope to a counter.
+ */
+class ScopedPhaseTimer {
+public:
+    explicit ScopedPhaseTimer(uint64_t &ns) : ns(ns), start(std::chrono::steady_clock::now()) {
+    }
+
+    ~ScopedPhaseTimer() {
+        ns += (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    uint64_t &ns;
+    std::chrono::steady_clock::time_point start;
+};
+
+#define ACC_PROFILE_CONCAT2(a, b) a##b
+#define ACC_PROFILE_CONCAT(a, b) ACC_PROFILE_CONCAT2(a, b)
+
+#ifdef ACC_PROFILE_STEP
+/**
+ * Adds the time until the end of the scope to the given counter. Nothing, unless ACC_PROFILE_STEP is defined.
+ */
+#define ACC_PROFILE_SCOPE(ns) ScopedPhaseTimer ACC_PROFILE_CONCAT(phaseTimer, __LINE__)(ns)
+#else
+#define ACC_PROFILE_SCOPE(ns) do { } while (0)
+#endif
+
+#endif
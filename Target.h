@@ -48,9 +48,6 @@ struct Target {
     Target() : vRel(0), dist(0) { }
 
     Target(float vRel, float dist) : vRel(vRel), dist(dist) { }
-
-    Target(const Target &o) : vRel(o.vRel), dist(o.dist) {
-    }
 };
 
 
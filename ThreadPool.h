@@ -0,0 +1,141 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEC_ACC_CPP_THREADPOOL_H
+#define LEC_ACC_CPP_THREADPOOL_H
+
+/**
+ * @file ThreadPool.h
+ * @brief Fixed set of worker threads for the parallel parts of the simulation
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads that split a batch of tasks between them.
+ *
+ * ThreadPool::run returns once every task of the batch is done, so consecutive
+ * calls act like phases separated by a barrier. The calling thread works too.
+ */
+class ThreadPool {
+public:
+    /**
+     * @param threads Total number of threads, the caller included. 0 uses every core.
+     */
+    explicit ThreadPool(unsigned threads);
+
+    ThreadPool(const ThreadPool &orig) = delete;
+
+    virtual ~ThreadPool();
+
+    /**
+     * Number of threads working on a batch, the caller included.
+     */
+    unsigned size() const {
+        return (unsigned) workers.size() + 1;
+    }
+
+    /**
+     * Calls f(task) for every task in [0, tasks), spread over the threads.
+     * Blocks until all of them are done. If any of them throws, the first exception
+     * is thrown again from here.
+     * Doesn't allocate: f is passed by reference and must outlive the call.
+     */
+    template<typename F>
+    void run(size_t tasks, F &f) {
+        runBatch(tasks, &call<F>, &f);
+    }
+
+private:
+    typedef void (*TaskFunction)(void *context, size_t task);
+
+    template<typename F>
+    static void call(void *f, size_t task) {
+        (*static_cast<F *>(f))(task);
+    }
+
+    void runBatch(size_t tasks, TaskFunction function, void *context);
+
+    /**
+     * Worker thread main loop.
+     */
+    void work();
+
+    /**
+     * Takes tasks from the current batch until there are none left.
+     */
+    void drain();
+
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+
+    /**
+     * The current batch. Only changed while no worker is draining it.
+     */
+    TaskFunction function = nullptr;
+    void *context = nullptr;
+    size_t tasks = 0;
+
+    /**
+     * Next task to hand out.
+     */
+    std::atomic<size_t> next;
+
+    /**
+     * Bumped for every batch, so the workers know there's work.
+     */
+    uint64_t generation = 0;
+
+    /**
+     * Workers done with the current batch.
+     */
+    size_t checkedIn = 0;
+
+    bool stopping = false;
+
+    /**
+     * First exception thrown by a task of the current batch.
+     */
+    std::exception_ptr error;
+};
+
+#endif
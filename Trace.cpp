@@ -0,0 +1,185 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file Trace.cpp
+ * @brief Timeline of frames and simulation phases, in the Chrome trace format
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <vector>
+#include "Trace.h"
+
+/**
+ * Events kept per thread. A power of two.
+ */
+static const uint64_t EVENTS_PER_THREAD = 1 << 17;
+
+/**
+ * The events of one thread. Written only by that thread, read by Trace::flush.
+ */
+struct TraceBuffer {
+    std::vector<TraceEvent> events;
+
+    /**
+     * Number of events ever written. The last one is at (written - 1) % EVENTS_PER_THREAD.
+     */
+    std::atomic<uint64_t> written;
+
+    int thread;
+    const char *name;
+
+    TraceBuffer(int thread, const char *name) : events(EVENTS_PER_THREAD), written(0), thread(thread), name(name) {
+    }
+
+    void push(const TraceEvent &e) {
+        uint64_t i = written.load(std::memory_order_relaxed);
+        events[i & (EVENTS_PER_THREAD - 1)] = e;
+        written.store(i + 1, std::memory_order_release);
+    }
+};
+
+std::atomic<bool> Trace::on(false);
+
+static std::string tracePath;
+static std::chrono::steady_clock::time_point traceStart;
+
+/**
+ * Every buffer ever made. Only locked when a thread records its first event, and to flush.
+ * The buffers outlive their threads, so the workers' events can be written after they're gone.
+ */
+static std::mutex buffersMutex;
+static std::vector<TraceBuffer *> buffers;
+
+static thread_local TraceBuffer *threadBuffer = nullptr;
+static thread_local const char *threadName = nullptr;
+
+static TraceBuffer &buffer() {
+    if (threadBuffer == nullptr) {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        threadBuffer = new TraceBuffer((int) buffers.size() + 1, threadName);
+        buffers.push_back(threadBuffer);
+    }
+    return *threadBuffer;
+}
+
+static void flushAtExit() {
+    Trace::flush();
+}
+
+void Trace::enable(const std::string &path) {
+    if (enabled()) {
+        return;
+    }
+    tracePath = path;
+    traceStart = std::chrono::steady_clock::now();
+    std::atexit(flushAtExit);
+    on.store(true);
+}
+
+void Trace::setThreadName(const char *name) {
+    threadName = name;
+    if (threadBuffer != nullptr) {
+        threadBuffer->name = name;
+    }
+}
+
+uint64_t Trace::now() {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - traceStart).count();
+}
+
+void Trace::span(const char *name, uint64_t start, uint64_t end) {
+    TraceEvent e;
+    e.name = name;
+    e.start = start;
+    e.duration = end - start;
+    e.value = -1;
+    buffer().push(e);
+}
+
+void Trace::counter(const char *name, int64_t value) {
+    if (!enabled()) {
+        return;
+    }
+    TraceEvent e;
+    e.name = name;
+    e.start = now();
+    e.duration = 0;
+    e.value = value;
+    buffer().push(e);
+}
+
+void Trace::flush() {
+    if (!enabled()) {
+        return;
+    }
+
+    std::ofstream out(tracePath.c_str());
+    if (!out) {
+        std::cerr << "Can't write trace to " << tracePath << std::endl;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    out.setf(std::ios::fixed);
+    out.precision(3);
+
+    bool first = true;
+    for (TraceBuffer *b: buffers) {
+        if (!first) {
+            out << ",\n";
+        }
+        first = false;
+        out << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": " << b->thread
+            << ", \"args\": {\"name\": \"" << (b->name ? b->name : "thread") << " " << b->thread << "\"}}";
+
+        uint64_t written = b->written.load(std::memory_order_acquire);
+        uint64_t begin = written > EVENTS_PER_THREAD ? written - EVENTS_PER_THREAD : 0;
+        for (uint64_t i = begin; i < written; i++) {
+            const TraceEvent &e = b->events[i & (EVENTS_PER_THREAD - 1)];
+            out << ",\n";
+            if (e.value < 0) {
+                out << "{\"ph\": \"X\", \"name\": \"" << e.name << "\", \"pid\": 1, \"tid\": " << b->thread
+                    << ", \"ts\": " << e.start / 1e3 << ", \"dur\": " << e.duration / 1e3 << "}";
+            } else {
+                out << "{\"ph\": \"C\", \"name\": \"" << e.name << "\", \"pid\": 1, \"tid\": " << b->thread
+                    << ", \"ts\": " << e.start / 1e3 << ", \"args\": {\"value\": " << e.value << "}}";
+            }
+        }
+    }
+    out << "\n]}\n";
+}
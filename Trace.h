@@ -0,0 +1,145 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEC_ACC_CPP_TRACE_H
+#define LEC_ACC_CPP_TRACE_H
+
+/**
+ * @file Trace.h
+ * @brief Timeline of frames and simulation phases, in the Chrome trace format
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "StepProfile.h"
+
+/**
+ * One entry on the timeline: a span of time, or the value of a counter.
+ */
+struct TraceEvent {
+    /**
+     * Must outlive the trace: a string literal.
+     */
+    const char *name;
+
+    /**
+     * Nanoseconds since the trace started.
+     */
+    uint64_t start;
+
+    /**
+     * Length of the span, in nanoseconds. Unused for counters.
+     */
+    uint64_t duration;
+
+    /**
+     * Value of a counter, or -1 for a span.
+     */
+    int64_t value;
+};
+
+/**
+ * Records what the threads are doing, to look at in chrome://tracing or Perfetto.
+ *
+ * Every thread writes to its own ring buffer, without locks; once a buffer is full,
+ * the oldest events are overwritten. Trace::flush writes all of them to a JSON file,
+ * which happens by itself when the program exits.
+ * Costs a branch per span while off.
+ */
+class Trace {
+public:
+    /**
+     * Starts recording, to be written to the given file.
+     */
+    static void enable(const std::string &path);
+
+    static bool enabled() {
+        return on.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Names the calling thread on the timeline. Keeps the pointer: pass a string literal.
+     */
+    static void setThreadName(const char *name);
+
+    /**
+     * Nanoseconds since the trace started.
+     */
+    static uint64_t now();
+
+    /**
+     * Records a span on the calling thread.
+     */
+    static void span(const char *name, uint64_t start, uint64_t end);
+
+    /**
+     * Records the value of a counter, shown as a graph above the threads.
+     */
+    static void counter(const char *name, int64_t value);
+
+    /**
+     * Writes everything recorded so far. Call it while the other threads are idle.
+     */
+    static void flush();
+
+private:
+    static std::atomic<bool> on;
+};
+
+/**
+ * Records the time until the end of the scope as a span on the timeline.
+ */
+class ScopedTrace {
+public:
+    explicit ScopedTrace(const char *name) : name(name), on(Trace::enabled()) {
+        if (on) {
+            start = Trace::now();
+        }
+    }
+
+    ~ScopedTrace() {
+        if (on) {
+            Trace::span(name, start, Trace::now());
+        }
+    }
+
+private:
+    const char *name;
+    bool on;
+    uint64_t start = 0;
+};
+
+#define ACC_TRACE_SCOPE(name) ScopedTrace ACC_PROFILE_CONCAT(traceScope, __LINE__)(name)
+
+#endif
@@ -0,0 +1,703 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file Trajectory.cpp
+ * @brief Compressed recordings of every vehicle on every step
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ByteOrder.h"
+#include "Error.h"
+#include "Highway.h"
+#include "Trajectory.h"
+
+/**
+ * Starts a trajectory file.
+ */
+static const char FILE_MAGIC[8] = {'A', 'C', 'C', 'T', 'R', 'A', 'C', 'K'};
+
+/**
+ * Ends a trajectory file that was closed properly, after the index.
+ */
+static const char INDEX_MAGIC[8] = {'A', 'C', 'C', 'I', 'N', 'D', 'E', 'X'};
+
+/**
+ * Bumped whenever the layout of the file changes.
+ */
+const uint32_t TRAJECTORY_VERSION = 2;
+
+/**
+ * Start the track of the preferred vehicle of a block, and the bands.
+ */
+static const char BLOCK_TAG[4] = {'B', 'L', 'C', 'K'};
+static const char BAND_TAG[4] = {'B', 'A', 'N', 'D'};
+
+/**
+ * Bytes of the file header, of a block header, of a vehicle in the track, and of a band header.
+ */
+const size_t FILE_HEADER_SIZE = 24;
+const size_t BLOCK_HEADER_SIZE = 28;
+const size_t TRACK_ROW_SIZE = 32;
+const size_t BAND_HEADER_SIZE = 76;
+
+/**
+ * Bytes of an entry of the index, for a block and for a band, and after the entries.
+ */
+const size_t BLOCK_ENTRY_SIZE = 24;
+const size_t BAND_ENTRY_SIZE = 32;
+const size_t INDEX_FOOTER_SIZE = 32;
+
+/**
+ * Fixed point steps of the lanes, positions, speeds, accelerations and sizes:
+ * 1/1000 of a lane, 1 mm, 1 mm/s, 1 mm/s^2.
+ */
+const double TRAJECTORY_SCALE = 1000;
+
+/**
+ * Ids are reused, so they stay below the most vehicles a highway holds at once, with room for the ones added by hand.
+ * Anything larger comes from a damaged file.
+ */
+const int64_t MAX_TRAJECTORY_ID = 2 * (int64_t) HighwayConfig::MAX_LANES * HighwayConfig::MAX_VEHICLES_PER_LANE;
+
+/**
+ * Decoded bands kept by a reader, as long as they aren't all in use.
+ */
+const size_t CACHED_BANDS = 64;
+
+namespace {
+
+template<typename T>
+void put(std::vector<char> &out, const T &value) {
+    const char *bytes = reinterpret_cast<const char *>(&value);
+    size_t start = out.size();
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+    ByteOrder::convert(out.data() + start, sizeof(T), 1);
+}
+
+template<typename T>
+T get(const char *in) {
+    T value;
+    std::memcpy(&value, in, sizeof(T));
+    ByteOrder::convert(&value, sizeof(T), 1);
+    return value;
+}
+
+/**
+ * Most bytes putDelta writes.
+ */
+const size_t MAX_DELTA_SIZE = 10;
+
+/**
+ * Writes the difference between a value and its guess, zigzagged so small negative numbers stay small,
+ * seven bits per byte. There must be room for MAX_DELTA_SIZE bytes.
+ * @return The end of what was written.
+ */
+char *putDelta(char *out, int64_t value, int64_t guess) {
+    int64_t delta = (int64_t) ((uint64_t) value - (uint64_t) guess);
+    uint64_t n = ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63);
+    while (n >= 0x80) {
+        *out++ = (char) (n | 0x80);
+        n >>= 7;
+    }
+    *out++ = (char) n;
+    return out;
+}
+
+/**
+ * Reads a column written by putDelta, and throws if it ends too soon.
+ */
+struct ColumnReader {
+    const char *in;
+    const char *end;
+
+    int64_t getDelta(int64_t guess) {
+        uint64_t n = 0;
+        for (int shift = 0;; shift += 7) {
+            if (in == end || shift > 63) {
+                throw Error("Damaged trajectory band");
+            }
+            unsigned char byte = (unsigned char) *in++;
+            n |= (uint64_t) (byte & 0x7f) << shift;
+            if (byte < 0x80) {
+                break;
+            }
+        }
+        int64_t delta = (int64_t) (n >> 1) ^ -(int64_t) (n & 1);
+        return (int64_t) ((uint64_t) guess + (uint64_t) delta);
+    }
+};
+
+/**
+ * Rounds to the nearest fixed point step, halves away from zero, like std::llround, without the call.
+ */
+int64_t fixed(double value) {
+    double scaled = value * TRAJECTORY_SCALE;
+    return (int64_t) (scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+}
+
+TrajectoryHistory &historyOf(std::vector<TrajectoryHistory> &history, VehicleId id) {
+    if (id >= history.size()) {
+        TrajectoryHistory none = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+        history.resize(id + 1, none);
+    }
+    return history[id];
+}
+
+}
+
+void TrajectoryFrame::capture(const Highway &highway, float dt) {
+    clear();
+    step = highway.stepsTaken;
+    this->dt = dt;
+    preferred = highway.preferredVehicleId;
+    for (const Lane *l: highway.lanes) {
+        laneStart.push_back((uint32_t) id.size());
+        id.insert(id.end(), l->id.begin(), l->id.end());
+        lane.insert(lane.end(), l->lane.begin(), l->lane.end());
+        x.insert(x.end(), l->x.begin(), l->x.end());
+        v.insert(v.end(), l->v.begin(), l->v.end());
+        a.insert(a.end(), l->a.begin(), l->a.end());
+        length.insert(length.end(), l->length.begin(), l->length.end());
+        width.insert(width.end(), l->width.begin(), l->width.end());
+    }
+    laneStart.push_back((uint32_t) id.size());
+}
+
+void TrajectoryFrame::clear() {
+    laneStart.clear();
+    id.clear();
+    lane.clear();
+    x.clear();
+    v.clear();
+    a.clear();
+    length.clear();
+    width.clear();
+}
+
+void TrajectoryBand::clear() {
+    frameStart.clear();
+    id.clear();
+    lane.clear();
+    x.clear();
+    v.clear();
+    a.clear();
+    length.clear();
+    width.clear();
+}
+
+TrajectoryEncoder::TrajectoryEncoder() :
+        firstStep(0), dt(0), preferred(NO_VEHICLE), frameCount(0), bandNumber(0) {
+}
+
+void TrajectoryEncoder::header(std::vector<char> &out, uint32_t lanes, double ringLength) {
+    out.insert(out.end(), FILE_MAGIC, FILE_MAGIC + sizeof(FILE_MAGIC));
+    put(out, TRAJECTORY_VERSION);
+    put(out, lanes);
+    put(out, ringLength);
+}
+
+void TrajectoryEncoder::index(std::vector<char> &out, const std::vector<TrajectoryBlockEntry> &blocks,
+                              const std::vector<TrajectoryBandEntry> &bands, uint64_t offset) {
+    for (const TrajectoryBlockEntry &block: blocks) {
+        put(out, block.firstStep);
+        put(out, block.frames);
+        put(out, block.bandCount);
+        put(out, block.offset);
+    }
+    for (const TrajectoryBandEntry &band: bands) {
+        put(out, band.lane);
+        put(out, band.band);
+        put(out, band.minX);
+        put(out, band.maxX);
+        put(out, band.offset);
+    }
+    put(out, (uint64_t) blocks.size());
+    put(out, (uint64_t) bands.size());
+    put(out, offset);
+    out.insert(out.end(), INDEX_MAGIC, INDEX_MAGIC + sizeof(INDEX_MAGIC));
+}
+
+void TrajectoryEncoder::startBand(Band &band) {
+    band.number = ++bandNumber;
+    band.minX = std::numeric_limits<double>::infinity();
+    band.maxX = -std::numeric_limits<double>::infinity();
+    band.lastIds.clear();
+    for (std::vector<char> &column: band.columns) {
+        column.clear();
+    }
+    // Empty in the frames before it was needed
+    char none[MAX_DELTA_SIZE];
+    for (uint32_t f = 0; f < frameCount; f++) {
+        char *end = putDelta(none, 0, 0);
+        band.columns[COUNT].insert(band.columns[COUNT].end(), none, end);
+    }
+}
+
+void TrajectoryEncoder::add(const TrajectoryFrame &frame) {
+    if (frameCount == 0) {
+        firstStep = frame.step;
+        dt = frame.dt;
+        preferred = frame.preferred;
+        track.clear();
+        bandsUsed.assign(bandsUsed.size(), 0);
+    }
+
+    size_t lanes = frame.laneStart.empty() ? 0 : frame.laneStart.size() - 1;
+    if (bands.size() < lanes) {
+        bands.resize(lanes);
+        bandsUsed.resize(lanes, 0);
+    }
+    for (size_t l = 0; l < lanes; l++) {
+        size_t begin = frame.laneStart[l], end = frame.laneStart[l + 1];
+        size_t needed = (end - begin + TRAJECTORY_BAND_ROWS - 1) / TRAJECTORY_BAND_ROWS;
+        if (bands[l].size() < needed) {
+            bands[l].resize(needed);
+        }
+        while (bandsUsed[l] < needed) {
+            startBand(bands[l][bandsUsed[l]++]);
+        }
+        for (size_t b = 0; b < bandsUsed[l]; b++) {
+            size_t from = std::min(end, begin + b * TRAJECTORY_BAND_ROWS);
+            size_t to = std::min(end, from + TRAJECTORY_BAND_ROWS);
+            addRows(bands[l][b], frame, from, to);
+        }
+    }
+
+    // The preferred vehicle, to point the camera before decoding anything
+    TrajectoryVehicle acc;
+    for (size_t r = 0; r < frame.size(); r++) {
+        if (frame.id[r] == preferred) {
+            acc.id = frame.id[r];
+            acc.lane = frame.lane[r];
+            acc.x = frame.x[r];
+            acc.v = frame.v[r];
+            acc.a = frame.a[r];
+            acc.length = frame.length[r];
+            acc.width = frame.width[r];
+            break;
+        }
+    }
+    put(track, acc.id);
+    put(track, acc.lane);
+    put(track, acc.x);
+    put(track, acc.v);
+    put(track, acc.a);
+    put(track, acc.length);
+    put(track, acc.width);
+
+    frameCount++;
+}
+
+void TrajectoryEncoder::addRows(Band &band, const TrajectoryFrame &frame, size_t begin, size_t end) {
+    size_t n = end - begin;
+    // Room for the longest deltas, cut back to what was written below
+    char *out[COLUMN_COUNT];
+    for (int c = 0; c < COLUMN_COUNT; c++) {
+        std::vector<char> &column = band.columns[c];
+        size_t used = column.size();
+        column.resize(used + (c == COUNT ? 1 : n) * MAX_DELTA_SIZE);
+        out[c] = column.data() + used;
+    }
+
+    out[COUNT] = putDelta(out[COUNT], (int64_t) n, 0);
+    for (size_t r = 0; r < n; r++) {
+        size_t row = begin + r;
+        VehicleId id = frame.id[row];
+        out[ID] = putDelta(out[ID], id, r < band.lastIds.size() ? band.lastIds[r] : 0);
+
+        TrajectoryHistory &h = historyOf(history, id);
+        int64_t lane = fixed(frame.lane[row]);
+        int64_t x = fixed(frame.x[row]);
+        int64_t v = fixed(frame.v[row]);
+        int64_t a = fixed(frame.a[row]);
+        int64_t length = fixed(frame.length[row]);
+        int64_t width = fixed(frame.width[row]);
+
+        // Guess from the last frame only if the vehicle was in this band then, and it's still the same vehicle.
+        // The lanes carry the choice in their lowest bit, so the decoder doesn't have to work it out.
+        bool fresh = h.band != band.number || h.frame + 1 != frameCount || h.seen == 0
+                     || h.length != length || h.width != width;
+        uint32_t seen = fresh ? 0 : h.seen;
+        out[LANE] = putDelta(out[LANE], 2 * (lane - (seen > 0 ? h.lane : 0)) + (fresh ? 1 : 0), 0);
+        out[X] = putDelta(out[X], x, seen == 0 ? 0 : h.x + h.move);
+        out[V] = putDelta(out[V], v, seen > 0 ? h.v : 0);
+        out[A] = putDelta(out[A], a, seen > 0 ? h.a : 0);
+        if (fresh) {
+            out[LENGTH] = putDelta(out[LENGTH], length, 0);
+            out[WIDTH] = putDelta(out[WIDTH], width, 0);
+        }
+
+        h.band = band.number;
+        h.frame = frameCount;
+        h.move = seen > 0 ? x - h.x : 0;
+        h.lane = lane;
+        h.x = x;
+        h.v = v;
+        h.a = a;
+        h.length = length;
+        h.width = width;
+        h.seen = std::min(seen + 1, 2u);
+
+        band.minX = std::min(band.minX, frame.x[row]);
+        band.maxX = std::max(band.maxX, frame.x[row]);
+    }
+
+    for (int c = 0; c < COLUMN_COUNT; c++) {
+        band.columns[c].resize(out[c] - band.columns[c].data());
+    }
+    band.lastIds.assign(frame.id.begin() + begin, frame.id.begin() + end);
+}
+
+void TrajectoryEncoder::finish(std::vector<char> &out, uint64_t offset, std::vector<TrajectoryBlockEntry> &blocks,
+                               std::vector<TrajectoryBandEntry> &bandEntries) {
+    TrajectoryBlockEntry block;
+    block.firstStep = firstStep;
+    block.frames = frameCount;
+    block.bandCount = 0;
+    block.offset = offset + out.size();
+
+    out.insert(out.end(), BLOCK_TAG, BLOCK_TAG + sizeof(BLOCK_TAG));
+    put(out, (uint32_t) (BLOCK_HEADER_SIZE + track.size()));
+    put(out, firstStep);
+    put(out, frameCount);
+    put(out, dt);
+    put(out, preferred);
+    out.insert(out.end(), track.begin(), track.end());
+
+    for (size_t l = 0; l < bandsUsed.size(); l++) {
+        for (uint32_t b = 0; b < bandsUsed[l]; b++) {
+            Band &band = bands[l][b];
+            if (band.minX > band.maxX) {
+                // Never had a vehicle
+                continue;
+            }
+            TrajectoryBandEntry entry = {(uint32_t) l, b, band.minX, band.maxX, offset + out.size()};
+            bandEntries.push_back(entry);
+            block.bandCount++;
+
+            size_t payload = BAND_HEADER_SIZE;
+            for (const std::vector<char> &column: band.columns) {
+                payload += column.size();
+            }
+            out.insert(out.end(), BAND_TAG, BAND_TAG + sizeof(BAND_TAG));
+            put(out, (uint32_t) payload);
+            put(out, firstStep);
+            put(out, frameCount);
+            put(out, (uint32_t) l);
+            put(out, b);
+            put(out, band.minX);
+            put(out, band.maxX);
+            for (const std::vector<char> &column: band.columns) {
+                put(out, (uint32_t) column.size());
+            }
+            for (const std::vector<char> &column: band.columns) {
+                out.insert(out.end(), column.begin(), column.end());
+            }
+        }
+    }
+    blocks.push_back(block);
+    frameCount = 0;
+}
+
+TrajectoryReader::TrajectoryReader(const std::string &path) :
+        path(path),
+        data(nullptr),
+        size(0),
+        laneCount(0),
+        ring(0),
+        trackBlock(SIZE_MAX),
+        calls(0),
+        decodeCount(0) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw Error("Can't open trajectory " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        size = (size_t) st.st_size;
+        void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        data = p == MAP_FAILED ? nullptr : static_cast<const char *>(p);
+    }
+    close(fd);
+    if (data == nullptr) {
+        throw Error("Can't map trajectory " + path);
+    }
+
+    try {
+        if (size < FILE_HEADER_SIZE + INDEX_FOOTER_SIZE || std::memcmp(data, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0) {
+            throw Error(path + " isn't a trajectory");
+        }
+        if (get<uint32_t>(data + 8) != TRAJECTORY_VERSION) {
+            throw Error("Trajectory " + path + " was written by another version");
+        }
+        laneCount = get<uint32_t>(data + 12);
+        ring = get<double>(data + 16);
+
+        const char *footer = data + size - INDEX_FOOTER_SIZE;
+        if (std::memcmp(footer + 24, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) {
+            throw Error("Trajectory " + path + " wasn't closed properly");
+        }
+        uint64_t blockCount = get<uint64_t>(footer);
+        uint64_t bandCount = get<uint64_t>(footer + 8);
+        uint64_t indexOffset = get<uint64_t>(footer + 16);
+        if (laneCount == 0 || laneCount > HighwayConfig::MAX_LANES || blockCount == 0
+            || indexOffset < FILE_HEADER_SIZE || blockCount > size || bandCount > size
+            || indexOffset + blockCount * BLOCK_ENTRY_SIZE + bandCount * BAND_ENTRY_SIZE + INDEX_FOOTER_SIZE != size) {
+            throw Error("Trajectory " + path + " is damaged");
+        }
+
+        const char *in = data + indexOffset;
+        uint64_t bandsSoFar = 0;
+        for (uint64_t k = 0; k < blockCount; k++, in += BLOCK_ENTRY_SIZE) {
+            TrajectoryBlockEntry block;
+            block.firstStep = get<uint64_t>(in);
+            block.frames = get<uint32_t>(in + 8);
+            block.bandCount = get<uint32_t>(in + 12);
+            block.offset = get<uint64_t>(in + 16);
+            bool follows = blocks.empty() || blocks.back().firstStep + blocks.back().frames == block.firstStep;
+            if (!follows || block.frames == 0 || block.frames > TRAJECTORY_CHUNK_FRAMES
+                || block.offset + BLOCK_HEADER_SIZE + block.frames * TRACK_ROW_SIZE > indexOffset) {
+                throw Error("Trajectory " + path + " is damaged");
+            }
+            blocks.push_back(block);
+            firstBand.push_back((size_t) bandsSoFar);
+            bandsSoFar += block.bandCount;
+        }
+        for (uint64_t b = 0; b < bandCount; b++, in += BAND_ENTRY_SIZE) {
+            TrajectoryBandEntry band;
+            band.lane = get<uint32_t>(in);
+            band.band = get<uint32_t>(in + 4);
+            band.minX = get<double>(in + 8);
+            band.maxX = get<double>(in + 16);
+            band.offset = get<uint64_t>(in + 24);
+            if (band.lane >= laneCount || band.offset + BAND_HEADER_SIZE > indexOffset) {
+                throw Error("Trajectory " + path + " is damaged");
+            }
+            bandEntries.push_back(band);
+        }
+        if (bandsSoFar != bandCount) {
+            throw Error("Trajectory " + path + " is damaged");
+        }
+    } catch (const Error &) {
+        munmap(const_cast<char *>(data), size);
+        throw;
+    }
+}
+
+TrajectoryReader::~TrajectoryReader() {
+    for (Cached *c: cache) {
+        delete c;
+    }
+    munmap(const_cast<char *>(data), size);
+}
+
+uint64_t TrajectoryReader::firstStep() const {
+    return blocks.front().firstStep;
+}
+
+uint64_t TrajectoryReader::lastStep() const {
+    return blocks.back().firstStep + blocks.back().frames - 1;
+}
+
+float TrajectoryReader::dt() const {
+    return get<float>(data + blocks.front().offset + 20);
+}
+
+size_t TrajectoryReader::blockOf(uint64_t step) const {
+    step = std::min(std::max(step, firstStep()), lastStep());
+    auto after = std::upper_bound(blocks.begin(), blocks.end(), step,
+                                  [](uint64_t s, const TrajectoryBlockEntry &b) {
+                                      return s < b.firstStep;
+                                  });
+    return (size_t) (after - blocks.begin()) - 1;
+}
+
+TrajectoryVehicle TrajectoryReader::preferred(uint64_t step) {
+    size_t k = blockOf(step);
+    const TrajectoryBlockEntry &block = blocks[k];
+    if (trackBlock != k) {
+        const char *in = data + block.offset;
+        if (std::memcmp(in, BLOCK_TAG, sizeof(BLOCK_TAG)) != 0 || get<uint32_t>(in + 16) != block.frames) {
+            throw Error("Trajectory " + path + " is damaged");
+        }
+        in += BLOCK_HEADER_SIZE;
+        track.resize(block.frames);
+        for (TrajectoryVehicle &acc: track) {
+            acc.id = get<VehicleId>(in);
+            acc.lane = get<float>(in + 4);
+            acc.x = get<double>(in + 8);
+            acc.v = get<float>(in + 16);
+            acc.a = get<float>(in + 20);
+            acc.length = get<float>(in + 24);
+            acc.width = get<float>(in + 28);
+            in += TRACK_ROW_SIZE;
+        }
+        trackBlock = k;
+    }
+    step = std::min(std::max(step, firstStep()), lastStep());
+    return track[step - block.firstStep];
+}
+
+bool TrajectoryReader::overlaps(double a, double b, double c, double d) const {
+    if (ring <= 0) {
+        return a <= d && c <= b;
+    }
+    if (d - c >= ring) {
+        return true;
+    }
+    double start = std::fmod(c, ring);
+    if (start < 0) {
+        start += ring;
+    }
+    double end = start + (d - c);
+    return (a <= end && start <= b) || (a + ring <= end && start <= b + ring);
+}
+
+const std::vector<const TrajectoryBand *> &TrajectoryReader::bands(uint64_t step, double from, double to) {
+    calls++;
+    found.clear();
+    size_t k = blockOf(step);
+    for (size_t e = firstBand[k]; e < firstBand[k] + blocks[k].bandCount; e++) {
+        const TrajectoryBandEntry &entry = bandEntries[e];
+        if (overlaps(entry.minX, entry.maxX, from, to)) {
+            found.push_back(&decode(e));
+        }
+    }
+    return found;
+}
+
+const TrajectoryBand &TrajectoryReader::decode(size_t e) {
+    Cached *slot = nullptr;
+    for (Cached *c: cache) {
+        if (c->entry == e) {
+            c->used = calls;
+            return c->band;
+        }
+        // The least recently used, among the ones not handed out by this call
+        if (c->used < calls && (slot == nullptr || c->used < slot->used)) {
+            slot = c;
+        }
+    }
+    if (slot == nullptr || cache.size() < CACHED_BANDS) {
+        slot = new Cached();
+        cache.push_back(slot);
+    }
+    slot->entry = SIZE_MAX;
+    slot->used = calls;
+
+    const TrajectoryBandEntry &entry = bandEntries[e];
+    const char *in = data + entry.offset;
+    size_t available = size - INDEX_FOOTER_SIZE - entry.offset;
+    uint32_t payload = get<uint32_t>(in + 4);
+    uint32_t frames = get<uint32_t>(in + 16);
+    if (std::memcmp(in, BAND_TAG, sizeof(BAND_TAG)) != 0 || payload > available
+        || frames > TRAJECTORY_CHUNK_FRAMES || get<uint32_t>(in + 20) != entry.lane) {
+        throw Error("Trajectory " + path + " is damaged");
+    }
+
+    ColumnReader columns[8];
+    const char *column = in + BAND_HEADER_SIZE;
+    for (int c = 0; c < 8; c++) {
+        uint32_t length = get<uint32_t>(in + 44 + 4 * c);
+        if ((ptrdiff_t) length > in + payload - column) {
+            throw Error("Trajectory " + path + " is damaged");
+        }
+        columns[c].in = column;
+        columns[c].end = column + length;
+        column += length;
+    }
+    ColumnReader &count = columns[0], &ids = columns[1], &lanes = columns[2], &xs = columns[3], &vs = columns[4],
+            &as = columns[5], &lengths = columns[6], &widths = columns[7];
+
+    TrajectoryBand &band = slot->band;
+    band.clear();
+    band.firstStep = get<uint64_t>(in + 8);
+    band.frames = frames;
+    band.laneIndex = entry.lane;
+    lastIds.clear();
+    for (uint32_t f = 0; f < frames; f++) {
+        band.frameStart.push_back((uint32_t) band.id.size());
+        int64_t n = count.getDelta(0);
+        // Every vehicle takes at least a byte in the id column
+        if (n < 0 || n > ids.end - ids.in) {
+            throw Error("Trajectory " + path + " is damaged");
+        }
+        size_t start = band.id.size();
+        for (int64_t r = 0; r < n; r++) {
+            int64_t id = ids.getDelta((size_t) r < lastIds.size() ? lastIds[r] : 0);
+            if (id < 0 || id >= MAX_TRAJECTORY_ID) {
+                throw Error("Trajectory " + path + " is damaged");
+            }
+            TrajectoryHistory &h = historyOf(history, (VehicleId) id);
+            int64_t word = lanes.getDelta(0);
+            bool fresh = (word & 1) != 0;
+            uint32_t seen = fresh ? 0 : h.seen;
+            int64_t lane = (seen > 0 ? h.lane : 0) + (word - (fresh ? 1 : 0)) / 2;
+            int64_t x = xs.getDelta(seen == 0 ? 0 : h.x + h.move);
+            int64_t v = vs.getDelta(seen > 0 ? h.v : 0);
+            int64_t a = as.getDelta(seen > 0 ? h.a : 0);
+            if (fresh) {
+                h.length = lengths.getDelta(0);
+                h.width = widths.getDelta(0);
+            }
+
+            h.move = seen > 0 ? x - h.x : 0;
+            h.lane = lane;
+            h.x = x;
+            h.v = v;
+            h.a = a;
+            h.seen = std::min(seen + 1, 2u);
+
+            band.id.push_back((VehicleId) id);
+            band.lane.push_back((float) (lane / TRAJECTORY_SCALE));
+            band.x.push_back(x / TRAJECTORY_SCALE);
+            band.v.push_back((float) (v / TRAJECTORY_SCALE));
+            band.a.push_back((float) (a / TRAJECTORY_SCALE));
+            band.length.push_back((float) (h.length / TRAJECTORY_SCALE));
+            band.width.push_back((float) (h.width / TRAJECTORY_SCALE));
+        }
+        lastIds.assign(band.id.begin() + start, band.id.end());
+    }
+    band.frameStart.push_back((uint32_t) band.id.size());
+
+    slot->entry = e;
+    decodeCount++;
+    return band;
+}
@@ -0,0 +1,392 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEC_ACC_CPP_TRAJECTORY_H
+#define LEC_ACC_CPP_TRAJECTORY_H
+
+/**
+ * @file Trajectory.h
+ * @brief Compressed recordings of every vehicle on every step
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Vehicle.h"
+
+class Highway;
+
+/**
+ * Where every vehicle was after one step, lane after lane and in slot order, like in the lanes.
+ */
+struct TrajectoryFrame {
+    /**
+     * Highway::stepsTaken after the step.
+     */
+    uint64_t step = 0;
+
+    /**
+     * Length of the step, in seconds.
+     */
+    float dt = 0;
+
+    VehicleId preferred = NO_VEHICLE;
+
+    /**
+     * Where each lane starts in the columns below, and where the last one ends.
+     */
+    std::vector<uint32_t> laneStart;
+
+    std::vector<VehicleId> id;
+    std::vector<float> lane;
+    std::vector<double> x;
+    std::vector<float> v;
+    std::vector<float> a;
+    std::vector<float> length;
+    std::vector<float> width;
+
+    size_t size() const {
+        return id.size();
+    }
+
+    /**
+     * Copies the vehicles of the highway. Only allocates when there are more vehicles than ever before.
+     */
+    void capture(const Highway &highway, float dt);
+
+    void clear();
+};
+
+/**
+ * A trajectory file is a header, then blocks of up to TRAJECTORY_CHUNK_FRAMES consecutive frames,
+ * then an index of the blocks and of their bands, so a reader can seek to any step. Everything is little-endian.
+ *
+ * A block starts with the track of the preferred vehicle, then holds each lane cut in bands of
+ * TRAJECTORY_BAND_ROWS slots. Slots are sorted by position, so a band covers a stretch of road, and the index
+ * says which: a viewer only decodes the bands around the camera.
+ *
+ * Each band is stored column by column: the number of vehicles in each frame, then the ids, lanes,
+ * positions, speeds, accelerations, lengths and widths of all its frames. Values are stored in fixed point
+ * (1 mm, 1 mm/s, 1 mm/s^2 and 1/1000 of a lane), as the zigzag varint of their difference from a guess:
+ * the id in the same row of the previous frame, and for the rest, the value of the same vehicle in the
+ * previous frame, or for positions that plus its last move. Lengths and widths are only stored when a vehicle
+ * comes into the band. Vehicles barely change from a step to the next, so most values take a byte or two.
+ * A band only refers to its own frames, so it's decoded on its own.
+ */
+const uint32_t TRAJECTORY_CHUNK_FRAMES = 64;
+
+const uint32_t TRAJECTORY_BAND_ROWS = 256;
+
+/**
+ * Where a block is in a trajectory file.
+ */
+struct TrajectoryBlockEntry {
+    uint64_t firstStep;
+    uint32_t frames;
+
+    /**
+     * Its bands are the next bandCount in the index, after the ones of the blocks before.
+     */
+    uint32_t bandCount;
+    uint64_t offset;
+};
+
+/**
+ * Where a band is in a trajectory file, and the stretch of road its vehicles were on.
+ */
+struct TrajectoryBandEntry {
+    uint32_t lane;
+    uint32_t band;
+    double minX;
+    double maxX;
+    uint64_t offset;
+};
+
+/**
+ * One vehicle in one frame, as decoded.
+ */
+struct TrajectoryVehicle {
+    VehicleId id = NO_VEHICLE;
+    float lane = 0;
+    double x = 0;
+    float v = 0;
+    float a = 0;
+    float length = 0;
+    float width = 0;
+};
+
+/**
+ * The frames of one band of one lane, as decoded. The rows of each frame are in slot order.
+ */
+struct TrajectoryBand {
+    uint64_t firstStep = 0;
+    uint32_t frames = 0;
+
+    /**
+     * The lane the band is a part of. The lanes of the vehicles themselves are fractional while they change lane.
+     */
+    uint32_t laneIndex = 0;
+
+    /**
+     * Where each frame starts in the columns below, and where the last one ends.
+     */
+    std::vector<uint32_t> frameStart;
+
+    std::vector<VehicleId> id;
+    std::vector<float> lane;
+    std::vector<double> x;
+    std::vector<float> v;
+    std::vector<float> a;
+    std::vector<float> length;
+    std::vector<float> width;
+
+    void clear();
+};
+
+/**
+ * What the encoder and the decoder know of one vehicle, in fixed point, to guess its next values from.
+ * The encoder only guesses from the frame just before, in the same band, and says when it doesn't,
+ * so a band decodes the same on its own as when it was encoded with the rest.
+ */
+struct TrajectoryHistory {
+    /**
+     * The band and the frame of it these values are from. Only kept by the encoder.
+     */
+    uint32_t band;
+    uint32_t frame;
+
+    /**
+     * Frames in a row the vehicle was in that band, up to 2.
+     */
+    uint32_t seen;
+
+    int64_t lane;
+    int64_t x;
+    int64_t move;
+    int64_t v;
+    int64_t a;
+    int64_t length;
+    int64_t width;
+};
+
+/**
+ * Compresses frames into blocks, one frame at a time.
+ */
+class TrajectoryEncoder {
+public:
+    TrajectoryEncoder();
+
+    /**
+     * Appends the start of a file, for a highway with that many lanes, on a ring that long (0 if straight).
+     */
+    static void header(std::vector<char> &out, uint32_t lanes, double ringLength);
+
+    /**
+     * Appends the index of the blocks, which ends the file.
+     * @param offset Where the index starts in the file.
+     */
+    static void index(std::vector<char> &out, const std::vector<TrajectoryBlockEntry> &blocks,
+                      const std::vector<TrajectoryBandEntry> &bands, uint64_t offset);
+
+    /**
+     * Adds a frame to the block being encoded.
+     */
+    void add(const TrajectoryFrame &frame);
+
+    /**
+     * Number of frames added since the last TrajectoryEncoder::finish.
+     */
+    uint32_t frames() const {
+        return frameCount;
+    }
+
+    /**
+     * Appends the block to out, and its entries to the index, and starts a new one.
+     * @param offset Where out starts in the file.
+     */
+    void finish(std::vector<char> &out, uint64_t offset, std::vector<TrajectoryBlockEntry> &blocks,
+                std::vector<TrajectoryBandEntry> &bands);
+
+private:
+    enum Column {
+        COUNT, ID, LANE, X, V, A, LENGTH, WIDTH, COLUMN_COUNT
+    };
+
+    /**
+     * One band of one lane being encoded.
+     */
+    struct Band {
+        uint32_t number;
+        double minX;
+        double maxX;
+        std::vector<VehicleId> lastIds;
+        std::vector<char> columns[COLUMN_COUNT];
+    };
+
+    uint64_t firstStep;
+    float dt;
+    VehicleId preferred;
+    uint32_t frameCount;
+
+    /**
+     * Numbers the bands, for TrajectoryHistory::band.
+     */
+    uint32_t bandNumber;
+
+    /**
+     * The bands of each lane, kept from block to block so their columns stay allocated.
+     * Only the first bandsUsed of each lane are in the current block.
+     */
+    std::vector<std::vector<Band>> bands;
+    std::vector<uint32_t> bandsUsed;
+
+    /**
+     * The preferred vehicle in each frame, stored as is.
+     */
+    std::vector<char> track;
+
+    std::vector<TrajectoryHistory> history;
+
+    void startBand(Band &band);
+
+    void addRows(Band &band, const TrajectoryFrame &frame, size_t begin, size_t end);
+};
+
+/**
+ * Reads a trajectory file, mapped in memory, and decodes the parts asked for.
+ * Keeps the last bands it decoded, so moving back and forth around a step decodes nothing new.
+ */
+class TrajectoryReader {
+public:
+    /**
+     * Maps the file, and reads its index. Throws an Error if it isn't a whole trajectory file.
+     */
+    explicit TrajectoryReader(const std::string &path);
+
+    ~TrajectoryReader();
+
+    TrajectoryReader(const TrajectoryReader &) = delete;
+
+    TrajectoryReader &operator=(const TrajectoryReader &) = delete;
+
+    uint32_t lanes() const {
+        return laneCount;
+    }
+
+    /**
+     * Length of the ring road, or 0 if the road was straight.
+     */
+    double ringLength() const {
+        return ring;
+    }
+
+    /**
+     * The first and the last step recorded. There's a frame for every step in between.
+     */
+    uint64_t firstStep() const;
+
+    uint64_t lastStep() const;
+
+    /**
+     * Length of a recorded step, in seconds.
+     */
+    float dt() const;
+
+    /**
+     * The preferred vehicle after that step, which must be between TrajectoryReader::firstStep and lastStep.
+     */
+    TrajectoryVehicle preferred(uint64_t step);
+
+    /**
+     * Decodes the bands of the block holding that step that were anywhere between from and to,
+     * and points to them, in lane order, and in slot order for each lane.
+     * The bands are good until the next call.
+     */
+    const std::vector<const TrajectoryBand *> &bands(uint64_t step, double from, double to);
+
+    /**
+     * Bands decoded so far. Stays put while the bands asked for are already decoded.
+     */
+    uint64_t bandsDecoded() const {
+        return decodeCount;
+    }
+
+private:
+    std::string path;
+    const char *data;
+    size_t size;
+
+    uint32_t laneCount;
+    double ring;
+
+    std::vector<TrajectoryBlockEntry> blocks;
+    std::vector<TrajectoryBandEntry> bandEntries;
+
+    /**
+     * Where the bands of each block start in bandEntries.
+     */
+    std::vector<size_t> firstBand;
+
+    /**
+     * The block holding the track below, and the track.
+     */
+    size_t trackBlock;
+    std::vector<TrajectoryVehicle> track;
+
+    /**
+     * A decoded band, and when it was last asked for.
+     */
+    struct Cached {
+        size_t entry;
+        uint64_t used;
+        TrajectoryBand band;
+    };
+
+    std::vector<Cached *> cache;
+    uint64_t calls;
+    uint64_t decodeCount;
+    std::vector<const TrajectoryBand *> found;
+
+    std::vector<TrajectoryHistory> history;
+    std::vector<VehicleId> lastIds;
+
+    size_t blockOf(uint64_t step) const;
+
+    /**
+     * Whether the stretch from a to b, wrapped around the ring if there's one, meets the one from c to d.
+     */
+    bool overlaps(double a, double b, double c, double d) const;
+
+    const TrajectoryBand &decode(size_t entry);
+};
+
+#endif
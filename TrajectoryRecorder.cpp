@@ -0,0 +1,157 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file TrajectoryRecorder.cpp
+ * @brief Records every vehicle on every step to a file, on a thread of its own
+ */
+
+#include <chrono>
+#include <iostream>
+#include "Error.h"
+#include "Trace.h"
+#include "TrajectoryRecorder.h"
+
+/**
+ * Frames waiting for the writer at most: two blocks, so one can be compressed while the next fills up.
+ */
+const uint32_t RING_FRAMES = 2 * TRAJECTORY_CHUNK_FRAMES;
+
+/**
+ * How long the writer sleeps when it has caught up.
+ */
+const std::chrono::microseconds WRITER_IDLE(500);
+
+TrajectoryRecorder::TrajectoryRecorder(const std::string &path, uint32_t lanes, double ringLength) :
+        path(path),
+        file(std::fopen(path.c_str(), "wb")),
+        ring(RING_FRAMES),
+        empty(RING_FRAMES),
+        filled(RING_FRAMES),
+        failed(false),
+        written(0),
+        stopping(false),
+        captured(0),
+        stalled(0) {
+    if (file == nullptr) {
+        throw Error("Can't write trajectory " + path);
+    }
+    for (uint32_t slot = 0; slot < RING_FRAMES; slot++) {
+        empty.push(slot);
+    }
+    TrajectoryEncoder::header(buffer, lanes, ringLength);
+    write(buffer);
+    writer = std::thread(&TrajectoryRecorder::run, this);
+}
+
+TrajectoryRecorder::~TrajectoryRecorder() {
+    try {
+        close();
+    } catch (const Error &e) {
+        std::cerr << e.what() << std::endl;
+    }
+}
+
+void TrajectoryRecorder::capture(const Highway &highway, float dt) {
+    if (file == nullptr) {
+        return;
+    }
+    uint32_t slot;
+    if (!empty.pop(slot)) {
+        stalled++;
+        while (!empty.pop(slot)) {
+            std::this_thread::yield();
+        }
+    }
+    ring[slot].capture(highway, dt);
+    filled.push(slot);
+    captured++;
+}
+
+void TrajectoryRecorder::close() {
+    if (file == nullptr) {
+        return;
+    }
+    stopping.store(true, std::memory_order_release);
+    writer.join();
+
+    flushBlock();
+    buffer.clear();
+    TrajectoryEncoder::index(buffer, blocks, bands, written.load());
+    write(buffer);
+    failed = std::fclose(file) != 0 || failed;
+    file = nullptr;
+    if (failed) {
+        throw Error("Can't write trajectory " + path);
+    }
+}
+
+void TrajectoryRecorder::run() {
+    Trace::setThreadName("Recorder");
+    for (;;) {
+        // Whatever was captured before the stop is still written
+        bool last = stopping.load(std::memory_order_acquire);
+        uint32_t slot;
+        bool busy = false;
+        while (filled.pop(slot)) {
+            ACC_TRACE_SCOPE("Compress frame");
+            encoder.add(ring[slot]);
+            empty.push(slot);
+            if (encoder.frames() == TRAJECTORY_CHUNK_FRAMES) {
+                flushBlock();
+            }
+            busy = true;
+        }
+        if (last) {
+            break;
+        }
+        if (!busy) {
+            std::this_thread::sleep_for(WRITER_IDLE);
+        }
+    }
+}
+
+void TrajectoryRecorder::flushBlock() {
+    if (encoder.frames() == 0) {
+        return;
+    }
+    buffer.clear();
+    encoder.finish(buffer, written.load(), blocks, bands);
+    write(buffer);
+}
+
+void TrajectoryRecorder::write(const std::vector<char> &bytes) {
+    if (std::fwrite(bytes.data(), 1, bytes.size(), file) != bytes.size()) {
+        failed = true;
+    }
+    written.fetch_add(bytes.size(), std::memory_order_relaxed);
+}
@@ -0,0 +1,144 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEC_ACC_CPP_TRAJECTORYRECORDER_H
+#define LEC_ACC_CPP_TRAJECTORYRECORDER_H
+
+/**
+ * @file TrajectoryRecorder.h
+ * @brief Records every vehicle on every step to a file, on a thread of its own
+ */
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SpscQueue.h"
+#include "Trajectory.h"
+
+class Highway;
+
+/**
+ * Writes the trajectory of every vehicle to a file, see Trajectory.h for the format.
+ *
+ * The thread that steps the highway only copies the vehicles into a ring of frames.
+ * A writer thread compresses them into chunks and writes those, so the step never waits on the disk.
+ * If the writer falls behind by the whole ring, the step waits for it rather than drop a frame.
+ */
+class TrajectoryRecorder {
+public:
+    /**
+     * Creates the file and starts the writer. Throws an Error if the file can't be created.
+     */
+    TrajectoryRecorder(const std::string &path, uint32_t lanes, double ringLength);
+
+    TrajectoryRecorder(const TrajectoryRecorder &) = delete;
+
+    TrajectoryRecorder &operator=(const TrajectoryRecorder &) = delete;
+
+    /**
+     * Closes the file, if TrajectoryRecorder::close wasn't called. Errors are only reported.
+     */
+    ~TrajectoryRecorder();
+
+    /**
+     * Hands the vehicles of the highway, as they are after a step, to the writer.
+     * Only copies them, unless the writer is a whole ring behind.
+     */
+    void capture(const Highway &highway, float dt);
+
+    /**
+     * Writes the frames still in the ring, the index of the chunks, and closes the file.
+     * Throws an Error if anything couldn't be written.
+     */
+    void close();
+
+    /**
+     * Frames handed to the writer so far.
+     */
+    uint64_t frames() const {
+        return captured;
+    }
+
+    /**
+     * Bytes written to the file so far. Final once the recorder is closed.
+     */
+    uint64_t bytesWritten() const {
+        return written.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Number of times TrajectoryRecorder::capture waited for the writer.
+     */
+    uint64_t stalls() const {
+        return stalled;
+    }
+
+private:
+    std::string path;
+    FILE *file;
+
+    /**
+     * The ring of frames. The slots go back and forth between the two queues.
+     */
+    std::vector<TrajectoryFrame> ring;
+    SpscQueue<uint32_t> empty;
+    SpscQueue<uint32_t> filled;
+
+    // Only touched by the writer while it runs
+    TrajectoryEncoder encoder;
+    std::vector<char> buffer;
+    std::vector<TrajectoryBlockEntry> blocks;
+    std::vector<TrajectoryBandEntry> bands;
+    bool failed;
+
+    std::atomic<uint64_t> written;
+    std::atomic<bool> stopping;
+    std::thread writer;
+    uint64_t captured;
+    uint64_t stalled;
+
+    /**
+     * The writer: compresses the frames as they come, until stopped.
+     */
+    void run();
+
+    /**
+     * Writes the block encoded so far, if there's anything in it.
+     */
+    void flushBlock();
+
+    void write(const std::vector<char> &bytes);
+};
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEC_ACC_CPP_TRIPLEBUFFER_H
+#define LEC_ACC_CPP_TRIPLEBUFFER_H
+
+/**
+ * @file TripleBuffer.h
+ * @brief Hands the latest value from one thread to another, without locks
+ */
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Three copies of a value: one being written, one being read, and the latest finished one in between.
+ *
+ * One writer fills in TripleBuffer::back and publishes it; one reader picks up the latest published
+ * value with TripleBuffer::update and reads it at TripleBuffer::front, for as long as it likes.
+ * Neither ever waits for the other. Values the reader was too slow to pick up are skipped.
+ * The copies are reused, so a T that keeps its capacity (like a vector) stops allocating.
+ */
+template<typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : middle(1), frontIndex(0), backIndex(2) {
+    }
+
+    /**
+     * The copy the writer fills in. Only the writer may touch it.
+     */
+    T &back() {
+        return slots[backIndex];
+    }
+
+    /**
+     * Makes the back copy the latest one, and gives the writer another one to fill in.
+     */
+    void publish() {
+        backIndex = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    /**
+     * Moves the reader to the latest published copy.
+     * @return false if nothing was published since the last call.
+     */
+    bool update() {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+            return false;
+        }
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    /**
+     * The copy the reader is on. Only the reader may touch it.
+     */
+    const T &front() const {
+        return slots[frontIndex];
+    }
+
+private:
+    static const uint8_t INDEX = 3;
+    static const uint8_t FRESH = 4;
+
+    T slots[3];
+
+    /**
+     * Index of the copy in between, plus FRESH if the reader hasn't picked it up yet.
+     */
+    std::atomic<uint8_t> middle;
+
+    uint8_t frontIndex;
+    uint8_t backIndex;
+};
+
+#endif
@@ -35,9 +35,12 @@
  * @brief Coordinates between ImGUI and app logic
  */
 
+#include <algorithm>
+#include <cfloat>
 #include <imgui.h>
 #include <sstream>
 #include "UIPresenter.h"
+#include "PerfCounters.h"
 #include "imgui_impl_glfw.h"
 
 /**
@@ -50,16 +53,45 @@ static const float RESET_TIMEOUT = 5.5;
  */
 static Interval coin(0, 1);
 
-UIPresenter::UIPresenter(Highway &highway, GLFWwindow *window, ScreenMapper *screenMapper) :
+/**
+ * Colours of the phases of the step, in the statistics view.
+ */
+static const ImVec4 PHASE_COLORS[STEP_PHASE_COUNT] = {
+        ImVec4(0.90f, 0.60f, 0.20f, 1.0f),
+        ImVec4(0.90f, 0.90f, 0.30f, 1.0f),
+        ImVec4(0.90f, 0.35f, 0.35f, 1.0f),
+        ImVec4(0.35f, 0.70f, 0.95f, 1.0f),
+        ImVec4(0.45f, 0.90f, 0.45f, 1.0f),
+        ImVec4(0.75f, 0.50f, 0.95f, 1.0f),
+        ImVec4(0.70f, 0.70f, 0.70f, 1.0f),
+        ImVec4(0.95f, 0.55f, 0.75f, 1.0f),
+};
+
+static const float PROFILE_WIDTH = 320;
+
+/**
+ * Fastest a replay plays, either way, in recorded seconds per second.
+ */
+static const float MAX_REPLAY_SPEED = 64;
+
+UIPresenter::UIPresenter(Highway *highway, Simulation &simulation, GLFWwindow *window,
+                         ScreenMapper *screenMapper) :
         highway(highway),
+        simulation(simulation),
         window(window),
         screenMapper(screenMapper) {
     ImGui_ImplGlfw_Init(window, true);
     resetState();
+
+    // The sliders have the last word
+    VehicleId acc = simulation.current().preferred.id;
+    simulation.post(HighwayCommand::setTargetSpeed(acc, accTargetSpeed / 3.6f));
+    simulation.post(HighwayCommand::setTargetDistance(acc, accTargetDistance));
 }
 
 UIPresenter::UIPresenter(const UIPresenter &orig) :
         highway(orig.highway),
+        simulation(orig.simulation),
         window(orig.window),
         screenMapper(orig.screenMapper) {
 }
@@ -68,30 +100,26 @@ UIPresenter::~UIPresenter() {
     ImGui_ImplGlfw_Shutdown();
 }
 
-void UIPresenter::present(float dt) {
+void UIPresenter::present(const Snapshot &snapshot, float dt) {
     ImGui_ImplGlfw_NewFrame();
 
-    commandView();
-    if (showStatsView) {
-        statsView();
-    }
-
-    if (highway.selectedVehicle != nullptr && highway.selectedVehicle != highway.preferredVehicle) {
-        showRandomVehicleView();
-    }
-
-
     timeToStateReset -= dt;
     if (timeToStateReset < 0) {
         resetState();
     }
+    followSnapshot(snapshot);
 
-    if (std::abs(highway.preferredVehicle->getTargetSpeed() - accTargetSpeed / 3.6f) > 0.5f) {
-        highway.preferredVehicle->setTargetSpeed(accTargetSpeed / 3.6f);
+    if (simulation.replaying() != nullptr) {
+        replayView();
+    } else {
+        commandView(snapshot);
+    }
+    if (showStatsView) {
+        statsView(snapshot);
     }
 
-    if (std::abs(highway.preferredVehicle->getTargetDistance() - accTargetDistance) > 0.5f) {
-        highway.preferredVehicle->setTargetDistance(accTargetDistance);
+    if (snapshot.selected.id != NO_VEHICLE) {
+        showRandomVehicleView(snapshot);
     }
 
 //    if (showDemoView)
@@ -111,35 +139,49 @@ void UIPresenter::mouse_button_callback(int button, int action, int mods) {
     Point cursorPos;
     double x, y;
     glfwGetCursorPos(window, &x, &y);
-    cursorPos.x = (float) x;
-    cursorPos.y = (float) y;
+    cursorPos.x = x;
+    cursorPos.y = y;
 
     Point roadCoords = screenMapper->pixelToRoadCoordinates(cursorPos);
 
+    if (simulation.replaying() != nullptr) {
+        // Nothing to give orders to
+        return;
+    }
     if (waitingForVehiclePlacement) {
         waitingForVehiclePlacement = false;
-        highway.unselectVehicle();
-        if (highway.addVehicleAt(roadCoords.x, roadCoords.y, newVehicleSpeed / 3.6f)) {
-            setState("Vehicle added.");
-        } else {
-            setState("Vehicle couldn't be added.");
-        }
+        simulation.post(HighwayCommand::addVehicleAt(roadCoords.x, roadCoords.y, newVehicleSpeed / 3.6f));
+        setState("Adding vehicle...");
         return;
-    } else {
-        highway.selectVehicleAt(roadCoords.x, roadCoords.y);
     }
 
-    if (highway.selectedVehicle == highway.preferredVehicle) {
-        highway.unselectVehicle();
+    // followSnapshot tells if something got selected
+    selectionCommand = simulation.post(HighwayCommand::selectVehicleAt(roadCoords.x, roadCoords.y));
+    resetState();
+    shownSelection = NO_VEHICLE;
+}
+
+void UIPresenter::followSnapshot(const Snapshot &snapshot) {
+    if (snapshot.commandsExecuted >= selectionCommand && snapshot.selected.id != shownSelection) {
+        shownSelection = snapshot.selected.id;
+        if (shownSelection != NO_VEHICLE) {
+            setState("Vehicle selected.");
+            randomTargetDistance = snapshot.selected.targetDistance;
+            randomTargetSpeed = snapshot.selected.targetSpeed * 3.6f;
+        }
     }
 
-    if (highway.selectedVehicle != nullptr) {
-        setState("Vehicle selected.");
-        randomTargetDistance = highway.selectedVehicle->getTargetDistance();
-        randomTargetSpeed = highway.selectedVehicle->getTargetSpeed() * 3.6f;
+    uint32_t added = snapshot.vehiclesAdded - shownVehiclesAdded;
+    uint32_t notAdded = snapshot.vehiclesNotAdded - shownVehiclesNotAdded;
+    shownVehiclesAdded = snapshot.vehiclesAdded;
+    shownVehiclesNotAdded = snapshot.vehiclesNotAdded;
+    if (added + notAdded == 1) {
+        setState(added ? "Vehicle added." : "Vehicle couldn't be added.");
+    } else if (added + notAdded > 1) {
+        std::ostringstream ss;
+        ss << added << " vehicles added, " << notAdded << " didn't fit.";
+        setState(ss.str());
     }
-    else
-        resetState();
 }
 
 
@@ -148,12 +190,17 @@ void UIPresenter::render() {
 }
 
 
-void UIPresenter::commandView() {
+void UIPresenter::commandView(const Snapshot &snapshot) {
     ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiSetCond_FirstUseEver);
     ImGui::Begin("Simulation command", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
 
-    ImGui::SliderFloat("ACC target speed", &accTargetSpeed, 10.0f, 350.0f, "%.0f");
-    ImGui::SliderFloat("ACC target distance", &accTargetDistance, 20.0f, 150.0f, "%.0f");
+    VehicleId acc = snapshot.preferred.id;
+    if (ImGui::SliderFloat("ACC target speed", &accTargetSpeed, 10.0f, 350.0f, "%.0f")) {
+        simulation.post(HighwayCommand::setTargetSpeed(acc, accTargetSpeed / 3.6f));
+    }
+    if (ImGui::SliderFloat("ACC target distance", &accTargetDistance, 20.0f, 150.0f, "%.0f")) {
+        simulation.post(HighwayCommand::setTargetDistance(acc, accTargetDistance));
+    }
 
 
     if (ImGui::Button("Toggle statistics window")) {
@@ -175,13 +222,13 @@ void UIPresenter::commandView() {
     ImGui::Text("ACC: Change lane ");
     ImGui::SameLine();
     if (ImGui::SmallButton("left")) {
-        highway.preferredVehicle->setAction(Action::change_lane_left);
+        simulation.post(HighwayCommand::setAction(acc, Action::change_lane_left));
 
         setState("Lane change requested.");
     }
     ImGui::SameLine();
     if (ImGui::SmallButton("right")) {
-        highway.preferredVehicle->setAction(Action::change_lane_right);
+        simulation.post(HighwayCommand::setAction(acc, Action::change_lane_right));
 
         setState("Lane change requested.");
     }
@@ -189,9 +236,9 @@ void UIPresenter::commandView() {
     if (ImGui::SmallButton("randomly")) {
         float t = coin.uniform();
         if (t < 0.5) {
-            highway.preferredVehicle->setAction(Action::change_lane_right);
+            simulation.post(HighwayCommand::setAction(acc, Action::change_lane_right));
         } else {
-            highway.preferredVehicle->setAction(Action::change_lane_left);
+            simulation.post(HighwayCommand::setAction(acc, Action::change_lane_left));
         }
         setState("Lane change requested.");
     }
@@ -200,11 +247,8 @@ void UIPresenter::commandView() {
     ImGui::Text("Sim: Add vehicle ");
     ImGui::SameLine();
     if (ImGui::SmallButton("in front")) {
-        if( highway.addVehicleInFrontOfPreferred(newVehicleSpeed / 3.6f)) {
-            setState("Vehicle added.");
-        } else {
-            setState("Vehicle not added.");
-        }
+        simulation.post(HighwayCommand::addVehicleInFrontOfPreferred(newVehicleSpeed / 3.6f));
+        setState("Adding vehicle...");
     }
 
     ImGui::SameLine();
@@ -213,7 +257,15 @@ void UIPresenter::commandView() {
         setState("Click on the road!");
     }
 
+    ImGui::SameLine();
+    if (ImGui::SmallButton("a batch")) {
+        // One order, however big the batch
+        simulation.post(HighwayCommand::addVehicles((uint32_t) batchSize, newVehicleSpeed / 3.6f));
+        setState("Adding vehicles...");
+    }
+
     ImGui::SliderFloat("New vehicle speed", &newVehicleSpeed, 30, 250, "%.0f");
+    ImGui::SliderInt("Vehicles in a batch", &batchSize, 10, 1000);
 
     ImGui::Text("Status: %s", status.c_str());
 
@@ -223,22 +275,134 @@ void UIPresenter::commandView() {
 /**
  * Shows stats, like FPS, ACC speed/distance.
  */
-void UIPresenter::statsView() {
+void UIPresenter::statsView(const Snapshot &snapshot) {
     ImGui::SetNextWindowPos(ImVec2(450, 10), ImGuiSetCond_FirstUseEver);
     ImGui::Begin("Statistics", &showStatsView, ImGuiWindowFlags_AlwaysAutoResize);
 
     ImGui::Text("FPS: %.0f (%.1f ms/frame) ", ImGui::GetIO().Framerate, 1000.0f / ImGui::GetIO().Framerate);
-    ImGui::Text("ACC Speed: %.0f km/h", highway.preferredVehicle->getV() * 3.6f);
-    if (std::abs(highway.preferredVehicleFrontDistance) > 1e4) {
+    ImGui::Text("ACC Speed: %.0f km/h", snapshot.preferred.v * 3.6f);
+    if (std::abs(snapshot.preferredFrontDistance) > 1e4) {
         ImGui::Text("ACC Distance to next vehicle: infinity (unknown)");
     } else {
-        ImGui::Text("ACC Distance to next vehicle: %.0f meters", highway.preferredVehicleFrontDistance);
+        ImGui::Text("ACC Distance to next vehicle: %.0f meters", snapshot.preferredFrontDistance);
+    }
+
+    Replay *replay = simulation.replaying();
+    if (replay != nullptr) {
+        // Nothing but the vehicles was recorded
+        ImGui::Text("Replaying step %llu, %llu bands decoded so far", (unsigned long long) snapshot.steps,
+                    (unsigned long long) replay->bandsDecoded());
+        ImGui::End();
+        return;
+    }
+    ImGui::Text("Heap allocations in last step: %llu", (unsigned long long) snapshot.lastStepAllocations);
+    ImGui::Text("Overtakes sorted in last step: %u", (unsigned) snapshot.lastSortInversions);
+    ImGui::Text("Simulation: %.0f steps/s on %s thread, %llu steps dropped", 1 / snapshot.dt,
+                simulation.threaded() ? "its own" : "the window's", (unsigned long long) snapshot.droppedSteps);
+
+    ImGui::Separator();
+#ifdef ACC_PROFILE_STEP
+    const StepProfile &profile = snapshot.profile;
+    int steps = (int) profile.size();
+    ImGui::Text("Step time, last %d steps (%u threads)", steps, snapshot.threads);
+    ImGui::PlotLines("##steptime", profile.totals(), steps, 0, "ms", 0.0f, FLT_MAX, ImVec2(PROFILE_WIDTH, 60));
+
+    // Mean time of each phase, stacked in one bar
+    float total = 0;
+    for (size_t p = 0; p < STEP_PHASE_COUNT; p++) {
+        total += profile.mean((StepPhase) p);
+    }
+    ImDrawList *draw = ImGui::GetWindowDrawList();
+    ImVec2 corner = ImGui::GetCursorScreenPos();
+    const float height = 14;
+    float x = corner.x;
+    for (size_t p = 0; p < STEP_PHASE_COUNT && total > 0; p++) {
+        float width = profile.mean((StepPhase) p) / total * PROFILE_WIDTH;
+        draw->AddRectFilled(ImVec2(x, corner.y), ImVec2(x + width, corner.y + height),
+                            ImGui::ColorConvertFloat4ToU32(PHASE_COLORS[p]));
+        x += width;
+    }
+    ImGui::Dummy(ImVec2(PROFILE_WIDTH, height));
+
+    for (size_t p = 0; p < STEP_PHASE_COUNT; p++) {
+        StepPhase phase = (StepPhase) p;
+        ImGui::TextColored(PHASE_COLORS[p], "%-18s mean %7.3f ms   p99 %7.3f ms",
+                           StepProfile::name(phase), profile.mean(phase), profile.p99(phase));
+    }
+#else
+    ImGui::Text("Step timers are compiled out (ACC_PROFILE_STEP)");
+#endif
+
+    if (highway != nullptr && highway->getConfig().perfCounters) {
+        ImGui::Separator();
+        ImGui::Text("%s", PerfCounters::status().c_str());
+        if (PerfCounters::enabled()) {
+            ImGui::SameLine();
+            if (ImGui::SmallButton("Reset")) {
+                PerfCounters::reset();
+            }
+            ImGui::Text("%s", PerfCounters::report().c_str());
+        }
     }
 
     ImGui::End();
 }
 
 
+void UIPresenter::replayView() {
+    Replay &replay = *simulation.replaying();
+    ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiSetCond_FirstUseEver);
+    ImGui::Begin("Replay", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+
+    float first = (float) replay.firstStep();
+    float last = (float) replay.lastStep();
+    float step = (float) replay.position();
+    if (ImGui::SliderFloat("Step", &step, first, last, "%.0f")) {
+        replay.seek(step);
+    }
+    ImGui::Text("Time: %.2f s of %.2f s", (replay.position() - first) * replay.dt(), (last - first) * replay.dt());
+
+    float speed = replay.speed();
+    if (ImGui::SliderFloat("Speed", &speed, -MAX_REPLAY_SPEED, MAX_REPLAY_SPEED, "%.2fx", 3.0f)) {
+        replay.setSpeed(speed);
+    }
+
+    // Twice as fast each time, or turn around
+    if (ImGui::Button("<<")) {
+        replay.setSpeed(speed >= 0 ? -1 : std::max(speed * 2, -MAX_REPLAY_SPEED));
+        replay.setPaused(false);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button(replay.paused() ? "Play" : "Pause")) {
+        replay.setPaused(!replay.paused());
+    }
+    ImGui::SameLine();
+    if (ImGui::Button(">>")) {
+        replay.setSpeed(speed <= 0 ? 1 : std::min(speed * 2, MAX_REPLAY_SPEED));
+        replay.setPaused(false);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Real time")) {
+        replay.setSpeed(1);
+    }
+
+    if (ImGui::Button("Toggle statistics window")) {
+        showStatsView ^= 1;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Zoom In")) {
+        screenMapper->zoomIn();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Zoom Out")) {
+        screenMapper->zoomOut();
+    }
+    ImGui::Text("Space: play or pause, left and right: one step");
+
+    ImGui::End();
+}
+
+
 void UIPresenter::setState(std::string statusString) {
     status = statusString;
     timeToStateReset = RESET_TIMEOUT;
@@ -251,39 +415,36 @@ void UIPresenter::resetState() {
     waitingForVehiclePlacement = false;
 }
 
-void UIPresenter::showRandomVehicleView() {
+void UIPresenter::showRandomVehicleView(const Snapshot &snapshot) {
     ImGui::SetNextWindowPos(ImVec2(450, 100), ImGuiSetCond_FirstUseEver);
     ImGui::Begin("Selected vehicle", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
 
-    ImGui::SliderFloat("Target speed", &randomTargetSpeed, 10.0f, 280.0f, "%.0f");
-    ImGui::SliderFloat("Target distance", &randomTargetDistance, 20.0f, 150.0f, "%.0f");
-
-    if (std::abs(highway.selectedVehicle->getTargetSpeed() - randomTargetSpeed / 3.6) > 0.5) {
-        highway.selectedVehicle->setTargetSpeed(randomTargetSpeed / 3.6f);
+    const VehicleSnapshot &selected = snapshot.selected;
+    if (ImGui::SliderFloat("Target speed", &randomTargetSpeed, 10.0f, 280.0f, "%.0f")) {
+        simulation.post(HighwayCommand::setTargetSpeed(selected.id, randomTargetSpeed / 3.6f));
     }
-
-    if (std::abs(highway.selectedVehicle->getTargetDistance() - randomTargetDistance) > 0.5) {
-        highway.selectedVehicle->setTargetDistance(randomTargetDistance);
+    if (ImGui::SliderFloat("Target distance", &randomTargetDistance, 20.0f, 150.0f, "%.0f")) {
+        simulation.post(HighwayCommand::setTargetDistance(selected.id, randomTargetDistance));
     }
 
     ImGui::Text("Change lane ");
     ImGui::SameLine();
     if (ImGui::SmallButton("left")) {
-        highway.selectedVehicle->setAction(Action::change_lane_left);
+        simulation.post(HighwayCommand::setAction(selected.id, Action::change_lane_left));
     }
     ImGui::SameLine();
     if (ImGui::SmallButton("right")) {
-        highway.selectedVehicle->setAction(Action::change_lane_right);
+        simulation.post(HighwayCommand::setAction(selected.id, Action::change_lane_right));
     }
     ImGui::SameLine();
     if (ImGui::SmallButton("randomly")) {
         float t = coin.uniform();
         if (t < 0.5) {
-            highway.selectedVehicle->setAction(Action::change_lane_right);
+            simulation.post(HighwayCommand::setAction(selected.id, Action::change_lane_right));
         } else {
-            highway.selectedVehicle->setAction(Action::change_lane_left);
+            simulation.post(HighwayCommand::setAction(selected.id, Action::change_lane_left));
         }
     }
-    ImGui::Text("Speed: %.0f km/h", highway.selectedVehicle->getV() * 3.6f);
+    ImGui::Text("Speed: %.0f km/h", selected.v * 3.6f);
     ImGui::End();
 }
@@ -40,20 +40,21 @@
 #include <GLFW/glfw3.h>
 #include <string>
 #include "Highway.h"
+#include "Simulation.h"
 
 /**
- * 2D point, uses floats.
+ * 2D point, uses doubles, because road coordinates get large.
  * I got lazy using std::pair<float, float> so I wrote this.
  */
 struct Point {
-    float x;
-    float y;
+    double x;
+    double y;
 
     Point() {
         x = y = 0;
     }
 
-    Point(float x, float y) : x(x), y(y) { }
+    Point(double x, double y) : x(x), y(y) { }
 };
 
 /**
@@ -77,9 +78,15 @@ public:
 class UIPresenter {
 protected:
     /**
-     * Ref to the highway
+     * The highway, or nullptr when playing back a recording. Only its configuration is read here:
+     * the state comes from the snapshots of the simulation, and the orders go to it.
      */
-    Highway &highway;
+    Highway *highway;
+
+    /**
+     * Steps the highway, and carries out our orders
+     */
+    Simulation &simulation;
 
     /**
      * The window the UI is rendered to
@@ -121,6 +128,11 @@ protected:
      */
     float newVehicleSpeed = 120.0f;
 
+    /**
+     * Number of vehicles added at once by the 'a batch' button.
+     */
+    int batchSize = 100;
+
     /**
      * UI status message. This should reset once in a while
      */
@@ -129,12 +141,17 @@ protected:
     /**
      * Displays stats, like ACC speed and distance.
      */
-    void statsView();
+    void statsView(const Snapshot &snapshot);
 
     /**
      * Main command view, controls the ACC and the simulation.
      */
-    void commandView();
+    void commandView(const Snapshot &snapshot);
+
+    /**
+     * Takes the place of the command view when playing back a recording: play, pause, speed and scrubbing.
+     */
+    void replayView();
 
     /**
      * Sets the state string and resets the timeout.
@@ -157,9 +174,23 @@ protected:
      */
     void resetState();
 
+    /**
+     * The selection, and the count of vehicles added or not, in the last snapshot we looked at.
+     * Our orders are carried out later, on the simulation's side: their results show up as changes to these.
+     */
+    VehicleId shownSelection = NO_VEHICLE;
+    uint64_t selectionCommand = 0;
+    uint32_t shownVehiclesAdded = 0;
+    uint32_t shownVehiclesNotAdded = 0;
+
+    /**
+     * Reports the results of our orders that came in with the latest snapshot.
+     */
+    void followSnapshot(const Snapshot &snapshot);
+
 
 public:
-    UIPresenter(Highway &highway, GLFWwindow *window, ScreenMapper *screenMapper);
+    UIPresenter(Highway *highway, Simulation &simulation, GLFWwindow *window, ScreenMapper *screenMapper);
 
     UIPresenter(const UIPresenter &orig);
 
@@ -168,9 +199,10 @@ public:
     /**
      * Builds the ImGui interface.
      * Should be called as soon as possible into the loop.
+     * @param snapshot What the simulation looks like this frame
      * @param dt Time elapsed since last calling. Used for state timeout
      */
-    void present(float dt);
+    void present(const Snapshot &snapshot, float dt);
 
     /**
      * Renders the UI onto the screen.
@@ -193,7 +225,7 @@ public:
     /**
      * View with knobs and switches for the random vehicle that the user selects.
      */
-    void showRandomVehicleView();
+    void showRandomVehicleView(const Snapshot &snapshot);
 
 };
 
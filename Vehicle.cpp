@@ -32,10 +32,14 @@
 
 /**
  * @file Vehicle.cpp
- * Implements this really brittle abstract class.
+ * Implements the vehicle handle and the logic shared by all vehicles.
  */
 
+#include <cmath>
 #include "Vehicle.h"
+#include "Lane.h"
+#include "RandomVehicle.h"
+#include "ACCVehicle.h"
 
 static Interval intSpeed(90 / 3.6f, 240 / 3.6f);
 static Interval intWidth(3.0, 3.2);
@@ -50,41 +54,116 @@ const float PANIC_DISTANCE = 10.0;
 
 const float MIN_A = -16;
 
-Vehicle::Vehicle(LaneChangeObserver *highway, float lane) : highway(highway), lane(lane) {
-    x = a = v = 0;
+Vehicle::Vehicle() : lane(nullptr), index(0) {
+}
+
+Vehicle::Vehicle(Lane *lane, size_t index) : lane(lane), index(index) {
+}
 
-    v = targetSpeed = intSpeed.uniform();
-    width = intWidth.normal();
-    length = intLength.normal();
-    targetDistance = intTargetDistance.uniform();
+VehicleData Vehicle::sample(float lane, RandomStream &random) {
+    VehicleData d;
+    d.id = NO_VEHICLE;
+    d.kind = VehicleKind::random;
+    d.lane = lane;
+    d.x = d.a = d.v = 0;
+
+    d.v = d.targetSpeed = intSpeed.uniform(random);
+    d.width = intWidth.normal(random);
+    d.length = intLength.normal(random);
+    d.targetDistance = intTargetDistance.uniform(random);
+
+    d.reactionTime = intReactionTime.uniform(random);
+    d.panicDistance = PANIC_DISTANCE;
+
+    d.terminalSpeed = intTerminalSpeed.normal(random);
+    d.maxAcceleration = intMaximumAcceleration.normal(random);
+
+    d.action = Action::none;
+    d.timeUntilNextAction = 0;
+    d.unsatisfied = false;
+    d.unsatisfiedTime = 0;
+    return d;
+}
 
-    reactionTime = intReactionTime.uniform();
-    panicDistance = PANIC_DISTANCE;
+VehicleId Vehicle::getId() const {
+    return lane->id[index];
+}
 
-    terminalSpeed = intTerminalSpeed.normal();
-    maxAcceleration = intMaximumAcceleration.normal();
+VehicleKind Vehicle::getKind() const {
+    return lane->kind[index];
+}
 
-    action = Action::none;
+float Vehicle::getTargetSpeed() const {
+    return lane->targetSpeed[index];
 }
 
+float Vehicle::getTargetDistance() const {
+    return lane->targetDistance[index];
+}
 
-Vehicle::Vehicle(const Vehicle &orig) :
-        x(orig.x), v(orig.v), a(orig.a), targetSpeed(orig.targetSpeed), targetDistance(orig.targetDistance),
-        width(orig.width), length(orig.length),
-        highway(orig.highway), lane(orig.lane), panicDistance(orig.panicDistance),
-        reactionTime(orig.reactionTime), terminalSpeed(orig.terminalSpeed), maxAcceleration(orig.maxAcceleration) {
+float Vehicle::getWidth() const {
+    return lane->width[index];
 }
 
-Vehicle::~Vehicle() {
+float Vehicle::getLength() const {
+    return lane->length[index];
 }
 
+double Vehicle::getX() const {
+    return lane->x[index];
+}
 
-bool Vehicle::operator<(const Vehicle &other) {
-    return x < other.x;
+double Vehicle::getInterpolatedX(float alpha) const {
+    return lane->interpolatedX(index, alpha);
+}
+
+float Vehicle::getV() const {
+    return lane->v[index];
+}
+
+float Vehicle::getLane() const {
+    return lane->lane[index];
+}
+
+void Vehicle::setAction(Action action, RandomStream &random) {
+    if (lane->kind[index] == VehicleKind::random) {
+        RandomVehicle::setAction(*lane, index, action, random);
+    } else {
+        lane->action[index] = action;
+    }
 }
 
-void Vehicle::step(float dt) {
-    float MAX_A = maxAcceleration * (1.0f - v / terminalSpeed);
+void Vehicle::setV(float v) {
+    lane->v[index] = v;
+}
+
+void Vehicle::setTargetSpeed(float targetSpeed, RandomStream &random) {
+    if (lane->kind[index] == VehicleKind::random) {
+        RandomVehicle::setTargetSpeed(*lane, index, targetSpeed, random);
+    } else {
+        lane->targetSpeed[index] = targetSpeed;
+    }
+}
+
+void Vehicle::setLane(float lane) {
+    this->lane->lane[index] = lane;
+}
+
+void Vehicle::setTargetDistance(float targetDistance, RandomStream &random) {
+    if (lane->kind[index] == VehicleKind::random) {
+        RandomVehicle::setTargetDistance(*lane, index, targetDistance, random);
+    } else {
+        lane->targetDistance[index] = targetDistance;
+    }
+}
+
+
+void Vehicle::integrate(Lane &l, size_t i, float dt) {
+    float v = l.v[i];
+    float a = l.a[i];
+    float lane = l.lane[i];
+
+    float MAX_A = l.maxAcceleration[i] * (1.0f - v / l.terminalSpeed[i]);
     if (std::abs(lane - std::round(lane)) > 0.02) {
         // We're during overtaking. We should limit
         // the acceleration to a moderate value
@@ -97,39 +176,74 @@ void Vehicle::step(float dt) {
 
     v += dt * a;
     if (v < 0) v = 0;
-    x += dt * v;
+    l.nextX[i] = l.x[i] + dt * v;
+    l.nextV[i] = v;
+    l.a[i] = a;
 }
 
-void Vehicle::think(const Neighbours *n) {
-    this->decideAcceleration(n);
+void Vehicle::step(Lane &l, size_t i, float dt) {
+    switch (l.kind[i]) {
+        case VehicleKind::acc:
+            ACCVehicle::step(l, i, dt);
+            break;
 
-    switch (action) {
-        case Action::change_lane_left:
-            if (this->canChangeLane(n->frontLeft, n->backLeft)) {
-                highway->notifyLaneChange(this, +1);
-                action = Action::none;
-            }
+        default:
+            RandomVehicle::step(l, i, dt);
             break;
+    }
+}
 
-        case Action::change_lane_right:
-            if (this->canChangeLane(n->frontRight, n->backRight)) {
-                highway->notifyLaneChange(this, -1);
-                action = Action::none;
-            }
+void Vehicle::think(Lane &l, size_t i, const Neighbours &n, VehicleObserver *highway) {
+    switch (l.kind[i]) {
+        case VehicleKind::acc:
+            ACCVehicle::think(l, i, n, highway);
             break;
 
         default:
+            RandomVehicle::think(l, i, n, highway);
             break;
     }
 }
 
+void Vehicle::decideAcceleration(Lane &l, size_t i, const Target &front) {
+    switch (l.kind[i]) {
+        case VehicleKind::acc:
+            ACCVehicle::decideAcceleration(l, i, front);
+            break;
 
+        default:
+            RandomVehicle::decideAcceleration(l, i, front);
+            break;
+    }
+}
 
+bool Vehicle::canChangeLane(const Lane &l, size_t i, const Target &front, const Target &back) {
+    switch (l.kind[i]) {
+        case VehicleKind::acc:
+            return ACCVehicle::canChangeLane(l, i, front, back);
 
+        default:
+            return RandomVehicle::canChangeLane(l, i, front, back);
+    }
+}
 
+void Vehicle::applyAction(Lane &l, size_t i, const Neighbours &n, VehicleObserver *highway) {
+    switch (l.action[i]) {
+        case Action::change_lane_left:
+            if (n.left && canChangeLane(l, i, n.frontLeft, n.backLeft)) {
+                highway->notifyLaneChange(l.id[i], +1);
+                l.action[i] = Action::none;
+            }
+            break;
 
+        case Action::change_lane_right:
+            if (n.right && canChangeLane(l, i, n.frontRight, n.backRight)) {
+                highway->notifyLaneChange(l.id[i], -1);
+                l.action[i] = Action::none;
+            }
+            break;
 
-
-
-
-
+        default:
+            break;
+    }
+}
@@ -34,59 +34,76 @@
 #define VEHICLE_H
 
 /**
- * @file Vehicle.cpp
- * Implements this really brittle abstract class.
+ * @file Vehicle.h
+ * Vehicle data, the shared driving logic and the handle used to poke at a single vehicle.
  */
 
+#include <cstddef>
+#include <cstdint>
 #include "Interval.h"
 #include "Neighbours.h"
 
 
-enum class Action {
+enum class Action : uint8_t {
     none,
     change_lane_left,
     change_lane_right
 };
 
-class Vehicle;
-
 /**
- * Observer callback for the highway.
+ * Selects the driving logic used for a vehicle.
  */
-class LaneChangeObserver {
-public:
-    virtual void notifyLaneChange(Vehicle *v, int direction) = 0;
+enum class VehicleKind : uint8_t {
+    random,
+    acc
 };
 
-class Vehicle {
-public:
-    Vehicle(LaneChangeObserver *highway, float lane);
+/**
+ * Identifies a vehicle for its whole life.
+ * Unlike the slot in a Lane, it doesn't change when the lane is sorted or when the vehicle changes lanes.
+ */
+typedef uint32_t VehicleId;
 
-    Vehicle(const Vehicle &orig);
+/**
+ * Marks the absence of a vehicle.
+ */
+const VehicleId NO_VEHICLE = UINT32_MAX;
 
-    virtual ~Vehicle();
+class Lane;
+
+/**
+ * Observer callback for the highway.
+ * Vehicles report here the decisions that touch more than their own state,
+ * so the highway can carry them out in a fixed order.
+ */
+class VehicleObserver {
+public:
+    virtual void notifyLaneChange(VehicleId v, int direction) = 0;
 
     /**
-     * Decide actions based on the neighbours and on internal state.
+     * Random numbers for the vehicle's own choices in this step, such as RandomVehicle::act.
+     * Keyed by the seed, the vehicle and the step, so they don't depend on which thread asks.
      */
-    virtual void think(const Neighbours *n);
+    virtual RandomStream dice(VehicleId v) = 0;
+};
 
+/**
+ * Every field of a single vehicle, in one place.
+ * The lanes store each field in its own array; this is used to create vehicles and move them around.
+ */
+struct VehicleData {
     /**
-     * Advance the car's state using euler integration.
+     * Stable identifier, assigned by the highway.
      */
-    virtual void step(float dt);
-
+    VehicleId id;
     /**
-     * Compares X coordinates. Used for sorting.
+     * Which driving logic to apply.
      */
-    virtual bool operator<(const Vehicle &other);
-
-protected:
-
+    VehicleKind kind;
     /**
-     * Position on the road.
+     * Position on the road. Double, because long highways go well past float precision.
      */
-    float x;
+    double x;
     /**
      * Speed, in m/s.
      */
@@ -111,17 +128,13 @@ protected:
      * Vehicle height, in meters.
      */
     float length;
-    /**
-     * The object that is notified when the vehicle wants to change lane.
-     */
-    LaneChangeObserver *highway;
     /**
      * The current lane. Has non-int values when it's currently changing lanes.
+     * lane = 0 is the rightmost position.
      */
     float lane;
     /**
      * Distance to the front when maximum breaking is applied.
-     * lane = 0 is the rightmost position.
      */
     float panicDistance;
     /**
@@ -135,76 +148,128 @@ protected:
     /**
      * The maximum acceleration this vehicle can reach.
      * Maximum acceleration decreases linearly with speed.
-     *
      */
     float maxAcceleration;
-
     /**
      * Next desired action.
      * This field is changed to request a lane change.
      */
     Action action;
-
     /**
-     * Decides what acceleration this vehicle will try to apply.
+     * RandomVehicle only: time until the vehicle does another random thing.
      */
-    virtual void decideAcceleration(const Neighbours *n) = 0;
-
+    float timeUntilNextAction;
     /**
-     * Decides if the vehicle can change lane.
-     * @param front The vehicle in front of this one, on the target lane.
-     * @param back The vehicle in the back of this one, on the target lane.
+     * ACCVehicle only: marks if the vehicle is currently slowed down by traffic.
+     */
+    bool unsatisfied;
+    /**
+     * ACCVehicle only: marks for how long the vehicle has been slowed down by traffic.
      */
-    virtual bool canChangeLane(Target *front, Target *back) = 0;
+    float unsatisfiedTime;
+};
 
+/**
+ * Handle to a vehicle stored in a Lane, used by the UI to read and change a single vehicle.
+ * The vehicle logic itself works on whole lanes, through the static functions.
+ *
+ * A handle is only good until the lane is sorted or changed, so don't keep it between steps;
+ * keep the VehicleId instead.
+ */
+class Vehicle {
 public:
-    float getTargetSpeed() const {
-        return targetSpeed;
-    }
+    Vehicle();
 
-    float getTargetDistance() const {
-        return targetDistance;
-    }
+    Vehicle(Lane *lane, size_t index);
 
-    float getWidth() const {
-        return width;
+    /**
+     * False for the handle of a vehicle that doesn't exist.
+     */
+    bool valid() const {
+        return lane != nullptr;
     }
 
-    float getLength() const {
-        return length;
-    }
+    VehicleId getId() const;
 
-    float getX() const {
-        return x;
-    }
+    VehicleKind getKind() const;
 
-    float getV() const {
-        return v;
-    }
+    float getTargetSpeed() const;
 
-    virtual void setAction(Action action) {
-        this->action = action;
-    }
+    float getTargetDistance() const;
 
-    void setV(float v) {
-        this->v = v;
-    }
+    float getWidth() const;
 
-    virtual void setTargetSpeed(float targetSpeed) {
-        this->targetSpeed = targetSpeed;
-    }
+    float getLength() const;
 
-    void setLane(float lane) {
-        this->lane = lane;
-    }
+    double getX() const;
 
-    float getLane() const {
-        return lane;
-    }
+    /**
+     * Position a fraction alpha of the way through the last step, see Lane::interpolatedX.
+     */
+    double getInterpolatedX(float alpha) const;
 
-    virtual void setTargetDistance(float targetDistance) {
-        this->targetDistance = targetDistance;
-    }
+    float getV() const;
+
+    float getLane() const;
+
+    /**
+     * Orders a lane change. Random vehicles hold onto it for a while, timed with the given stream.
+     */
+    void setAction(Action action, RandomStream &random);
+
+    void setV(float v);
+
+    void setTargetSpeed(float targetSpeed, RandomStream &random);
+
+    void setLane(float lane);
+
+    void setTargetDistance(float targetDistance, RandomStream &random);
+
+    /**
+     * Samples the physical profile of a new vehicle. The position is left at 0.
+     */
+    static VehicleData sample(float lane, RandomStream &random);
+
+    /**
+     * Decide actions based on the neighbours and on internal state.
+     * The acceleration is decided before, see Vehicle::decideAcceleration.
+     */
+    static void think(Lane &lane, size_t i, const Neighbours &n, VehicleObserver *highway);
+
+    /**
+     * Advance the car's state using euler integration.
+     * Writes the new position and speed to the lane's next state, see Lane::beginStep.
+     */
+    static void step(Lane &lane, size_t i, float dt);
+
+    /**
+     * Decides what acceleration this vehicle will try to apply.
+     * The scalar reference for AccelerationKernel, which does this for many vehicles at once.
+     * @param front The vehicle in front of this one.
+     */
+    static void decideAcceleration(Lane &lane, size_t i, const Target &front);
+
+    /**
+     * Decides if the vehicle can change lane.
+     * @param front The vehicle in front of this one, on the target lane.
+     * @param back The vehicle in the back of this one, on the target lane.
+     */
+    static bool canChangeLane(const Lane &lane, size_t i, const Target &front, const Target &back);
+
+    /**
+     * Carries out the lane change in Vehicle::action, if it's safe.
+     */
+    static void applyAction(Lane &lane, size_t i, const Neighbours &n, VehicleObserver *highway);
+
+    /**
+     * The physics shared by all vehicles: clamps the acceleration and integrates speed and position.
+     * The new speed and position go to Lane::nextV and Lane::nextX; the current ones are only read.
+     */
+    static void integrate(Lane &lane, size_t i, float dt);
+
+private:
+    Lane *lane;
+    size_t index;
 };
 
 /**
@@ -217,4 +282,3 @@ int sgn(T val) {
 }
 
 #endif /* VEHICLE_H */
-
@@ -0,0 +1,118 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file WarmStart.cpp
+ * @brief Cache of stabilised highways
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include "WarmStart.h"
+#include "Checkpoint.h"
+#include "Error.h"
+#include "Highway.h"
+
+/**
+ * Bumped whenever the vehicles or the step change, so caches made before don't get picked up.
+ */
+const uint32_t MODEL_VERSION = 1;
+
+namespace {
+
+/**
+ * FNV-1a, over the bytes of each value.
+ */
+struct KeyHash {
+    uint64_t hash = 14695981039346656037ull;
+
+    template<typename T>
+    void add(const T &value) {
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&value);
+        for (size_t i = 0; i < sizeof(T); i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    }
+};
+
+}
+
+uint64_t WarmStart::key(const HighwayConfig &config) {
+    KeyHash k;
+    k.add(MODEL_VERSION);
+    k.add(config.lanes);
+    k.add(config.vehiclesPerLane);
+    k.add(config.accRatio);
+    k.add(config.teleportDistance);
+    k.add(config.ringLength);
+    k.add(config.maxViewDistance);
+    k.add(config.stabiliseSteps);
+    k.add(config.seed);
+    return k.hash;
+}
+
+std::string WarmStart::path(const HighwayConfig &config) {
+    if (config.warmStartDir.empty() || config.seed == 0) {
+        return "";
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "/warm-%016llx.state", (unsigned long long) key(config));
+    return config.warmStartDir + name;
+}
+
+bool WarmStart::load(Highway &highway) {
+    std::string file = path(highway.getConfig());
+    if (file.empty() || !std::ifstream(file.c_str())) {
+        // Nothing cached yet
+        return false;
+    }
+    try {
+        Checkpoint::load(highway, file, key(highway.getConfig()));
+        return true;
+    } catch (const Error &e) {
+        std::cerr << e.what() << ", stabilising instead" << std::endl;
+        return false;
+    }
+}
+
+void WarmStart::save(const Highway &highway) {
+    std::string file = path(highway.getConfig());
+    if (file.empty()) {
+        return;
+    }
+    try {
+        Checkpoint::save(highway, file, key(highway.getConfig()));
+    } catch (const Error &e) {
+        std::cerr << e.what() << std::endl;
+    }
+}
@@ -0,0 +1,79 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LEC_ACC_CPP_WARMSTART_H
+#define LEC_ACC_CPP_WARMSTART_H
+
+/**
+ * @file WarmStart.h
+ * @brief Cache of stabilised highways
+ */
+
+#include <cstdint>
+#include <string>
+#include "HighwayConfig.h"
+
+class Highway;
+
+/**
+ * Keeps the state of a highway right after Highway::stabilise in HighwayConfig::warmStartDir,
+ * so the next launch with the same configuration and seed loads it instead of stepping all over again.
+ * See Checkpoint for the file.
+ */
+class WarmStart {
+public:
+    /**
+     * Key of everything that decides how a highway looks once stabilised: its size and tuning, and the seed.
+     * The number of threads doesn't matter, a run plays out the same on any.
+     */
+    static uint64_t key(const HighwayConfig &config);
+
+    /**
+     * File the stabilised highway is cached in. Empty if it isn't cached:
+     * there's no HighwayConfig::warmStartDir, or the seed changes on every run.
+     */
+    static std::string path(const HighwayConfig &config);
+
+    /**
+     * Loads the cached state into a highway that was just made.
+     * @return false if there's nothing cached for its configuration, or it can't be read.
+     */
+    static bool load(Highway &highway);
+
+    /**
+     * Caches the state of a highway that was just stabilised.
+     * Failing to is reported, but isn't an error: the next launch stabilises again.
+     */
+    static void save(const Highway &highway);
+};
+
+#endif
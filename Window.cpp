@@ -39,8 +39,11 @@
 #include <iostream>
 #include <GLFW/glfw3.h>
 #include <map>
+#include <cmath>
 #include <complex>
 #include "Error.h"
+#include "PerfCounters.h"
+#include "Trace.h"
 #include "Window.h"
 
 /**
@@ -65,6 +68,23 @@ static void global_mouse_button_callback(GLFWwindow *window, int button, int act
 }
 
 void Window::key_callback(int key, int, int action, int) {
+    Replay *replay = simulation.replaying();
+    if (replay != nullptr && (action == GLFW_PRESS || action == GLFW_REPEAT)) {
+        switch (key) {
+            case GLFW_KEY_SPACE:
+                replay->setPaused(!replay->paused());
+                break;
+            case GLFW_KEY_LEFT:
+            case GLFW_KEY_RIGHT:
+                // One recorded step at a time
+                replay->setPaused(true);
+                replay->seek(std::round(replay->position()) + (key == GLFW_KEY_LEFT ? -1 : 1));
+                break;
+            default:
+                break;
+        }
+    }
+
     if (action == GLFW_PRESS || action == GLFW_REPEAT) {
         switch (key) {
             case GLFW_KEY_Q:
@@ -88,7 +108,19 @@ void Window::key_callback(int key, int, int action, int) {
 }
 
 
-Window::Window(Highway &high) : highway(high) {
+Window::Window(Highway &high) :
+        highway(&high),
+        simulation(high) {
+    open();
+}
+
+Window::Window(Replay &replay) :
+        highway(nullptr),
+        simulation(replay) {
+    open();
+}
+
+void Window::open() {
     if (window_reference_count > 0) {
         throw Error("Only one Window is permitted!");
     } else {
@@ -116,7 +148,7 @@ Window::Window(Highway &high) : highway(high) {
     }
     glfwMakeContextCurrent(window);
 
-    presenter = new UIPresenter(highway, window, this);
+    presenter = new UIPresenter(highway, simulation, window, this);
 
     activeWindows[window] = this;
     glfwSetKeyCallback(window, global_key_callback);
@@ -138,12 +170,22 @@ float Window::timeElapsed() {
 
 void Window::start() {
     float last = timeElapsed() - 1.0f / 60.0f;
+    simulation.start();
 
     while (!glfwWindowShouldClose(window)) {
+        ACC_TRACE_SCOPE("Frame");
         glfwPollEvents();
         float now = timeElapsed();
 
-        presenter->present(now - last);
+        // Steps here only without a simulation thread
+        simulation.advance(now - last);
+        // The UI and the road show the same snapshot
+        const Snapshot &snapshot = simulation.acquire();
+
+        {
+            ACC_TRACE_SCOPE("UIPresenter::present");
+            presenter->present(snapshot, now - last);
+        }
 
         glfwGetFramebufferSize(window, &width, &height);
         glViewport(0, 0, width, height);
@@ -151,15 +193,22 @@ void Window::start() {
         glClearColor(0.0, 0.4, 0.0, 1.0);
         glClear(GL_COLOR_BUFFER_BIT);
 
-        highway.step(now - last);
-        draw(width, height);
+        {
+            ACC_PERF_REGION(PerfRegion::draw);
+            ACC_TRACE_SCOPE("Window::draw");
+            draw(snapshot, width, height);
+        }
 
         last = now;
 
         presenter->render();
 
-        glfwSwapBuffers(window);
+        {
+            ACC_TRACE_SCOPE("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+        }
     }
+    simulation.stop();
 }
 
 
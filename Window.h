@@ -40,6 +40,7 @@
 
 #include <GLFW/glfw3.h>
 #include "Highway.h"
+#include "Simulation.h"
 #include "UIPresenter.h"
 #include <chrono>
 
@@ -51,6 +52,11 @@ public:
 
     Window(Highway &high);
 
+    /**
+     * A window that plays back a recording instead.
+     */
+    Window(Replay &replay);
+
     /**
      * Propagates the GLFW3 key callback to the UIPresenter and the app logic
      */
@@ -63,9 +69,15 @@ public:
      */
     void start();
 
-    virtual void draw(int width, int height) = 0;
+    /**
+     * Draws the road as it is in a snapshot, the one the UI shows this frame.
+     */
+    virtual void draw(const Snapshot &snapshot, int width, int height) = 0;
 
-    Highway &highway;
+    /**
+     * The highway stepped, or nullptr when playing back a recording.
+     */
+    Highway *highway;
 
     UIPresenter *presenter;
 
@@ -77,6 +89,12 @@ protected:
      */
     std::chrono::system_clock::time_point startTime;
 
+    /**
+     * Steps the highway, on its own thread if it has one. The window draws its snapshots,
+     * and sends it the user's orders.
+     */
+    Simulation simulation;
+
     /**
      * Lane width in meters
      */
@@ -96,6 +114,11 @@ private:
 
     float timeElapsed();
 
+    /**
+     * Opens the window, once the simulation is set up.
+     */
+    void open();
+
 };
 
 #endif /* USERINTERFACE_H */
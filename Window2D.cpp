@@ -35,9 +35,11 @@
  * @brief Implementation for a 2D view of the highway
  */
 
+#include <algorithm>
 #include <iostream>
 #include <SOIL.h>
 #include <iomanip>
+#include <cmath>
 #include "Window.h"
 #include "Window2D.h"
 
@@ -52,6 +54,11 @@ const int GUIDE_LENGTH = 8;
  */
 const int N_TEXTURES = 7;
 
+/**
+ * Road copied beyond the edges of the screen, in meters, so the vehicles there are drawn whole.
+ */
+const double VIEW_MARGIN = 50;
+
 /**
  * Used to choose the texture for a given car.
  */
@@ -67,25 +74,26 @@ void Window2D::drawRect(float left, float right, float bottom, float top) {
 };
 
 
-std::pair<float, float> Window2D::roadLimits() {
+std::pair<double, double> Window2D::roadLimits() {
     return std::make_pair(centerX + maxLeft / ratio - 10, centerX + maxRight / ratio + 10);
 };
 
 
-void Window2D::drawVehicle(Vehicle *const v) {
-    Point center = roadToScreenCoordinates(Point(v->getX(), v->getLane()));
-    auto find = textureMap.find(v);
+void Window2D::drawVehicle(const LaneSnapshot &lane, size_t i, float alpha) {
+    Point center = roadToScreenCoordinates(Point(lane.interpolatedX(i, alpha), lane.lane[i]));
+    VehicleId id = lane.id[i];
+    auto find = textureMap.find(id);
     if (find == textureMap.end()) {
-        textureMap[v] = textures[(int) (one.uniform() * N_TEXTURES)];
+        textureMap[id] = textures[(int) (one.uniform() * N_TEXTURES)];
     }
 
-    glBindTexture(GL_TEXTURE_2D, textureMap.at(v));
+    glBindTexture(GL_TEXTURE_2D, textureMap.at(id));
     float left, right, bottom, top;
 
-    left = center.x - ratio * v->getLength() / 2;
-    right = center.x + ratio * v->getLength() / 2;
-    bottom = center.y - ratio * v->getWidth() / 2;
-    top = center.y + ratio * v->getWidth() / 2;
+    left = center.x - ratio * lane.length[i] / 2;
+    right = center.x + ratio * lane.length[i] / 2;
+    bottom = center.y - ratio * lane.width[i] / 2;
+    top = center.y + ratio * lane.width[i] / 2;
 
 
     glBegin(GL_QUADS);
@@ -103,37 +111,38 @@ void Window2D::drawVehicle(Vehicle *const v) {
 
 }
 
-void Window2D::markVehicle(const Vehicle *v, float red, float green, float blue) {
+void Window2D::markVehicle(const Snapshot &snapshot, const VehicleSnapshot &v, float alpha,
+                           float red, float green, float blue) {
     glColor3f(red, green, blue);
 
     const float THICKNESS = 15.0f;
     glLineWidth(THICKNESS / zoom);
     glBegin(GL_LINE_LOOP);
     {
-        Point center = roadToScreenCoordinates(Point(v->getX(), v->getLane()));
-        drawRect(center.x - ratio * v->getLength() / 1.6f,
-                 center.x + ratio * v->getLength() / 1.6f,
-                 center.y - ratio * v->getWidth() / 1.6f,
-                 center.y + ratio * v->getWidth() / 1.6f);
+        double x = snapshot.unwrap(v.interpolatedX(alpha), centerX);
+        Point center = roadToScreenCoordinates(Point(x, v.lane));
+        drawRect(center.x - ratio * v.length / 1.6f,
+                 center.x + ratio * v.length / 1.6f,
+                 center.y - ratio * v.width / 1.6f,
+                 center.y + ratio * v.width / 1.6f);
     }
     glEnd();
     glLineWidth(1.0f);
 }
 
-void Window2D::drawVehicles(const std::deque<Vehicle *> vs) {
-    std::pair<float, float> cameraLimits = roadLimits();
-    auto it = vs.begin();
-    while (it != vs.end() && (*it)->getX() < cameraLimits.first) ++it;
+void Window2D::drawVehicles(const LaneSnapshot &lane, float alpha) {
+    std::pair<double, double> cameraLimits = roadLimits();
+    size_t i = std::lower_bound(lane.x.begin(), lane.x.end(), cameraLimits.first) - lane.x.begin();
 
-    while (it != vs.end() && (*it)->getX() < cameraLimits.second) {
-        drawVehicle(*it);
-        ++it;
+    while (i < lane.size() && lane.x[i] < cameraLimits.second) {
+        drawVehicle(lane, i, alpha);
+        ++i;
     }
 }
 
-void Window2D::drawDash(float xMeters, float lane, float thickness) {
+void Window2D::drawDash(double xMeters, float lane, float thickness) {
     // round to nearest guide_length
-    xMeters = int((xMeters) / GUIDE_LENGTH) * GUIDE_LENGTH;
+    xMeters = std::floor(xMeters / GUIDE_LENGTH) * GUIDE_LENGTH;
     Point center = roadToScreenCoordinates(Point(xMeters - lane * lane * 3, lane));
 
     float step = ratio * GUIDE_LENGTH;
@@ -143,7 +152,7 @@ void Window2D::drawDash(float xMeters, float lane, float thickness) {
     }
 }
 
-void Window2D::draw(int width, int height) {
+void Window2D::draw(const Snapshot &snapshot, int width, int height) {
 
     maxLeft = -zoom * width / height;
     maxRight = zoom * width / height;
@@ -154,8 +163,15 @@ void Window2D::draw(int width, int height) {
     glMatrixMode(GL_MODELVIEW);
 
 
+    float alpha = snapshot.alphaNow();
+
     float front = maxRight / ratio / 2.5f;
-    centerX = (highway.preferredVehicle->getX()) + front;
+    double accX = snapshot.preferred.interpolatedX(alpha);
+    centerX = accX + front;
+
+    // Ask for what's on screen next time, with some room for the vehicles' length
+    std::pair<double, double> cameraLimits = roadLimits();
+    simulation.setView(accX - cameraLimits.first + VIEW_MARGIN, cameraLimits.second - accX + VIEW_MARGIN);
     foliage->draw(centerX);
 
     glBegin(GL_QUADS);
@@ -164,11 +180,11 @@ void Window2D::draw(int width, int height) {
         drawRect(maxLeft, maxRight, -1, 1);
 
         glColor3f(0.9, 0.9, 0.9);
-        float thickness = 0.1f / highway.lanes.size();
+        float thickness = 0.1f / lanes;
         drawRect(maxLeft, maxRight, 0.99f - thickness, 0.99f);
         drawRect(maxLeft, maxRight, -0.99f, -0.99f + thickness);
 
-        for (uint i = 0; i < highway.lanes.size() - 1; i++) {
+        for (uint i = 0; i < lanes - 1; i++) {
             drawDash(centerX, i + 0.5f, thickness);
         }
 
@@ -184,16 +200,16 @@ void Window2D::draw(int width, int height) {
 
     glColor3f(1.0, 1.0, 1.0);
 
-    for (uint i = 0; i < highway.lanes.size(); i++) {
-        drawVehicles(highway.lanes[i]->vehicles);
+    for (const LaneSnapshot &lane: snapshot.lanes) {
+        drawVehicles(lane, alpha);
     }
     glDisable(GL_TEXTURE_2D);
 
 
-    if (highway.selectedVehicle != nullptr) {
-        markVehicle(highway.selectedVehicle, 1.0, 0.3, 0.3);
+    if (snapshot.selected.id != NO_VEHICLE) {
+        markVehicle(snapshot, snapshot.selected, alpha, 1.0, 0.3, 0.3);
     }
-    markVehicle(highway.preferredVehicle, 0.3, 1.0, 0.4);
+    markVehicle(snapshot, snapshot.preferred, alpha, 0.3, 1.0, 0.4);
 }
 
 void Window2D::zoomIn() {
@@ -207,9 +223,18 @@ void Window2D::zoomOut() {
 }
 
 Window2D::Window2D(Highway &highway) : Window(highway), zoom(4.5) {
-    ratio = 2 / (highway.lanes.size() * LANE_WIDTH);
-    centerX = highway.preferredVehicle->getX();
-    foliage = new Foliage2D(ratio, highway.preferredVehicle->getX());
+    init();
+}
+
+Window2D::Window2D(Replay &replay) : Window(replay), zoom(4.5) {
+    init();
+}
+
+void Window2D::init() {
+    lanes = simulation.current().lanes.size();
+    ratio = 2 / (lanes * LANE_WIDTH);
+    centerX = simulation.current().preferred.x;
+    foliage = new Foliage2D(ratio, centerX);
 
     initTextures();
 }
@@ -245,11 +270,11 @@ Point Window2D::pixelToRoadCoordinates(Point pixelCoords) {
     pixelCoords.y *= zoom;
 
     Point screen(pixelCoords);
-    float lane = (float) ((highway.lanes.size() - 1.0f) / 2.0f + screen.y / (LANE_WIDTH * ratio));
-    return Point(centerX + screen.x / ratio, highway.lanes.size() - 1 - std::round(lane));
+    double lane = (lanes - 1.0f) / 2.0f + screen.y / (LANE_WIDTH * ratio);
+    return Point(centerX + screen.x / ratio, lanes - 1 - std::round(lane));
 }
 
 Point Window2D::roadToScreenCoordinates(Point roadCoords) {
     return Point((roadCoords.x - centerX) * ratio,
-                 LANE_WIDTH * ratio * (roadCoords.y - (highway.lanes.size() - 1.0f) / 2));
+                 LANE_WIDTH * ratio * (roadCoords.y - (lanes - 1.0f) / 2));
 }
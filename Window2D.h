@@ -48,14 +48,17 @@
 class Window2D : public Window {
 private:
 
-    void drawVehicle(Vehicle *const v);
+    /**
+     * Draws the vehicle in slot i of the lane, a fraction alpha of the way through the last step.
+     */
+    void drawVehicle(const LaneSnapshot &lane, size_t i, float alpha);
     /**
      * Draws a dash separating two lanes.
      * @param xMeters the left hand side of the screen
      * @param yScreen center line
      * @param thickness In screen coords
      */
-    void drawDash(float xMeters, float yScreen, float thickness);
+    void drawDash(double xMeters, float yScreen, float thickness);
     /**
      * Draws an opengl rect (in screen coords) using glVertex2f.
      */
@@ -63,23 +66,27 @@ private:
 
     /**
      * Draws a rectangle around the given vehicle
+     * @param snapshot The snapshot being drawn
      * @param v The on-screen vehicle
+     * @param alpha How far through the last step to draw it
      * @param red
      * @param green
      * @param blue
      */
-    void markVehicle(const Vehicle *v, float red, float green, float blue);
+    void markVehicle(const Snapshot &snapshot, const VehicleSnapshot &v, float alpha,
+                     float red, float green, float blue);
 
     /**
      * Returns left and right margins shown on the screen, in meters (road coords).
      */
-    std::pair<float, float> roadLimits();
+    std::pair<double, double> roadLimits();
 
     /**
      * Draws all the vehicles on this given lane
-     * @param vs Sorted vehicle deque. Drawing will be done only for the vehicles on screen.
+     * @param lane Sorted lane, as copied by the simulation. Drawing will be done only for the vehicles on screen.
+     * @param alpha How far through the last step to draw them
      */
-    void drawVehicles(const std::deque<Vehicle *> vs);
+    void drawVehicles(const LaneSnapshot &lane, float alpha);
 
     /**
      * Number of meters for a given
@@ -89,7 +96,7 @@ private:
     /**
      * Current center of the screen, in meters.
      */
-    float centerX;
+    double centerX;
 
     /**
      * Random triangle generator.
@@ -99,7 +106,7 @@ private:
     /**
      * Maps each vehicle to its texture ID.
      */
-    std::unordered_map<Vehicle *, GLuint> textureMap;
+    std::unordered_map<VehicleId, GLuint> textureMap;
 
     /**
      * Texture list.
@@ -112,6 +119,16 @@ private:
      */
     void initTextures();
 
+    /**
+     * Number of lanes on the road.
+     */
+    size_t lanes;
+
+    /**
+     * Sets up the view, once the simulation is set up.
+     */
+    void init();
+
 protected:
 
     virtual void zoomIn() override;
@@ -127,10 +144,15 @@ protected:
     float zoom;
 
 public:
-    virtual void draw(int width, int height) override;
+    virtual void draw(const Snapshot &snapshot, int width, int height) override;
 
     Window2D(Highway &highway);
 
+    /**
+     * Plays back a recording instead of stepping a highway.
+     */
+    Window2D(Replay &replay);
+
     virtual ~Window2D() override;
 };
 
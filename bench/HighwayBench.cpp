@@ -0,0 +1,381 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file HighwayBench.cpp
+ * @brief Benchmarks for the simulation core, with JSON output
+ */
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "AccelerationKernel.h"
+#include "Error.h"
+#include "Highway.h"
+
+/**
+ * One highway shape to run the benchmarks on.
+ */
+struct BenchCase {
+    int lanes;
+    int vehiclesPerLane;
+    float accRatio;
+};
+
+/**
+ * Timing of one benchmark on one case.
+ */
+struct BenchResult {
+    std::string name;
+    bool hasCase;
+    BenchCase shape;
+    long iterations;
+    double nsPerOp;
+
+    /**
+     * Time per vehicle, for the benchmarks that go over the whole highway. Negative otherwise.
+     */
+    double nsPerVehicleStep;
+
+    /**
+     * Extra JSON fields, already formatted, with a leading comma.
+     */
+    std::string extra;
+};
+
+/**
+ * Options of a benchmark run.
+ */
+struct BenchOptions {
+    std::vector<int> lanes = {1, 3, 8};
+    std::vector<int> vehiclesPerLane = {1000, 10000};
+    std::vector<float> accRatios = {0.0f, 0.5f};
+    int steps = 200;
+    int seed = 1;
+    int threads = 1;
+    std::string output;
+};
+
+/**
+ * Steps before anything is timed, so the vehicles are spread out and the buffers allocated.
+ */
+const int WARMUP_STEPS = 30;
+
+const float BENCH_DT = 1.0f / 60.0f;
+
+/**
+ * Samples drawn by the Interval benchmarks.
+ */
+const long INTERVAL_SAMPLES = 1000000;
+
+typedef std::chrono::steady_clock Clock;
+
+static double nsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+/**
+ * Keeps the compiler from optimising away the results we time.
+ */
+static volatile float sink;
+
+/**
+ * Runs the benchmarks. A friend of Highway, so it can time the phases of the step one by one.
+ */
+class HighwayBench {
+public:
+    static void runCase(const BenchOptions &options, const BenchCase &c, std::vector<BenchResult> &results);
+
+    static void runInterval(std::vector<BenchResult> &results);
+
+private:
+    static size_t vehicleCount(const Highway &h) {
+        size_t n = 0;
+        for (const Lane *l: h.lanes) {
+            n += l->size();
+        }
+        return n;
+    }
+
+    static BenchResult result(const std::string &name, const BenchCase &c, long iterations, double ns,
+                              double vehicleSteps) {
+        BenchResult r;
+        r.name = name;
+        r.hasCase = true;
+        r.shape = c;
+        r.iterations = iterations;
+        r.nsPerOp = ns / iterations;
+        r.nsPerVehicleStep = vehicleSteps > 0 ? ns / vehicleSteps : -1;
+        return r;
+    }
+};
+
+void HighwayBench::runCase(const BenchOptions &options, const BenchCase &c, std::vector<BenchResult> &results) {
+    HighwayConfig config;
+    config.lanes = c.lanes;
+    config.vehiclesPerLane = c.vehiclesPerLane;
+    config.accRatio = c.accRatio;
+    config.seed = options.seed;
+    config.threads = options.threads;
+    config.validate();
+
+    Highway h(config);
+    for (int i = 0; i < WARMUP_STEPS; i++) {
+        h.step(BENCH_DT);
+    }
+
+    // The whole step
+    double vehicleSteps = 0;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < options.steps; i++) {
+        h.step(BENCH_DT);
+        vehicleSteps += vehicleCount(h);
+    }
+    results.push_back(result("Highway::step", c, options.steps, nsSince(start), vehicleSteps));
+
+    // Sorting the lanes after a step, and teleporting: each timed right after a step, untimed
+    double sortNs = 0, teleportNs = 0;
+    vehicleSteps = 0;
+    for (int i = 0; i < options.steps; i++) {
+        h.step(BENCH_DT);
+        vehicleSteps += vehicleCount(h);
+
+        start = Clock::now();
+        h.sort();
+        sortNs += nsSince(start);
+
+        start = Clock::now();
+        h.teleportVehicles();
+        teleportNs += nsSince(start);
+    }
+    results.push_back(result("Highway::sort", c, options.steps, sortNs, vehicleSteps));
+    results.push_back(result("Highway::teleportVehicles", c, options.steps, teleportNs, vehicleSteps));
+
+    // The vehicle in front, for every vehicle
+    std::vector<std::vector<float> > dist(h.lanes.size()), vRel(h.lanes.size());
+    long targets = 0;
+    float sum = 0;
+    start = Clock::now();
+    for (size_t li = 0; li < h.lanes.size(); li++) {
+        const Lane &l = *h.lanes[li];
+        dist[li].resize(l.size());
+        vRel[li].resize(l.size());
+        for (size_t i = 0; i + 1 < l.size(); i++) {
+            Target t = h.target(l, i, l, i + 1);
+            dist[li][i] = t.dist;
+            vRel[li][i] = t.vRel;
+            sum += t.dist;
+            targets++;
+        }
+        // Nobody in front of the last one
+        dist[li].back() = 1e6f;
+        vRel[li].back() = 0;
+    }
+    sink = sum;
+    results.push_back(result("Highway::target", c, targets, nsSince(start), -1));
+
+    // Acceleration kernels, on copies of the lanes so both start from the same state
+    std::vector<Lane> scalarLanes, simdLanes;
+    for (const Lane *l: h.lanes) {
+        scalarLanes.push_back(*l);
+        simdLanes.push_back(*l);
+    }
+    size_t vehicles = vehicleCount(h);
+
+    start = Clock::now();
+    for (int i = 0; i < options.steps; i++) {
+        for (size_t li = 0; li < scalarLanes.size(); li++) {
+            AccelerationKernel::runScalar(scalarLanes[li], 0, scalarLanes[li].size(), dist[li].data(), vRel[li].data());
+        }
+    }
+    results.push_back(result("AccelerationKernel::runScalar", c, options.steps, nsSince(start),
+                             (double) vehicles * options.steps));
+
+    start = Clock::now();
+    for (int i = 0; i < options.steps; i++) {
+        for (size_t li = 0; li < simdLanes.size(); li++) {
+            AccelerationKernel::run(simdLanes[li], 0, simdLanes[li].size(), dist[li].data(), vRel[li].data());
+        }
+    }
+    BenchResult simd = result("AccelerationKernel::run", c, options.steps, nsSince(start),
+                              (double) vehicles * options.steps);
+
+    // The kernel must agree with the scalar code bit for bit
+    bool matches = true;
+    for (size_t li = 0; li < simdLanes.size(); li++) {
+        const Lane &a = simdLanes[li], &b = scalarLanes[li];
+        matches = matches && std::memcmp(a.a.data(), b.a.data(), a.size() * sizeof(float)) == 0
+                  && a.unsatisfied == b.unsatisfied;
+    }
+    simd.extra = std::string(", \"instructionSet\": \"") + AccelerationKernel::instructionSet()
+                 + "\", \"matchesScalar\": " + (matches ? "true" : "false");
+    results.push_back(simd);
+}
+
+void HighwayBench::runInterval(std::vector<BenchResult> &results) {
+    Interval interval(100 / 3.6f, 250 / 3.6f);
+    RandomStream random(1);
+    BenchCase none = {0, 0, 0};
+    float sum = 0;
+
+    Clock::time_point start = Clock::now();
+    for (long i = 0; i < INTERVAL_SAMPLES; i++) {
+        sum += interval.uniform(random);
+    }
+    BenchResult uniform = result("Interval::uniform", none, INTERVAL_SAMPLES, nsSince(start), -1);
+
+    start = Clock::now();
+    for (long i = 0; i < INTERVAL_SAMPLES; i++) {
+        sum += interval.normal(random);
+    }
+    BenchResult normal = result("Interval::normal", none, INTERVAL_SAMPLES, nsSince(start), -1);
+    sink = sum;
+
+    uniform.hasCase = normal.hasCase = false;
+    results.push_back(uniform);
+    results.push_back(normal);
+}
+
+template<typename T>
+static std::vector<T> parseList(const std::string &key, const std::string &value) {
+    std::vector<T> list;
+    std::istringstream in(value);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        std::istringstream itemIn(item);
+        T t;
+        if (!(itemIn >> t) || !(itemIn >> std::ws).eof()) {
+            throw Error("Bad value for " + key + ": '" + value + "'");
+        }
+        list.push_back(t);
+    }
+    if (list.empty()) {
+        throw Error("Empty list for " + key);
+    }
+    return list;
+}
+
+static BenchOptions parseArgs(int argc, char **argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string key = argv[i];
+        if (i + 1 >= argc) {
+            throw Error("Usage: acc_bench [--lanes 1,3,8] [--vehicles-per-lane 1000,10000] [--acc-ratio 0,0.5]\n"
+                        "                 [--steps N] [--seed N] [--threads N] [--output FILE]");
+        }
+        std::string value = argv[++i];
+        if (key == "--lanes") {
+            options.lanes = parseList<int>(key, value);
+        } else if (key == "--vehicles-per-lane") {
+            options.vehiclesPerLane = parseList<int>(key, value);
+        } else if (key == "--acc-ratio") {
+            options.accRatios = parseList<float>(key, value);
+        } else if (key == "--steps") {
+            options.steps = parseList<int>(key, value).front();
+        } else if (key == "--seed") {
+            options.seed = parseList<int>(key, value).front();
+        } else if (key == "--threads") {
+            options.threads = parseList<int>(key, value).front();
+        } else if (key == "--output") {
+            options.output = value;
+        } else {
+            throw Error("Unknown option: " + key);
+        }
+    }
+    if (options.steps < 1) {
+        throw Error("--steps must be positive");
+    }
+    return options;
+}
+
+static void writeJson(std::ostream &out, const BenchOptions &options, const std::vector<BenchResult> &results) {
+    out << "{\n"
+        << "  \"compiler\": \"" << __VERSION__ << "\",\n"
+        << "  \"instructionSet\": \"" << AccelerationKernel::instructionSet() << "\",\n"
+        << "  \"threads\": " << options.threads << ",\n"
+        << "  \"seed\": " << options.seed << ",\n"
+        << "  \"steps\": " << options.steps << ",\n"
+        << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &r = results[i];
+        out << "    {\"name\": \"" << r.name << "\"";
+        if (r.hasCase) {
+            out << ", \"lanes\": " << r.shape.lanes
+                << ", \"vehiclesPerLane\": " << r.shape.vehiclesPerLane
+                << ", \"accRatio\": " << r.shape.accRatio;
+        }
+        out << ", \"iterations\": " << r.iterations
+            << ", \"nsPerOp\": " << r.nsPerOp;
+        if (r.nsPerVehicleStep >= 0) {
+            out << ", \"nsPerVehicleStep\": " << r.nsPerVehicleStep;
+        }
+        out << r.extra << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char **argv) {
+    try {
+        BenchOptions options = parseArgs(argc, argv);
+        std::vector<BenchResult> results;
+
+        HighwayBench::runInterval(results);
+        for (int lanes: options.lanes) {
+            for (int perLane: options.vehiclesPerLane) {
+                for (float accRatio: options.accRatios) {
+                    BenchCase c = {lanes, perLane, accRatio};
+                    std::cerr << "lanes " << lanes << ", vehicles per lane " << perLane
+                              << ", ACC ratio " << accRatio << std::endl;
+                    HighwayBench::runCase(options, c, results);
+                }
+            }
+        }
+
+        if (options.output.empty()) {
+            writeJson(std::cout, options, results);
+        } else {
+            std::ofstream out(options.output.c_str());
+            if (!out) {
+                throw Error("Can't write " + options.output);
+            }
+            writeJson(out, options, results);
+        }
+    } catch (const Error &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,233 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file AccelerationKernelTest.cpp
+ * @brief Checks the SIMD acceleration kernels against the scalar code, bit for bit
+ */
+
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "AccelerationKernel.h"
+#include "Highway.h"
+#include "Lane.h"
+
+/**
+ * Distance to the vehicle in front when there's none, as Highway sees it.
+ */
+static const float FAR_IN_FRONT = 1e6f;
+
+/**
+ * Instruction sets checked against the scalar code, where the CPU has them.
+ */
+static const char *const KERNELS[] = {"avx2", "sse2"};
+
+/**
+ * A run of vehicles, and what they see in front of them.
+ */
+struct KernelCase {
+    std::string name;
+    Lane lane;
+    size_t begin;
+    std::vector<float> frontDist;
+    std::vector<float> frontVRel;
+};
+
+static int failures = 0;
+static int checks = 0;
+
+/**
+ * Runs one kernel and the scalar code on copies of the lane, and compares what they wrote.
+ */
+static void check(const KernelCase &c, const char *kernel) {
+    Lane scalar(c.lane), simd(c.lane);
+    AccelerationKernel::runScalar(scalar, c.begin, scalar.size(), c.frontDist.data(), c.frontVRel.data());
+    if (!AccelerationKernel::runWith(kernel, simd, c.begin, simd.size(), c.frontDist.data(), c.frontVRel.data())) {
+        return;
+    }
+    checks++;
+
+    for (size_t i = 0; i < c.lane.size(); i++) {
+        // Bit for bit, so NaNs and signed zeros count too
+        bool same = std::memcmp(&scalar.a[i], &simd.a[i], sizeof(float)) == 0
+                    && scalar.unsatisfied[i] == simd.unsatisfied[i];
+        if (!same) {
+            std::cerr << "FAIL " << kernel << ", " << c.name << ", slot " << i << ": a " << simd.a[i]
+                      << " instead of " << scalar.a[i] << ", unsatisfied " << (int) simd.unsatisfied[i]
+                      << " instead of " << (int) scalar.unsatisfied[i] << "\n";
+            failures++;
+            return;
+        }
+    }
+}
+
+static void checkAll(const KernelCase &c) {
+    for (const char *kernel: KERNELS) {
+        check(c, kernel);
+    }
+}
+
+/**
+ * Made up vehicles, with the corner cases mixed in: no relative speed, nobody in front,
+ * right at the target distance, overlapping the one in front, in panic.
+ */
+static KernelCase syntheticCase(std::mt19937 &rng, size_t size, size_t begin, int kinds) {
+    std::uniform_real_distribution<float> unit(0, 1);
+    KernelCase c;
+    std::ostringstream name;
+    name << "synthetic, " << size << " vehicles from " << begin << ", kinds " << kinds;
+    c.name = name.str();
+    c.begin = begin;
+
+    for (size_t i = 0; i < size; i++) {
+        VehicleData d = {};
+        d.id = (VehicleId) i;
+        // 0: all random, 1: all ACC, 2: alternating, 3: mixed at random
+        bool acc = kinds == 1 || (kinds == 2 && i % 2 == 1) || (kinds == 3 && unit(rng) < 0.5f);
+        d.kind = acc ? VehicleKind::acc : VehicleKind::random;
+        d.x = i * 40.0;
+        d.v = 60 * unit(rng);
+        d.a = 123.0f;
+        d.targetSpeed = 10 + 50 * unit(rng);
+        d.targetDistance = 5 + 75 * unit(rng);
+        d.width = 2;
+        d.length = 4.5f;
+        d.panicDistance = 2 + 18 * unit(rng);
+        d.reactionTime = 0.5f + 1.5f * unit(rng);
+        d.terminalSpeed = 70;
+        d.maxAcceleration = 3 + 7 * unit(rng);
+        d.unsatisfied = unit(rng) < 0.5f;
+        c.lane.push_back(d);
+
+        float dist, vRel;
+        switch (i % 6) {
+            case 0:
+                dist = FAR_IN_FRONT;
+                vRel = 0;
+                break;
+            case 1:
+                dist = d.targetDistance;
+                vRel = 0;
+                break;
+            case 2:
+                dist = -d.length * unit(rng);
+                vRel = -10 * unit(rng);
+                break;
+            case 3:
+                dist = d.targetDistance - d.panicDistance - 1 - 5 * unit(rng);
+                vRel = 20 * unit(rng) - 10;
+                break;
+            default:
+                dist = 300 * unit(rng) - 30;
+                vRel = unit(rng) < 0.3f ? 0 : 20 * unit(rng) - 10;
+                break;
+        }
+        c.frontDist.push_back(dist);
+        c.frontVRel.push_back(vRel);
+    }
+    return c;
+}
+
+/**
+ * The lanes of a real highway, with the vehicle in front found the way Highway::findNeighbours does on a
+ * straight road. The lanes at the edges have no lane on one side, or on either with a single lane.
+ */
+static void highwayCases(int lanes) {
+    HighwayConfig config;
+    config.lanes = lanes;
+    config.vehiclesPerLane = 203;
+    config.accRatio = 0.3f;
+    config.stabiliseSteps = 200;
+    config.seed = 11;
+    config.threads = 1;
+    Highway highway(config);
+    highway.reportCollisions = false;
+    highway.stabilise();
+
+    for (size_t l = 0; l < highway.lanes.size(); l++) {
+        KernelCase c;
+        std::ostringstream name;
+        name << "highway of " << lanes << " lanes, lane " << l;
+        c.name = name.str();
+        c.lane = *highway.lanes[l];
+        c.begin = 0;
+
+        const Lane &lane = c.lane;
+        for (size_t i = 0; i < lane.size(); i++) {
+            if (i + 1 < lane.size()) {
+                c.frontDist.push_back((float) (lane.x[i + 1] - lane.x[i]) - lane.length[i + 1] / 2
+                                      - lane.length[i] / 2);
+                c.frontVRel.push_back(lane.v[i + 1] - lane.v[i]);
+            } else {
+                c.frontDist.push_back(FAR_IN_FRONT);
+                c.frontVRel.push_back(0);
+            }
+        }
+        checkAll(c);
+    }
+}
+
+int main() {
+    std::mt19937 rng(5);
+
+    // Every tail length after the vector loops, and a few longer runs, from the start or part way in
+    std::vector<size_t> sizes;
+    for (size_t n = 0; n <= 20; n++) {
+        sizes.push_back(n);
+    }
+    sizes.push_back(31);
+    sizes.push_back(33);
+    sizes.push_back(63);
+    sizes.push_back(1003);
+
+    for (size_t size: sizes) {
+        for (size_t begin: {0, 1, 3}) {
+            if (begin > size) {
+                continue;
+            }
+            for (int kinds = 0; kinds < 4; kinds++) {
+                checkAll(syntheticCase(rng, size, begin, kinds));
+            }
+        }
+    }
+
+    highwayCases(1);
+    highwayCases(3);
+
+    std::cout << checks << " runs checked against the scalar code (" << AccelerationKernel::instructionSet()
+              << " picked on this CPU), " << failures << " failed" << std::endl;
+    return failures == 0 && checks > 0 ? 0 : 1;
+}
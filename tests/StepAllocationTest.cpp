@@ -0,0 +1,92 @@
+/*
+ *  Copyright (c)  2016, Gabriel Vijiala, Stefan Teodorescu
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice, this
+ *  list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation and/or
+ *  other materials provided with the distribution.
+ *
+ *  3. Neither the name of the copyright holder nor the names of its contributors may
+ *  be used to endorse or promote products derived from this software without
+ *  specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file StepAllocationTest.cpp
+ * @brief Checks that Highway::step stops allocating once the lanes have found their sizes
+ */
+
+#include <iostream>
+#include "Highway.h"
+#include "HighwayConfig.h"
+
+/**
+ * Steps taken after stabilising before allocations count: the lanes may still be growing.
+ */
+static const int WARM_UP_STEPS = 600;
+
+/**
+ * Steps that mustn't allocate, a minute of simulated time.
+ */
+static const int CHECKED_STEPS = 3600;
+
+static const float DT = 1.0f / 60.0f;
+
+static int failures = 0;
+
+static void check(const char *name, int lanes, int vehiclesPerLane, int seed, float ringLength) {
+    HighwayConfig config;
+    config.lanes = lanes;
+    config.vehiclesPerLane = vehiclesPerLane;
+    config.seed = seed;
+    config.ringLength = ringLength;
+    Highway highway(config);
+    highway.reportCollisions = false;
+    highway.stabilise();
+
+    for (int s = 0; s < WARM_UP_STEPS; s++) {
+        highway.step(DT);
+    }
+    uint64_t allocations = 0;
+    int allocatingSteps = 0;
+    for (int s = 0; s < CHECKED_STEPS; s++) {
+        highway.step(DT);
+        if (highway.lastStepAllocations > 0) {
+            allocations += highway.lastStepAllocations;
+            allocatingSteps++;
+        }
+    }
+
+    std::cout << name << ": " << allocations << " heap allocations in " << allocatingSteps << " of "
+              << CHECKED_STEPS << " steps" << std::endl;
+    if (allocations > 0) {
+        failures++;
+    }
+}
+
+int main() {
+    check("4 lanes of 2000", 4, 2000, 3, 0);
+    check("3 lanes of 300", 3, 300, 7, 0);
+    check("1 lane of 1000", 1, 1000, 5, 0);
+    check("ring road, 3 lanes of 500", 3, 500, 9, 500 * 30.0f);
+    return failures == 0 ? 0 : 1;
+}